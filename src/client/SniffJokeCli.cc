@@ -272,6 +272,7 @@ bool SniffJokeCli::printSJStat(const uint8_t *statblock, uint32_t blocklen)
         /* this are the possibile used storave variables */
         bool boolvar = false;
         uint16_t intvar = 0;
+        uint32_t longvar = 0;
         char charvar[MEDIUMBUF];
         memset(charvar, 0x00, MEDIUMBUF);
         /* starting the parsing of the blocks */
@@ -365,6 +366,57 @@ bool SniffJokeCli::printSJStat(const uint8_t *statblock, uint32_t blocklen)
             memcpy(&charvar, pointed_data, singleData->len);
             printf("single plugin:\t\t%s\n", charvar);
             break;
+        case STAT_RXRING_USED:
+            memcpy(&longvar, pointed_data, singleData->len);
+            printf("rx ring blocks in use:\t%u\n", longvar);
+            break;
+        case STAT_RXRING_SIZE:
+            memcpy(&longvar, pointed_data, singleData->len);
+            printf("rx ring blocks:\t\t%u\n", longvar);
+            break;
+        case STAT_RXRING_DROPS:
+            memcpy(&longvar, pointed_data, singleData->len);
+            printf("rx ring drops:\t\t%u\n", longvar);
+            break;
+        case STAT_TXRING_USED:
+            memcpy(&longvar, pointed_data, singleData->len);
+            printf("tx ring frames in use:\t%u\n", longvar);
+            break;
+        case STAT_TXRING_SIZE:
+            memcpy(&longvar, pointed_data, singleData->len);
+            printf("tx ring frames:\t\t%u\n", longvar);
+            break;
+        case STAT_TXRING_DROPS:
+            memcpy(&longvar, pointed_data, singleData->len);
+            printf("tx ring drops:\t\t%u\n", longvar);
+            break;
+        case STAT_KEEPWAIT:
+            /* an histogram: the bucket i counts the waits < 2^i ms, the last the longer */
+            for (uint32_t i = 0; i < singleData->len / sizeof (uint32_t); ++i)
+            {
+                memcpy(&longvar, (uint8_t *) pointed_data + i * sizeof (uint32_t), sizeof (uint32_t));
+                if (i + 1 < singleData->len / sizeof (uint32_t))
+                    printf("keep wait < %u ms:\t%u\n", 1U << i, longvar);
+                else
+                    printf("keep wait >= %u ms:\t%u\n", 1U << (i - 1), longvar);
+            }
+            break;
+        case STAT_KEEPEXPIRED:
+            memcpy(&longvar, pointed_data, singleData->len);
+            printf("keep expired:\t\t%u\n", longvar);
+            break;
+        case STAT_POOL_USED:
+            memcpy(&longvar, pointed_data, singleData->len);
+            printf("packet buffers in use:\t%u\n", longvar);
+            break;
+        case STAT_POOL_SIZE:
+            memcpy(&longvar, pointed_data, singleData->len);
+            printf("packet buffers:\t\t%u\n", longvar);
+            break;
+        case STAT_POOL_DROPS:
+            memcpy(&longvar, pointed_data, singleData->len);
+            printf("packet pool drops:\t%u\n", longvar);
+            break;
         default:
             break;
         }
@@ -73,13 +73,13 @@ public:
         pkt->randomizeID();
 
         /* under test the anticipation seq only */
-        pkt->tcp->seq = htonl(ntohl(pkt->tcp->seq) + (random() % 5000) + 300);
-        /* pkt->tcp->seq = htonl(ntohl(pkt->tcp->seq) - (random() % 5000)); */
+        pkt->tcp->seq = htonl(ntohl(pkt->tcp->seq) + (sj_random() % 5000) + 300);
+        /* pkt->tcp->seq = htonl(ntohl(pkt->tcp->seq) - (sj_random() % 5000)); */
 
-        pkt->tcp->window = htons((random() % 80) * 64);
+        pkt->tcp->window = htons((sj_random() % 80) * 64);
         pkt->tcp->ack = pkt->tcp->ack_seq = 0;
 
-        uint16_t newpayloadlen = random() % 100 + 200;
+        uint16_t newpayloadlen = sj_random() % 100 + 200;
 
         pkt->tcppayloadResize(newpayloadlen);
         pkt->tcppayloadRandomFill();
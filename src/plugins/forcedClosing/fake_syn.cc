@@ -73,13 +73,13 @@ public:
 
             pkt->randomizeID();
 
-            pkt->tcp->seq = htonl(ntohl(pkt->tcp->seq) + 65535 + (random() % 5000));
+            pkt->tcp->seq = htonl(ntohl(pkt->tcp->seq) + 65535 + (sj_random() % 5000));
 
             /* 20% is a SYN ACK */
-            if ((random() % 5) == 0)
+            if ((sj_random() % 5) == 0)
             {
                 pkt->tcp->ack = 1;
-                pkt->tcp->ack_seq = random();
+                pkt->tcp->ack_seq = sj_random();
             }
             else
             {
@@ -88,7 +88,7 @@ public:
             }
 
             /* 20% had source and dest port reversed */
-            if ((random() % 5) == 0)
+            if ((sj_random() % 5) == 0)
             {
                 uint16_t swap = pkt->tcp->source;
                 pkt->tcp->source = pkt->tcp->dest;
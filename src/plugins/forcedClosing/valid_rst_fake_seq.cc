@@ -127,7 +127,7 @@ public:
         pkt->randomizeID();
 
         pkt->tcp->rst = 1;
-        pkt->tcp->seq = htonl(ntohl(pkt->tcp->seq) + (65535 * 5) + (random() % 65535) );
+        pkt->tcp->seq = htonl(ntohl(pkt->tcp->seq) + (65535 * 5) + (sj_random() % 65535) );
         pkt->tcp->window = htons((uint16_t) (-1));
 
         /* tcp->ack and tcp->ack_seq is kept untouched */
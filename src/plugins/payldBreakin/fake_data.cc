@@ -74,7 +74,7 @@ private:
         if (random_percent(50))
         {
             pkt->tcp->urg = 1;
-            pkt->tcp->urg_ptr = pkt->tcp->seq << random() % 5;
+            pkt->tcp->urg_ptr = pkt->tcp->seq << sj_random() % 5;
         }
         else
         {
@@ -116,7 +116,7 @@ public:
          * due to the ratio: MIN_TCP_PAYLOAD = (MIN_SPLIT_PKTS * MIN_SPLIT_PAYLOAD)
          * the hack will produce pkts between a min of MIN_SPLIT_PKTS and a max of MAX_SPLIT_PKTS
          */
-        uint8_t pkts_n = MIN_SPLIT_PKTS + random() % (MAX_SPLIT_PKTS - (MIN_SPLIT_PKTS - 1));
+        uint8_t pkts_n = MIN_SPLIT_PKTS + sj_random() % (MAX_SPLIT_PKTS - (MIN_SPLIT_PKTS - 1));
         uint32_t split_size = origpkt.tcppayloadlen / pkts_n;
         split_size = split_size > MIN_SPLIT_PAYLOAD ? split_size : MIN_SPLIT_PAYLOAD;
         pkts_n = (origpkt.tcppayloadlen / split_size) + ((origpkt.tcppayloadlen % split_size) ? 1 : 0);
@@ -0,0 +1,222 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Checksum.h"
+
+#if defined(__x86_64__) || defined(__i386__)
+#define SJ_CSUM_X86
+#include <immintrin.h>
+#endif
+
+/*
+ * the vector kernels keep 32 bit lanes: every iteration adds at most two
+ * words to a lane, the lanes are moved in a 64 bit sum every
+ * CSUM_BLOCK_ITERATIONS, and the total is folded in 17 bits at the end.
+ * the buffers shorter than CSUM_VECTOR_MIN (the headers) are summed by
+ * the scalar kernel, and the tail of a buffer by the next smaller kernel.
+ */
+#define CSUM_BLOCK_ITERATIONS   16384
+#define CSUM_VECTOR_MIN         128
+
+static uint32_t foldSum(uint64_t sum)
+{
+    sum = (sum & 0xFFFFFFFF) + (sum >> 32);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+    sum = (sum & 0xFFFF) + (sum >> 16);
+
+    return sum;
+}
+
+static uint32_t halfsumScalar(const unsigned char *data, uint32_t len)
+{
+    const uint16_t *usdata = (const uint16_t *) data;
+    const uint16_t *end = (const uint16_t *) data + (len / sizeof (uint16_t));
+    uint64_t sum = 0;
+
+    while (usdata != end)
+        sum += *usdata++;
+
+    if (len % 2)
+        sum += *(const uint8_t *) usdata;
+
+    return foldSum(sum);
+}
+
+#ifdef SJ_CSUM_X86
+
+__attribute__((target("sse2")))
+static uint32_t halfsumSSE2(const unsigned char *data, uint32_t len)
+{
+    const __m128i zero = _mm_setzero_si128();
+    uint64_t sum = 0;
+    uint32_t i = 0;
+
+    if (len < CSUM_VECTOR_MIN)
+        return halfsumScalar(data, len);
+
+    while (len - i >= 32)
+    {
+        __m128i acc0 = zero, acc1 = zero;
+        uint32_t n = 0;
+
+        for (; len - i >= 32 && n < CSUM_BLOCK_ITERATIONS; i += 32, ++n)
+        {
+            const __m128i v0 = _mm_loadu_si128((const __m128i *) (data + i));
+            const __m128i v1 = _mm_loadu_si128((const __m128i *) (data + i + 16));
+
+            acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(v0, zero));
+            acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(v0, zero));
+            acc0 = _mm_add_epi32(acc0, _mm_unpacklo_epi16(v1, zero));
+            acc1 = _mm_add_epi32(acc1, _mm_unpackhi_epi16(v1, zero));
+        }
+
+        uint32_t lanes[8];
+        _mm_storeu_si128((__m128i *) lanes, acc0);
+        _mm_storeu_si128((__m128i *) (lanes + 4), acc1);
+        for (uint32_t l = 0; l < 8; ++l)
+            sum += lanes[l];
+    }
+
+    return foldSum(sum + halfsumScalar(data + i, len - i));
+}
+
+__attribute__((target("avx2")))
+static uint32_t halfsumAVX2(const unsigned char *data, uint32_t len)
+{
+    const __m256i zero = _mm256_setzero_si256();
+    uint64_t sum = 0;
+    uint32_t i = 0;
+
+    if (len < CSUM_VECTOR_MIN)
+        return halfsumScalar(data, len);
+
+    while (len - i >= 64)
+    {
+        __m256i acc0 = zero, acc1 = zero;
+        uint32_t n = 0;
+
+        for (; len - i >= 64 && n < CSUM_BLOCK_ITERATIONS; i += 64, ++n)
+        {
+            const __m256i v0 = _mm256_loadu_si256((const __m256i *) (data + i));
+            const __m256i v1 = _mm256_loadu_si256((const __m256i *) (data + i + 32));
+
+            acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v0, zero));
+            acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v0, zero));
+            acc0 = _mm256_add_epi32(acc0, _mm256_unpacklo_epi16(v1, zero));
+            acc1 = _mm256_add_epi32(acc1, _mm256_unpackhi_epi16(v1, zero));
+        }
+
+        uint32_t lanes[16];
+        _mm256_storeu_si256((__m256i *) lanes, acc0);
+        _mm256_storeu_si256((__m256i *) (lanes + 8), acc1);
+        for (uint32_t l = 0; l < 16; ++l)
+            sum += lanes[l];
+    }
+
+    /* the SSE2 kernel has not the VEX encoding */
+    _mm256_zeroupper();
+
+    return foldSum(sum + halfsumSSE2(data + i, len - i));
+}
+
+__attribute__((target("avx512f,avx512bw")))
+static uint32_t halfsumAVX512(const unsigned char *data, uint32_t len)
+{
+    const __m512i zero = _mm512_setzero_si512();
+    uint64_t sum = 0;
+    uint32_t i = 0;
+
+    if (len < CSUM_VECTOR_MIN)
+        return halfsumScalar(data, len);
+
+    while (len - i >= 128)
+    {
+        __m512i acc0 = zero, acc1 = zero;
+        uint32_t n = 0;
+
+        for (; len - i >= 128 && n < CSUM_BLOCK_ITERATIONS; i += 128, ++n)
+        {
+            const __m512i v0 = _mm512_loadu_si512((const void *) (data + i));
+            const __m512i v1 = _mm512_loadu_si512((const void *) (data + i + 64));
+
+            acc0 = _mm512_add_epi32(acc0, _mm512_unpacklo_epi16(v0, zero));
+            acc1 = _mm512_add_epi32(acc1, _mm512_unpackhi_epi16(v0, zero));
+            acc0 = _mm512_add_epi32(acc0, _mm512_unpacklo_epi16(v1, zero));
+            acc1 = _mm512_add_epi32(acc1, _mm512_unpackhi_epi16(v1, zero));
+        }
+
+        uint32_t lanes[32];
+        _mm512_storeu_si512((void *) lanes, acc0);
+        _mm512_storeu_si512((void *) (lanes + 16), acc1);
+        for (uint32_t l = 0; l < 32; ++l)
+            sum += lanes[l];
+    }
+
+    _mm256_zeroupper();
+
+    return foldSum(sum + halfsumAVX2(data + i, len - i));
+}
+
+#endif /* SJ_CSUM_X86 */
+
+static const struct sj_csum_kernel csum_kernels[] = {
+    { "scalar", halfsumScalar },
+#ifdef SJ_CSUM_X86
+    { "sse2", halfsumSSE2 },
+    { "avx2", halfsumAVX2 },
+    { "avx512", halfsumAVX512 },
+#endif
+};
+
+uint32_t sj_csum_kernels(const struct sj_csum_kernel **kernels)
+{
+    uint32_t usable = 1;
+
+#ifdef SJ_CSUM_X86
+    __builtin_cpu_init();
+
+    if (__builtin_cpu_supports("sse2"))
+    {
+        usable = 2;
+        if (__builtin_cpu_supports("avx2"))
+        {
+            usable = 3;
+            if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw"))
+                usable = 4;
+        }
+    }
+#endif
+
+    *kernels = csum_kernels;
+
+    return usable;
+}
+
+static const struct sj_csum_kernel *selectKernel(void)
+{
+    const struct sj_csum_kernel *kernels;
+    const uint32_t usable = sj_csum_kernels(&kernels);
+
+    return &kernels[usable - 1];
+}
+
+const struct sj_csum_kernel *sj_csum = selectKernel();
@@ -0,0 +1,49 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SJ_CHECKSUM_H
+#define SJ_CHECKSUM_H
+
+#include <stdint.h>
+
+/*
+ * the one's complement sum of the internet checksum (RFC 1071), over the
+ * 16 bit words in host order; the result is not folded and not
+ * complemented, and sums of different buffers can be added together
+ * while their lengths, except the last, are even.
+ *
+ * the sum is implemented by a scalar kernel and by SSE2, AVX2 and
+ * AVX-512 kernels: the fastest usable by the cpu is selected at startup.
+ */
+struct sj_csum_kernel
+{
+    const char *name;
+    uint32_t (*halfsum)(const unsigned char *, uint32_t);
+};
+
+/* the kernels usable by this cpu: the scalar one first, the fastest last */
+uint32_t sj_csum_kernels(const struct sj_csum_kernel **);
+
+/* the kernel used by sniffjoke */
+extern const struct sj_csum_kernel *sj_csum;
+
+#endif /* SJ_CHECKSUM_H */
@@ -0,0 +1,110 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+/*
+ * sniffjoke-checksum-bench: compares the checksum kernels usable by the
+ * cpu over the sizes of the packets handled by sniffjoke, verifying
+ * that every kernel gives the sum of the scalar one.
+ *
+ *   sniffjoke-checksum-bench [megabytes summed for every size, def. 256]
+ */
+
+#include "Checksum.h"
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <vector>
+
+using namespace std;
+
+static const uint32_t bench_sizes[] = { 20, 40, 60, 64, 128, 576, 1280, 1500, 4096, 9000, 16384, 65535 };
+
+static uint64_t monotonicNsec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000000 + now.tv_nsec;
+}
+
+static uint16_t foldedSum(uint32_t sum)
+{
+    sum = (sum >> 16) + (sum & 0xFFFF);
+    sum += (sum >> 16);
+
+    return sum & 0xFFFF;
+}
+
+int main(int argc, char **argv)
+{
+    const uint64_t megabytes = (argc > 1) ? strtoul(argv[1], NULL, 10) : 256;
+    const struct sj_csum_kernel *kernels;
+    const uint32_t usable = sj_csum_kernels(&kernels);
+    const uint32_t max_size = bench_sizes[sizeof (bench_sizes) / sizeof (bench_sizes[0]) - 1];
+    bool mismatch = false;
+
+    /* an odd offset of the buffer tests also the unaligned loads */
+    vector<unsigned char> buf(max_size + 1);
+    srandom(time(NULL));
+    for (uint32_t i = 0; i < buf.size(); ++i)
+        buf[i] = random();
+    const unsigned char *data = &buf[1];
+
+    printf("%8s", "bytes");
+    for (uint32_t k = 0; k < usable; ++k)
+        printf(" %16s", kernels[k].name);
+    printf("   (ns per sum, GB/s; selected: %s)\n", sj_csum->name);
+
+    for (uint32_t s = 0; s < sizeof (bench_sizes) / sizeof (bench_sizes[0]); ++s)
+    {
+        const uint32_t size = bench_sizes[s];
+        const uint64_t rounds = (megabytes * 1024 * 1024) / size + 1;
+        const uint16_t expected = foldedSum(kernels[0].halfsum(data, size));
+
+        printf("%8u", size);
+
+        for (uint32_t k = 0; k < usable; ++k)
+        {
+            volatile uint32_t sink = 0;
+
+            if (foldedSum(kernels[k].halfsum(data, size)) != expected)
+            {
+                printf(" %16s", "MISMATCH");
+                mismatch = true;
+                continue;
+            }
+
+            const uint64_t start = monotonicNsec();
+            for (uint64_t r = 0; r < rounds; ++r)
+                sink += kernels[k].halfsum(data, size);
+            const uint64_t elapsed = monotonicNsec() - start;
+
+            printf("  %7.1f %7.2f", (double) elapsed / rounds, (double) rounds * size / elapsed);
+        }
+
+        printf("\n");
+    }
+
+    return mismatch ? 1 : 0;
+}
@@ -58,6 +58,7 @@ bool Debug::appendOpen(uint8_t thislevel, const char *fname, char *buf, FILE **p
     {
         log(thislevel, __func__, "requested close of logfile %s (vars used: %s and level %d)",
             fname, fname, thislevel);
+        ring.flush(*previously);
         fclose(*previously);
         *previously = NULL;
     }
@@ -67,8 +68,8 @@ bool Debug::appendOpen(uint8_t thislevel, const char *fname, char *buf, FILE **p
         if ((fname == NULL) || ((*previously = fopen(fname, "a+")) == NULL))
             return false;
 
-        /* setbuffer(*previously, buf, DEBUGBUFFER); */
-        setlinebuf(*previously);
+        /* the log writer flushes once per batch, the synchronous log once per line */
+        setbuffer(*previously, buf, DEBUGBUFFER);
 
         log(thislevel, __func__, "opened logfile %s successful with debug level %d", fname, debuglevel);
     }
@@ -84,7 +85,7 @@ bool Debug::resetLevel(void)
     if (!appendOpen(SESSION_LEVEL, session_logstream_file, session_logstream_buf, &session_logstream))
         return false;
 
-    if (!appendOpen(PACKET_LEVEL, packet_logstream_file, session_logstream_buf, &packet_logstream))
+    if (!appendOpen(PACKET_LEVEL, packet_logstream_file, packet_logstream_buf, &packet_logstream))
         return false;
 
     return true;
@@ -107,18 +108,29 @@ void Debug::log(uint8_t errorlevel, const char *funcname, const char *msg, ...)
         else if (errorlevel == SESSION_LEVEL && session_logstream != NULL)
             output_flow = session_logstream;
 
-        /* the debug level used in development include function/pid/uid addictional infos */
-        if (errorlevel == DEBUG_LEVEL)
-            fprintf(output_flow, "%s %s %d/%d ", sj_clock_str, funcname, getpid(), getuid());
-        else
-            fprintf(output_flow, "%s ", sj_clock_str);
-
         va_list arguments;
         va_start(arguments, msg);
-        vfprintf(output_flow, msg, arguments);
-        va_end(arguments);
 
-        fprintf(output_flow, "\n");
+        /* with the log writer running the line is only captured in the ring */
+        if (ring.active())
+        {
+            ring.push(output_flow, (errorlevel == DEBUG_LEVEL) ? LOGPREFIX_DEBUG : LOGPREFIX_CLOCK,
+                      funcname, msg, arguments);
+        }
+        else
+        {
+            /* the debug level used in development include function/pid/uid addictional infos */
+            if (errorlevel == DEBUG_LEVEL)
+                fprintf(output_flow, "%s %s %d/%d ", sj_clock_str, funcname, getpid(), getuid());
+            else
+                fprintf(output_flow, "%s ", sj_clock_str);
+
+            vfprintf(output_flow, msg, arguments);
+            fprintf(output_flow, "\n");
+            fflush(output_flow);
+        }
+
+        va_end(arguments);
     }
 }
 
@@ -153,8 +165,7 @@ selfName(sN)
     if(fchmod(fileno(logstream),  0666) == -1)
         RUNTIME_EXCEPTION("unable to make plugin %s (%s) rw+uga: %s", selfName, LfN, strerror(errno));
 
-    /* setbuffer(logstream, logstream_buf, DEBUGBUFFER); */
-    setlinebuf(logstream);
+    setbuffer(logstream, logstream_buf, DEBUGBUFFER);
 
     completeLog("opened file %s successful for handler %s", LfN, selfName);
 }
@@ -162,17 +173,27 @@ selfName(sN)
 pluginLogHandler::~pluginLogHandler(void)
 {
     completeLog("requested logfile closing %s", selfName);
+    debug.ring.flush(logstream);
     fclose(logstream);
 }
 
 void pluginLogHandler::completeLog(const char *msg, ...)
 {
-    fprintf(logstream, "%s ", sj_clock_str);
-
     va_list arguments;
     va_start(arguments, msg);
-    vfprintf(logstream, msg, arguments);
-    fprintf(logstream, "\n");
+
+    if (debug.ring.active())
+    {
+        debug.ring.push(logstream, LOGPREFIX_CLOCK, NULL, msg, arguments);
+    }
+    else
+    {
+        fprintf(logstream, "%s ", sj_clock_str);
+        vfprintf(logstream, msg, arguments);
+        fprintf(logstream, "\n");
+        fflush(logstream);
+    }
+
     va_end(arguments);
 }
 
@@ -180,7 +201,17 @@ void pluginLogHandler::simpleLog(const char *msg, ...)
 {
     va_list arguments;
     va_start(arguments, msg);
-    vfprintf(logstream, msg, arguments);
-    fprintf(logstream, "\n");
+
+    if (debug.ring.active())
+    {
+        debug.ring.push(logstream, LOGPREFIX_NONE, NULL, msg, arguments);
+    }
+    else
+    {
+        vfprintf(logstream, msg, arguments);
+        fprintf(logstream, "\n");
+        fflush(logstream);
+    }
+
     va_end(arguments);
 }
@@ -24,6 +24,7 @@
 #define SJ_DEBUG_H
 
 #include "Utils.h"
+#include "LogRing.h"
 
 #define DEBUGBUFFER 65536 /* 64k */
 
@@ -33,6 +34,7 @@ private:
 
     friend class SniffJoke;
     friend class Process;
+    friend class pluginLogHandler;
 
     uint8_t debuglevel;
     const char* logstream_file;
@@ -45,6 +47,9 @@ private:
     char session_logstream_buf[DEBUGBUFFER];
     char packet_logstream_buf[DEBUGBUFFER];
 
+    /* when active the logs are written by its thread */
+    LogRing ring;
+
     void setLogstream(const char *lsf);
     void setSessionLogstream(const char *lsf);
     void setPacketLogstream(const char *lsf);
@@ -57,10 +62,23 @@ public:
 
     void log(uint8_t, const char *, const char *, ...);
 
-    uint8_t level(void)
+    uint8_t level(void) const
     {
         return debuglevel;
     };
+
+    /*
+     * with DISABLE_PACKET_LOG the session and packet levels are never
+     * enabled: called with a constant level the check is folded away.
+     */
+    bool enabled(uint8_t thislevel) const
+    {
+#ifdef DISABLE_PACKET_LOG
+        if (thislevel >= SESSION_LEVEL)
+            return false;
+#endif
+        return thislevel <= debuglevel;
+    }
 };
 
 /* Facility to support debug and dumping by the plugins */
@@ -78,11 +96,18 @@ public:
 };
 
 
-#define LOG_ALL(...)     debug.log(ALL_LEVEL, __func__, __VA_ARGS__)
-#define LOG_VERBOSE(...) debug.log(VERBOSE_LEVEL, __func__, __VA_ARGS__)
-#define LOG_DEBUG(...)   debug.log(DEBUG_LEVEL, __func__, __VA_ARGS__)
-#define LOG_SESSION(...) debug.log(SESSION_LEVEL, __func__, __VA_ARGS__)
-#define LOG_PACKET(...)  debug.log(PACKET_LEVEL, __func__, __VA_ARGS__)
+/*
+ * the arguments of a log line are evaluated only when its level is
+ * enabled, a disabled line costs a single compare.
+ */
+#define LOG_LEVEL(lvl, ...) \
+    do { if (debug.enabled(lvl)) debug.log(lvl, __func__, __VA_ARGS__); } while (0)
+
+#define LOG_ALL(...)     LOG_LEVEL(ALL_LEVEL, __VA_ARGS__)
+#define LOG_VERBOSE(...) LOG_LEVEL(VERBOSE_LEVEL, __VA_ARGS__)
+#define LOG_DEBUG(...)   LOG_LEVEL(DEBUG_LEVEL, __VA_ARGS__)
+#define LOG_SESSION(...) LOG_LEVEL(SESSION_LEVEL, __VA_ARGS__)
+#define LOG_PACKET(...)  LOG_LEVEL(PACKET_LEVEL, __VA_ARGS__)
 
 
 /* global debug object defined into Debug.cc and exported by this module */
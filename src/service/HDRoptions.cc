@@ -355,7 +355,7 @@ void HDRoptions::randomInjector(void)
     for (uint8_t i = protD.firstOptIndex; i <= protD.lastOptIndex; ++i)
         seq.push_back(i);
 
-    random_shuffle(seq.begin(), seq.end());
+    random_shuffle(seq.begin(), seq.end(), sj_random_below);
 
     for (vector<uint8_t>::iterator it = seq.begin(); it != seq.end(); ++it)
         injector(*it);
@@ -40,11 +40,8 @@ IPList::~IPList(void)
     SELFLOG("");
 }
 
-void IPList::selflog(const char *func, const char *format, ...) const
+void IPList::selflogFormat(const char *func, const char *format, ...) const
 {
-    if (debug.level() == SUPPRESS_LEVEL)
-        return;
-
     char loginfo[LARGEBUF];
     va_list arguments;
     va_start(arguments, format);
@@ -37,7 +37,12 @@ public:
     ~IPList(void);
 
     /* utilities */
-    void selflog(const char *func, const char *format, ...) const;
+    __attribute__((always_inline)) void selflog(const char *func, const char *format, ...) const
+    {
+        if (debug.enabled(SESSION_LEVEL))
+            selflogFormat(func, format, __builtin_va_arg_pack());
+    }
+    void selflogFormat(const char *, const char *, ...) const;
 };
 
 class IPListMap : public map<const uint32_t, IPList*>
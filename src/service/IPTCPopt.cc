@@ -52,7 +52,7 @@ uint8_t IPTCPopt::getBestRandsize(struct optHdrData *oD, uint8_t fixedLen, uint8
         return 0;
 
     if (checkedAvail > maxComputed)
-        return (((random() % (maxRblks - minRblks + 1)) + minRblks) * blockSize) + fixedLen;
+        return (((sj_random() % (maxRblks - minRblks + 1)) + minRblks) * blockSize) + fixedLen;
 
     /* else should try the best filling of memory and the NOP fill after */
 
@@ -0,0 +1,93 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LRUList.h"
+
+LRUList::LRUList(uint32_t capacity) :
+nodes(new lru_node[capacity]),
+oldest(LRU_NONE),
+newest(LRU_NONE)
+{
+    /* the nodes are acquired from the first */
+    free_nodes.reserve(capacity);
+    for (uint32_t i = capacity; i != 0; --i)
+        free_nodes.push_back(i - 1);
+}
+
+LRUList::~LRUList(void)
+{
+    delete[] nodes;
+}
+
+void LRUList::unlink(uint32_t node)
+{
+    if (nodes[node].older != LRU_NONE)
+        nodes[nodes[node].older].newer = nodes[node].newer;
+    else
+        oldest = nodes[node].newer;
+
+    if (nodes[node].newer != LRU_NONE)
+        nodes[nodes[node].newer].older = nodes[node].older;
+    else
+        newest = nodes[node].older;
+}
+
+/* the node is linked as the most recently used */
+void LRUList::link(uint32_t node)
+{
+    nodes[node].older = newest;
+    nodes[node].newer = LRU_NONE;
+
+    if (newest != LRU_NONE)
+        nodes[newest].newer = node;
+    else
+        oldest = node;
+
+    newest = node;
+}
+
+/* a node for a new record, the most recently used: the caller checks full() */
+uint32_t LRUList::acquire(void)
+{
+    const uint32_t node = free_nodes.back();
+    free_nodes.pop_back();
+
+    nodes[node].slot = LRU_NONE;
+    link(node);
+
+    return node;
+}
+
+void LRUList::release(uint32_t node)
+{
+    unlink(node);
+    free_nodes.push_back(node);
+}
+
+void LRUList::touch(uint32_t node)
+{
+    if (node == newest)
+        return;
+
+    unlink(node);
+    link(node);
+}
@@ -0,0 +1,93 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SJ_LRULIST_H
+#define SJ_LRULIST_H
+
+#include "Utils.h"
+
+#define LRU_NONE    0xFFFFFFFF
+
+/*
+ * LRUList orders the records of a map from the least to the most recently
+ * used: the nodes are allocated once for the capacity of the map, every
+ * record keeps the index of its node and the node the slot of its record,
+ * updated by the map when the record is moved.
+ *
+ * all the operations are O(1): the map evicts the oldest record when full,
+ * and the expiry stops at the first record still used.
+ */
+class LRUList
+{
+private:
+
+    struct lru_node
+    {
+        uint32_t older;
+        uint32_t newer;
+        uint32_t slot;
+    };
+
+    lru_node *nodes;
+    uint32_t oldest;
+    uint32_t newest;
+    vector<uint32_t> free_nodes;
+
+    void unlink(uint32_t);
+    void link(uint32_t);
+
+public:
+
+    LRUList(uint32_t);
+    ~LRUList(void);
+
+    uint32_t acquire(void);
+    void release(uint32_t);
+    void touch(uint32_t);
+
+    bool full(void) const
+    {
+        return free_nodes.empty();
+    }
+
+    void setSlot(uint32_t node, uint32_t slot)
+    {
+        nodes[node].slot = slot;
+    }
+
+    uint32_t getSlot(uint32_t node) const
+    {
+        return nodes[node].slot;
+    }
+
+    uint32_t getOldest(void) const
+    {
+        return oldest;
+    }
+
+    uint32_t getNewer(uint32_t node) const
+    {
+        return nodes[node].newer;
+    }
+};
+
+#endif /* SJ_LRULIST_H */
@@ -0,0 +1,728 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "LogRing.h"
+#include "Utils.h"
+
+#include <cctype>
+#include <cstddef>
+#include <poll.h>
+#include <sched.h>
+#include <signal.h>
+#include <sys/eventfd.h>
+
+/*
+ * the data of a record are the format, the function name of a
+ * LOGPREFIX_DEBUG record and the arguments: the integers as 64 bit,
+ * the floating points as double or long double, the strings with
+ * their terminator.
+ */
+struct LogRing::logRecord
+{
+    volatile uint32_t sequence;
+    uint8_t prefix;
+    bool truncated;
+    uint16_t len;
+    pid_t pid;
+    uid_t uid;
+    time_t clock;
+    FILE *stream;
+    unsigned char data[LOGRING_RECORD_SIZE];
+};
+
+/* the classes of the arguments, given by the conversion */
+enum logarg_t
+{
+    LOGARG_NONE, LOGARG_SKIP, LOGARG_SIGNED, LOGARG_UNSIGNED, LOGARG_DOUBLE,
+    LOGARG_LDOUBLE, LOGARG_STRING, LOGARG_POINTER, LOGARG_INVALID
+};
+
+/* a printf conversion, as far as the capture of its argument requires */
+struct logConversion
+{
+    char conv;
+    char length;    /* 0, h, H (hh), l, q (ll), L, z, j, t */
+    uint8_t stars;  /* the '*' of the width and of the precision */
+    logarg_t argclass;
+};
+
+/* p follows the '%', the returned pointer follows the conversion */
+static const char *parseConversion(const char *p, struct logConversion &c)
+{
+    c.length = 0;
+    c.stars = 0;
+
+    while (*p && strchr("-+ #0'", *p) != NULL)
+        ++p;
+
+    if (*p == '*')
+    {
+        ++c.stars;
+        ++p;
+    }
+    else
+    {
+        while (isdigit(*p))
+            ++p;
+    }
+
+    if (*p == '.')
+    {
+        if (*++p == '*')
+        {
+            ++c.stars;
+            ++p;
+        }
+        else
+        {
+            while (isdigit(*p))
+                ++p;
+        }
+    }
+
+    switch (*p)
+    {
+    case 'h':
+        c.length = (*++p == 'h') ? (++p, 'H') : 'h';
+        break;
+    case 'l':
+        c.length = (*++p == 'l') ? (++p, 'q') : 'l';
+        break;
+    case 'q':
+    case 'L':
+    case 'z':
+    case 'j':
+    case 't':
+        c.length = *p++;
+        break;
+    }
+
+    c.conv = *p;
+
+    switch (c.conv)
+    {
+    case '%':
+        c.argclass = LOGARG_NONE;
+        break;
+    case 'n':
+        c.argclass = LOGARG_SKIP;
+        break;
+    case 'd':
+    case 'i':
+        c.argclass = LOGARG_SIGNED;
+        break;
+    case 'c':
+        c.argclass = (c.length == 0) ? LOGARG_SIGNED : LOGARG_INVALID;
+        break;
+    case 'u':
+    case 'o':
+    case 'x':
+    case 'X':
+        c.argclass = LOGARG_UNSIGNED;
+        break;
+    case 'e':
+    case 'E':
+    case 'f':
+    case 'F':
+    case 'g':
+    case 'G':
+    case 'a':
+    case 'A':
+        c.argclass = (c.length == 'L') ? LOGARG_LDOUBLE : LOGARG_DOUBLE;
+        break;
+    case 's':
+        c.argclass = (c.length == 0) ? LOGARG_STRING : LOGARG_INVALID;
+        break;
+    case 'p':
+        c.argclass = LOGARG_POINTER;
+        break;
+    default:
+        c.argclass = LOGARG_INVALID;
+        return p;
+    }
+
+    return p + 1;
+}
+
+static int64_t fetchSigned(char length, va_list &arguments)
+{
+    switch (length)
+    {
+    case 'l': return va_arg(arguments, long);
+    case 'q': return va_arg(arguments, int64_t);
+    case 'z': return va_arg(arguments, ssize_t);
+    case 'j': return va_arg(arguments, intmax_t);
+    case 't': return va_arg(arguments, ptrdiff_t);
+    default: return va_arg(arguments, int);
+    }
+}
+
+static uint64_t fetchUnsigned(char length, va_list &arguments)
+{
+    switch (length)
+    {
+    case 'l': return va_arg(arguments, unsigned long);
+    case 'q': return va_arg(arguments, uint64_t);
+    case 'z': return va_arg(arguments, size_t);
+    case 'j': return va_arg(arguments, uintmax_t);
+    case 't': return va_arg(arguments, ptrdiff_t);
+    default: return va_arg(arguments, unsigned int);
+    }
+}
+
+static bool putValue(unsigned char *&p, const unsigned char *end, const void *value, size_t size)
+{
+    if (p + size > end)
+        return false;
+
+    memcpy(p, value, size);
+    p += size;
+    return true;
+}
+
+/* a string is truncated to the space available, at least its terminator has to fit */
+static bool putString(unsigned char *&p, const unsigned char *end, const char *str)
+{
+    if (p >= end)
+        return false;
+
+    size_t len = strlen(str);
+    if (len > (size_t) (end - p) - 1)
+        len = (end - p) - 1;
+
+    memcpy(p, str, len);
+    p[len] = '\0';
+    p += len + 1;
+    return true;
+}
+
+static bool getValue(const unsigned char *&p, const unsigned char *end, void *value, size_t size)
+{
+    if (p + size > end)
+        return false;
+
+    memcpy(value, p, size);
+    p += size;
+    return true;
+}
+
+template <typename T>
+static void printValue(FILE *out, const char *spec, const int *star, uint8_t stars, T value)
+{
+    if (stars == 2)
+        fprintf(out, spec, star[0], star[1], value);
+    else if (stars == 1)
+        fprintf(out, spec, star[0], value);
+    else
+        fprintf(out, spec, value);
+}
+
+static void printSigned(FILE *out, const char *spec, const int *star, const struct logConversion &c, int64_t value)
+{
+    switch (c.length)
+    {
+    case 'l': printValue(out, spec, star, c.stars, (long) value);
+        break;
+    case 'q': printValue(out, spec, star, c.stars, value);
+        break;
+    case 'z': printValue(out, spec, star, c.stars, (ssize_t) value);
+        break;
+    case 'j': printValue(out, spec, star, c.stars, (intmax_t) value);
+        break;
+    case 't': printValue(out, spec, star, c.stars, (ptrdiff_t) value);
+        break;
+    default: printValue(out, spec, star, c.stars, (int) value);
+    }
+}
+
+static void printUnsigned(FILE *out, const char *spec, const int *star, const struct logConversion &c, uint64_t value)
+{
+    switch (c.length)
+    {
+    case 'l': printValue(out, spec, star, c.stars, (unsigned long) value);
+        break;
+    case 'q': printValue(out, spec, star, c.stars, value);
+        break;
+    case 'z': printValue(out, spec, star, c.stars, (size_t) value);
+        break;
+    case 'j': printValue(out, spec, star, c.stars, (uintmax_t) value);
+        break;
+    case 't': printValue(out, spec, star, c.stars, (ptrdiff_t) value);
+        break;
+    default: printValue(out, spec, star, c.stars, (unsigned int) value);
+    }
+}
+
+void *logRingWriter(void *arg)
+{
+    LogRing &ring = *(LogRing *) arg;
+    vector<FILE *> touched;
+
+    while (true)
+    {
+        /* read before the drain: the records pushed before stop() are written */
+        const bool stopping = !ring.running;
+
+        FILE *stream;
+        uint32_t written = 0;
+
+        while (written < LOGRING_SLOTS && ring.pop(&stream))
+        {
+            if (find(touched.begin(), touched.end(), stream) == touched.end())
+                touched.push_back(stream);
+            ++written;
+        }
+
+        /* a batch becomes a single write() for every file */
+        for (vector<FILE *>::iterator it = touched.begin(); it != touched.end(); ++it)
+            fflush(*it);
+        touched.clear();
+
+        __sync_synchronize();
+        ring.flushed_index = ring.pop_index;
+
+        if (written)
+            continue;
+
+        if (stopping)
+        {
+            /* the drops not followed by a record go in the last stream used */
+            FILE * const out = ring.last_stream;
+            if (out != NULL)
+            {
+                ring.reportDrops(out);
+                fflush(out);
+            }
+            break;
+        }
+
+        /* woken early by a ring half full, a flush or the stop */
+        struct pollfd pfd;
+        pfd.fd = ring.wakefd;
+        pfd.events = POLLIN;
+
+        if (poll(&pfd, 1, LOGRING_WRITER_WAIT) == 1)
+        {
+            uint64_t count;
+            if (read(ring.wakefd, &count, sizeof (count)) == -1)
+                continue; /* EAGAIN: an other read has consumed the wake */
+        }
+    }
+
+    return NULL;
+}
+
+LogRing::LogRing(void) :
+records(NULL),
+push_index(0),
+pop_index(0),
+flushed_index(0),
+dropped(0),
+reported_drops(0),
+lossless(false),
+running(false),
+wakefd(-1),
+last_stream(NULL),
+formatted_clock(0)
+{
+    formatted_clock_str[0] = '\0';
+}
+
+LogRing::~LogRing(void)
+{
+    stop();
+    delete[] records;
+}
+
+/*
+ * the writer is a thread: the ring is started in the process doing the logs,
+ * after its fork. a lossless ring makes the producers wait when it is full,
+ * for the replay mode where the logs are part of the result.
+ */
+void LogRing::start(bool wait_when_full)
+{
+    if (running)
+        return;
+
+    if (records == NULL)
+        records = new logRecord[LOGRING_SLOTS];
+
+    for (uint32_t i = push_index; i != push_index + LOGRING_SLOTS; ++i)
+        records[i % LOGRING_SLOTS].sequence = i;
+
+    if ((wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+        RUNTIME_EXCEPTION("unable to open the eventfd of the log writer: %s", strerror(errno));
+
+    pop_index = flushed_index = push_index;
+    lossless = wait_when_full;
+    running = true;
+    __sync_synchronize();
+
+    /* the writer inherits a mask blocking every signal: they are for the threads of sniffjoke */
+    sigset_t fullset, oldset;
+    sigfillset(&fullset);
+    pthread_sigmask(SIG_SETMASK, &fullset, &oldset);
+
+    const int ret = pthread_create(&writer, NULL, logRingWriter, this);
+
+    pthread_sigmask(SIG_SETMASK, &oldset, NULL);
+
+    if (ret)
+    {
+        running = false;
+        close(wakefd);
+        wakefd = -1;
+        RUNTIME_EXCEPTION("unable to start the log writer: %s", strerror(ret));
+    }
+}
+
+void LogRing::stop(void)
+{
+    if (!running)
+        return;
+
+    running = false;
+    __sync_synchronize();
+
+    wake();
+    pthread_join(writer, NULL);
+
+    close(wakefd);
+    wakefd = -1;
+}
+
+/*
+ * the slot push_index is free when its sequence is push_index, and becomes
+ * readable when its sequence is push_index + 1; the writer gives it back
+ * for the next round of the ring with push_index + LOGRING_SLOTS.
+ */
+void LogRing::push(FILE *stream, logprefix_t prefix, const char *funcname, const char *format, va_list arguments)
+{
+    uint32_t index = push_index;
+    logRecord *record;
+
+    while (true)
+    {
+        record = &records[index % LOGRING_SLOTS];
+
+        const int32_t diff = (int32_t) (record->sequence - index);
+        if (diff == 0)
+        {
+            if (__sync_bool_compare_and_swap(&push_index, index, index + 1))
+                break;
+        }
+        else if (diff < 0)
+        {
+            if (!lossless)
+            {
+                __sync_fetch_and_add(&dropped, 1);
+                return;
+            }
+
+            wake();
+            sched_yield();
+        }
+
+        index = push_index;
+    }
+
+    record->stream = stream;
+    record->prefix = prefix;
+    record->truncated = false;
+    record->clock = sj_clock;
+
+    unsigned char *p = record->data;
+    const unsigned char * const end = record->data + sizeof (record->data);
+
+    /* the arguments are captured following the copy: a truncated format keeps them coherent */
+    const char *f = (const char *) p;
+    putString(p, end, format);
+
+    if (prefix == LOGPREFIX_DEBUG)
+    {
+        record->pid = getpid();
+        record->uid = getuid();
+        putString(p, end, funcname);
+    }
+
+    va_list args;
+    __va_copy(args, arguments);
+
+    bool fits = true;
+    while (fits && (f = strchr(f, '%')) != NULL)
+    {
+        struct logConversion c;
+        f = parseConversion(f + 1, c);
+
+        for (uint8_t i = 0; fits && i < c.stars; ++i)
+        {
+            const int star = va_arg(args, int);
+            fits = putValue(p, end, &star, sizeof (star));
+        }
+
+        if (!fits)
+            break;
+
+        switch (c.argclass)
+        {
+        case LOGARG_NONE:
+            break;
+        case LOGARG_SKIP:
+            va_arg(args, void *);
+            break;
+        case LOGARG_SIGNED:
+            {
+                const int64_t value = fetchSigned(c.length, args);
+                fits = putValue(p, end, &value, sizeof (value));
+            }
+            break;
+        case LOGARG_UNSIGNED:
+            {
+                const uint64_t value = fetchUnsigned(c.length, args);
+                fits = putValue(p, end, &value, sizeof (value));
+            }
+            break;
+        case LOGARG_DOUBLE:
+            {
+                const double value = va_arg(args, double);
+                fits = putValue(p, end, &value, sizeof (value));
+            }
+            break;
+        case LOGARG_LDOUBLE:
+            {
+                const long double value = va_arg(args, long double);
+                fits = putValue(p, end, &value, sizeof (value));
+            }
+            break;
+        case LOGARG_STRING:
+            {
+                const char *value = va_arg(args, const char *);
+                fits = putString(p, end, (value != NULL) ? value : "(null)");
+            }
+            break;
+        case LOGARG_POINTER:
+            {
+                void *value = va_arg(args, void *);
+                fits = putValue(p, end, &value, sizeof (value));
+            }
+            break;
+        case LOGARG_INVALID:
+            /* the type of the argument is unknown, the following can't be fetched */
+            fits = false;
+            break;
+        }
+    }
+
+    va_end(args);
+
+    record->truncated = !fits;
+    record->len = p - record->data;
+
+    __sync_synchronize();
+    record->sequence = index + 1;
+
+    /* the writer polls the ring, a burst does not wait its timeout */
+    if (index - pop_index == LOGRING_SLOTS / 2)
+        wake();
+}
+
+void LogRing::wake(void)
+{
+    const uint64_t one = 1;
+
+    if (write(wakefd, &one, sizeof (one)) == -1)
+        return; /* EAGAIN: the counter is full, the writer is woken anyway */
+}
+
+bool LogRing::pop(FILE **stream)
+{
+    logRecord &record = records[pop_index % LOGRING_SLOTS];
+
+    if (record.sequence != pop_index + 1)
+        return false;
+
+    __sync_synchronize();
+
+    print(record);
+    *stream = record.stream;
+
+    __sync_synchronize();
+    record.sequence = pop_index + LOGRING_SLOTS;
+    ++pop_index;
+
+    return true;
+}
+
+/* the drops are reported in the stream of the record following them */
+void LogRing::reportDrops(FILE *out)
+{
+    const uint32_t drops = dropped;
+
+    if (drops != reported_drops)
+    {
+        fprintf(out, "%s %u log records dropped: the log writer is behind\n", formatted_clock_str, drops - reported_drops);
+        reported_drops = drops;
+    }
+}
+
+/* the format is followed again, with the captured arguments in place of the va_list */
+void LogRing::print(const logRecord &record)
+{
+    FILE * const out = record.stream;
+
+    if (record.clock != formatted_clock)
+    {
+        struct tm tm;
+        strftime(formatted_clock_str, sizeof (formatted_clock_str), "%Y-%m-%d %H:%M:%S", localtime_r(&record.clock, &tm));
+        formatted_clock = record.clock;
+    }
+
+    reportDrops(out);
+    last_stream = out;
+
+    const unsigned char *p = record.data;
+    const unsigned char * const end = record.data + record.len;
+
+    const char *f = (const char *) p;
+    p += strlen(f) + 1;
+
+    if (record.prefix == LOGPREFIX_DEBUG)
+    {
+        const char *funcname = (const char *) p;
+        p += strlen(funcname) + 1;
+        fprintf(out, "%s %s %d/%d ", formatted_clock_str, funcname, record.pid, record.uid);
+    }
+    else if (record.prefix == LOGPREFIX_CLOCK)
+    {
+        fprintf(out, "%s ", formatted_clock_str);
+    }
+
+    bool complete = true;
+    const char *conv;
+    while ((conv = strchr(f, '%')) != NULL)
+    {
+        fwrite(f, 1, conv - f, out);
+
+        struct logConversion c;
+        f = parseConversion(conv + 1, c);
+
+        char spec[SMALLBUF];
+        const size_t speclen = f - conv;
+
+        if (c.argclass == LOGARG_INVALID || speclen >= sizeof (spec))
+        {
+            fwrite(conv, 1, speclen, out);
+            continue;
+        }
+
+        memcpy(spec, conv, speclen);
+        spec[speclen] = '\0';
+
+        int star[2];
+        for (uint8_t i = 0; complete && i < c.stars; ++i)
+            complete = getValue(p, end, &star[i], sizeof (star[i]));
+
+        if (!complete)
+            break;
+
+        switch (c.argclass)
+        {
+        case LOGARG_NONE:
+            fputc('%', out);
+            break;
+        case LOGARG_SKIP:
+        case LOGARG_INVALID:
+            break;
+        case LOGARG_SIGNED:
+            {
+                int64_t value;
+                if ((complete = getValue(p, end, &value, sizeof (value))))
+                    printSigned(out, spec, star, c, value);
+            }
+            break;
+        case LOGARG_UNSIGNED:
+            {
+                uint64_t value;
+                if ((complete = getValue(p, end, &value, sizeof (value))))
+                    printUnsigned(out, spec, star, c, value);
+            }
+            break;
+        case LOGARG_DOUBLE:
+            {
+                double value;
+                if ((complete = getValue(p, end, &value, sizeof (value))))
+                    printValue(out, spec, star, c.stars, value);
+            }
+            break;
+        case LOGARG_LDOUBLE:
+            {
+                long double value;
+                if ((complete = getValue(p, end, &value, sizeof (value))))
+                    printValue(out, spec, star, c.stars, value);
+            }
+            break;
+        case LOGARG_STRING:
+            {
+                const char *value = (const char *) p;
+                if ((complete = (p < end)))
+                {
+                    p += strlen(value) + 1;
+                    printValue(out, spec, star, c.stars, value);
+                }
+            }
+            break;
+        case LOGARG_POINTER:
+            {
+                void *value;
+                if ((complete = getValue(p, end, &value, sizeof (value))))
+                    printValue(out, spec, star, c.stars, value);
+            }
+            break;
+        }
+
+        if (!complete)
+            break;
+    }
+
+    if (complete)
+        fputs(f, out);
+
+    if (record.truncated)
+        fputs(" [truncated]", out);
+
+    fputc('\n', out);
+}
+
+/* used before the close of a stream: the records pushed until now are written and flushed */
+void LogRing::flush(FILE *closing)
+{
+    if (!running)
+        return;
+
+    const uint32_t target = push_index;
+
+    wake();
+    while ((int32_t) (flushed_index - target) < 0)
+        usleep(LOGRING_FLUSH_WAIT);
+
+    __sync_bool_compare_and_swap(&last_stream, closing, NULL);
+}
@@ -0,0 +1,99 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SJ_LOGRING_H
+#define SJ_LOGRING_H
+
+#include "hardcodedDefines.h"
+
+#include <cstdarg>
+#include <cstdio>
+#include <ctime>
+
+#include <pthread.h>
+#include <stdint.h>
+
+/* what is written in front of the message of a record */
+enum logprefix_t
+{
+    LOGPREFIX_NONE = 0, LOGPREFIX_CLOCK = 1, LOGPREFIX_DEBUG = 2
+};
+
+/*
+ * LogRing moves the formatting and the writing of the logs out of the
+ * threads logging: a record keeps a copy of the format and the arguments
+ * captured in binary form, the strings copied, and the writer thread
+ * prints the records in their streams and flushes them once per batch.
+ *
+ * the ring is a bounded multi producer queue, the slots are claimed with
+ * a compare and swap; a producer never waits: with the ring full the
+ * record is dropped and counted, the writer reports the drops in front
+ * of the next record written. in replay mode the producers wait instead.
+ */
+class LogRing
+{
+private:
+
+    struct logRecord;
+
+    logRecord *records;
+
+    volatile uint32_t push_index;    /* claimed by the producers */
+    volatile uint32_t pop_index;     /* written only by the writer */
+    volatile uint32_t flushed_index; /* the records before it are in the files */
+    volatile uint32_t dropped;
+    uint32_t reported_drops;
+
+    bool lossless;
+    volatile bool running;
+    pthread_t writer;
+    int wakefd;
+    FILE * volatile last_stream;
+
+    /* the writer formats the clock once per second */
+    time_t formatted_clock;
+    char formatted_clock_str[MEDIUMBUF];
+
+    friend void *logRingWriter(void *);
+
+    bool pop(FILE **);
+    void print(const logRecord &);
+    void reportDrops(FILE *);
+    void wake(void);
+
+public:
+
+    LogRing(void);
+    ~LogRing(void);
+
+    void start(bool);
+    void stop(void);
+    void push(FILE *, logprefix_t, const char *, const char *, va_list);
+    void flush(FILE *);
+
+    bool active(void) const
+    {
+        return running;
+    }
+};
+
+#endif /* SJ_LOGRING_H */
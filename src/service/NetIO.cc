@@ -23,11 +23,44 @@
 #include "NetIO.h"
 #include "UserConf.h"
 
+#include <cstddef>
+#include <new>
 #include <fcntl.h>
 #include <poll.h>
 #include <linux/if_tun.h>
 #include <net/if.h>
 #include <sys/ioctl.h>
+#include <sys/mman.h>
+#include <sys/eventfd.h>
+#include <sys/epoll.h>
+#include <sys/timerfd.h>
+#include <sys/uio.h>
+#include <sys/syscall.h>
+#include <linux/bpf.h>
+#include <linux/if_link.h>
+
+#define SJ_BPF_INSN(code, dst, src, off, imm)   { code, dst, src, off, imm }
+
+/* epoll data of timerfd and of the descriptors added by watchEvent, fds use their index */
+#define NETIO_TIMER_TAG     0x100
+#define NETIO_EXTERNAL_TAG  0x200
+
+/* the high 32 bits of the io_uring user_data, the low ones keep the tun queue or the write slot */
+#define URING_TAG_READ      1
+#define URING_TAG_RECV      2
+#define URING_TAG_WRITE     3
+
+/* IORING_OP_READ_MULTISHOT (linux 6.7) is newer than some linux/io_uring.h */
+#ifdef HAVE_IORING_OP_READ_MULTISHOT
+#define SJ_IORING_OP_READ_MULTISHOT     IORING_OP_READ_MULTISHOT
+#else
+#define SJ_IORING_OP_READ_MULTISHOT     49
+#endif
+
+static int sj_bpf(int cmd, union bpf_attr *attr)
+{
+    return syscall(__NR_bpf, cmd, attr, sizeof (*attr));
+}
 
 extern auto_ptr<UserConf> userconf;
 
@@ -88,24 +121,44 @@ void NetIO::setupTUN()
     int tmpfd;
     struct ifreq tmpifr;
 
-    memset(&tmpifr, 0x00, sizeof (tmpifr));
+    /* every queue is a new open of the tun device attached to the same interface */
+    for (uint16_t i = 0; i < tun_queues_num; ++i)
+    {
+        int &queuefd = tun_queues[i].fd;
 
-    if ((tunfd = open(tundev, O_RDWR)) != -1)
-        LOG_DEBUG("%s opened successfully", tundev);
-    else
-        RUNTIME_EXCEPTION("unable to open %s: %s, check the kernel module", tundev, strerror(errno));
+        memset(&tmpifr, 0x00, sizeof (tmpifr));
 
-    if (((tmpflags = fcntl(tunfd, F_GETFD)) != -1) && (fcntl(tunfd, F_SETFD, tmpflags | FD_CLOEXEC) != -1))
-        LOG_DEBUG("flag FD_CLOEXEC set successfully on tunfd (F_SETFD)");
-    else
-        RUNTIME_EXCEPTION("unable to set flag FD_CLOEXEC on tunfd (F_SETFD): %s", strerror(errno));
+        if ((queuefd = open(tundev, O_RDWR)) != -1)
+            LOG_DEBUG("%s opened successfully (queue %u)", tundev, i);
+        else
+            RUNTIME_EXCEPTION("unable to open %s: %s, check the kernel module", tundev, strerror(errno));
 
-    strncpy(tmpifr.ifr_name, TUN_IF_NAME, sizeof (tmpifr.ifr_name));
-    tmpifr.ifr_flags = IFF_TUN | IFF_NO_PI;
-    if (ioctl(tunfd, TUNSETIFF, &tmpifr) != -1)
-        LOG_DEBUG("flags set successfully on tunfd (TUNSETIFF)");
-    else
-        RUNTIME_EXCEPTION("unable to set flags on tunfd (TUNSETIFF): %s", strerror(errno));
+        if (((tmpflags = fcntl(queuefd, F_GETFD)) != -1) && (fcntl(queuefd, F_SETFD, tmpflags | FD_CLOEXEC) != -1))
+            LOG_DEBUG("flag FD_CLOEXEC set successfully on tunfd (F_SETFD)");
+        else
+            RUNTIME_EXCEPTION("unable to set flag FD_CLOEXEC on tunfd (F_SETFD): %s", strerror(errno));
+
+        strncpy(tmpifr.ifr_name, TUN_IF_NAME, sizeof (tmpifr.ifr_name));
+        tmpifr.ifr_flags = IFF_TUN | IFF_NO_PI;
+        if (tun_queues_num > 1)
+            tmpifr.ifr_flags |= IFF_MULTI_QUEUE;
+
+        if (tun_gso)
+            tmpifr.ifr_flags |= IFF_VNET_HDR;
+
+        if (ioctl(queuefd, TUNSETIFF, &tmpifr) != -1)
+            LOG_DEBUG("flags set successfully on tunfd (TUNSETIFF)");
+        else
+            RUNTIME_EXCEPTION("unable to set flags on tunfd (TUNSETIFF): %s", strerror(errno));
+
+        /* the kernel is allowed to give us TCP super-packets and partial checksums */
+        if (tun_gso && ioctl(queuefd, TUNSETOFFLOAD, TUN_F_CSUM | TUN_F_TSO4) != -1)
+            LOG_DEBUG("checksum and TSO offload set successfully on tunfd (TUNSETOFFLOAD)");
+        else if (tun_gso)
+            RUNTIME_EXCEPTION("unable to set offload on tunfd (TUNSETOFFLOAD): %s", strerror(errno));
+    }
+
+    tunfd = tun_queues[0].fd;
 
     tmpfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
 
@@ -146,7 +199,652 @@ void NetIO::setupTUN()
     close(tmpfd);
 }
 
-NetIO::NetIO(void)
+void NetIO::setupBatch()
+{
+    const uint16_t mtu = userconf->runcfg.net_iface_mtu;
+
+    rx_batchbuf.resize(NETIOBATCHSIZE * mtu);
+
+    memset(rx_msgs, 0x00, sizeof (rx_msgs));
+    memset(tx_msgs, 0x00, sizeof (tx_msgs));
+
+    for (uint32_t i = 0; i < NETIOBATCHSIZE; ++i)
+    {
+        rx_iovs[i].iov_base = &rx_batchbuf[i * mtu];
+        rx_iovs[i].iov_len = mtu;
+        rx_msgs[i].msg_hdr.msg_iov = &rx_iovs[i];
+        rx_msgs[i].msg_hdr.msg_iovlen = 1;
+
+        /* every packet sent to the network has the same link layer destination */
+        tx_msgs[i].msg_hdr.msg_name = &send_ll;
+        tx_msgs[i].msg_hdr.msg_namelen = sizeof (send_ll);
+        tx_msgs[i].msg_hdr.msg_iov = &tx_iovs[i];
+        tx_msgs[i].msg_hdr.msg_iovlen = 1;
+    }
+
+    LOG_DEBUG("batch I/O enabled on netfd: %u packets for recvmmsg/sendmmsg", NETIOBATCHSIZE);
+}
+
+void NetIO::setupRxRing()
+{
+    int version = TPACKET_V3;
+    struct tpacket_req3 req;
+
+    if (setsockopt(netfd, SOL_PACKET, PACKET_VERSION, &version, sizeof (version)) != -1)
+        LOG_DEBUG("TPACKET_V3 set successfully on netfd (PACKET_VERSION)");
+    else
+        RUNTIME_EXCEPTION("unable to set TPACKET_V3 on netfd (PACKET_VERSION): %s", strerror(errno));
+
+    memset(&req, 0x00, sizeof (req));
+    req.tp_block_size = RXRING_BLOCK_SIZE;
+    req.tp_block_nr = RXRING_BLOCK_NUM;
+    req.tp_frame_size = RXRING_FRAME_SIZE;
+    req.tp_frame_nr = (RXRING_BLOCK_SIZE / RXRING_FRAME_SIZE) * RXRING_BLOCK_NUM;
+    req.tp_retire_blk_tov = RXRING_RETIRE_TIMEOUT;
+
+    if (setsockopt(netfd, SOL_PACKET, PACKET_RX_RING, &req, sizeof (req)) != -1)
+        LOG_DEBUG("rx ring of %u blocks requested successfully on netfd (PACKET_RX_RING)", req.tp_block_nr);
+    else
+        RUNTIME_EXCEPTION("unable to request the rx ring on netfd (PACKET_RX_RING): %s", strerror(errno));
+
+    rx_ring_len = (size_t) req.tp_block_size * req.tp_block_nr;
+    rx_ring = (unsigned char *) mmap(NULL, rx_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_LOCKED, netfd, 0);
+    if (rx_ring == MAP_FAILED)
+    {
+        /* MAP_LOCKED fails under a strict RLIMIT_MEMLOCK: the ring works anyway */
+        rx_ring = (unsigned char *) mmap(NULL, rx_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED, netfd, 0);
+    }
+
+    if (rx_ring != MAP_FAILED)
+        LOG_DEBUG("rx ring of %u bytes mapped successfully", rx_ring_len);
+    else
+        RUNTIME_EXCEPTION("unable to mmap the rx ring: %s", strerror(errno));
+
+    rx_ring_block = 0;
+}
+
+void NetIO::setupTxRing()
+{
+    int tmpflags;
+    int version = TPACKET_V2;
+    struct tpacket_req req;
+    struct sockaddr_ll tx_ll;
+
+    if (userconf->runcfg.net_iface_mtu > TXRING_FRAME_SIZE - (TPACKET2_HDRLEN - sizeof (struct sockaddr_ll)))
+        RUNTIME_EXCEPTION("mtu %u is too big for the tx ring frames of %u bytes", userconf->runcfg.net_iface_mtu, TXRING_FRAME_SIZE);
+
+    /* protocol 0: this socket is used only for transmission and never receives a copy of the traffic */
+    if ((txfd = socket(PF_PACKET, SOCK_DGRAM, 0)) != -1)
+        LOG_DEBUG("datalink layer tx ring socket opened successfully");
+    else
+        RUNTIME_EXCEPTION("unable to open datalink layer tx ring socket: %s", strerror(errno));
+
+    if (((tmpflags = fcntl(txfd, F_GETFD)) != -1) && (fcntl(txfd, F_SETFD, tmpflags | FD_CLOEXEC) != -1))
+        LOG_DEBUG("flag FD_CLOEXEC set successfully in txfd (F_SETFD)");
+    else
+        RUNTIME_EXCEPTION("unable to set flag FD_CLOEXEC on txfd (F_SETFD): %s", strerror(errno));
+
+    if (setsockopt(txfd, SOL_PACKET, PACKET_VERSION, &version, sizeof (version)) != -1)
+        LOG_DEBUG("TPACKET_V2 set successfully on txfd (PACKET_VERSION)");
+    else
+        RUNTIME_EXCEPTION("unable to set TPACKET_V2 on txfd (PACKET_VERSION): %s", strerror(errno));
+
+    memset(&req, 0x00, sizeof (req));
+    req.tp_block_size = TXRING_BLOCK_SIZE;
+    req.tp_frame_size = TXRING_FRAME_SIZE;
+    req.tp_frame_nr = TXRING_FRAME_NUM;
+    req.tp_block_nr = TXRING_FRAME_NUM / (TXRING_BLOCK_SIZE / TXRING_FRAME_SIZE);
+
+    if (setsockopt(txfd, SOL_PACKET, PACKET_TX_RING, &req, sizeof (req)) != -1)
+        LOG_DEBUG("tx ring of %u frames requested successfully on txfd (PACKET_TX_RING)", req.tp_frame_nr);
+    else
+        RUNTIME_EXCEPTION("unable to request the tx ring on txfd (PACKET_TX_RING): %s", strerror(errno));
+
+    tx_ring_len = (size_t) req.tp_block_size * req.tp_block_nr;
+    tx_ring = (unsigned char *) mmap(NULL, tx_ring_len, PROT_READ | PROT_WRITE, MAP_SHARED, txfd, 0);
+    if (tx_ring != MAP_FAILED)
+        LOG_DEBUG("tx ring of %u bytes mapped successfully", tx_ring_len);
+    else
+        RUNTIME_EXCEPTION("unable to mmap the tx ring: %s", strerror(errno));
+
+    memcpy(&tx_ll, &send_ll, sizeof (tx_ll));
+    tx_ll.sll_protocol = 0;
+    if (bind(txfd, (struct sockaddr *) &tx_ll, sizeof (tx_ll)) != -1)
+        LOG_DEBUG("binding datalink layer tx ring interface successfully");
+    else
+        RUNTIME_EXCEPTION("unable to bind datalink layer tx ring interface: %s", strerror(errno));
+
+    tx_ring_head = 0;
+}
+
+void NetIO::setupTunQueues()
+{
+    int tmpflags;
+
+    /* the slots are sized on the tun mtu, known only after setupTUN */
+    for (uint16_t i = 0; i < tun_queues_num; ++i)
+    {
+        struct tunQueue &queue = tun_queues[i];
+
+        queue.netio = this;
+        queue.slot_size = tun_readsize;
+        queue.slot_num = tun_gso ? TUNQUEUE_GSO_RING_SLOTS : TUNQUEUE_RING_SLOTS;
+        queue.head = queue.reaped = queue.tail = 0;
+        queue.waiting = queue.stop = 0;
+        queue.error = 0;
+
+        /* the worker reads until EAGAIN, then waits in poll() for the queue or for wakefd */
+        if (((tmpflags = fcntl(queue.fd, F_GETFL)) != -1) && (fcntl(queue.fd, F_SETFL, tmpflags | O_NONBLOCK) != -1))
+            LOG_DEBUG("flag O_NONBLOCK set successfully on tun queue %u (F_SETFL)", i);
+        else
+            RUNTIME_EXCEPTION("unable to set flag O_NONBLOCK on tun queue %u (F_SETFL): %s", i, strerror(errno));
+
+        if ((queue.wakefd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) == -1)
+            RUNTIME_EXCEPTION("unable to open the eventfd of tun queue %u: %s", i, strerror(errno));
+    }
+
+    if ((tun_eventfd = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC)) != -1)
+        LOG_DEBUG("eventfd for %u tun queues opened successfully", tun_queues_num);
+    else
+        RUNTIME_EXCEPTION("unable to open the eventfd for the tun queues: %s", strerror(errno));
+}
+
+static bool signalEventfd(int fd)
+{
+    const uint64_t one = 1;
+
+    /* EAGAIN: the counter is saturated, the reader is going to wake anyway */
+    return (write(fd, &one, sizeof (one)) != -1 || errno == EAGAIN);
+}
+
+static void clearEventfd(int fd)
+{
+    uint64_t counter;
+
+    if (read(fd, &counter, sizeof (counter)) == -1 && errno != EAGAIN)
+        RUNTIME_EXCEPTION("error reading an eventfd: %s", strerror(errno));
+}
+
+/*
+ * the worker never logs nor throws: the LogRing and the exceptions belong
+ * to the core. an error is left in queue.error and the core is woken.
+ */
+void *tunQueueWorker(void *arg)
+{
+    struct tunQueue &queue = *(struct tunQueue *) arg;
+    struct pollfd fds[2];
+    uint64_t counter;
+
+    fds[0].fd = queue.fd;
+    fds[0].events = POLLIN;
+    fds[1].fd = queue.wakefd;
+    fds[1].events = POLLIN;
+
+    while (!__atomic_load_n(&queue.stop, __ATOMIC_ACQUIRE))
+    {
+        const uint32_t head = queue.head;
+
+        /* a full ring gives back pressure to the tun queue in the kernel: the core wakes us giving back a slot */
+        if (head == __atomic_load_n(&queue.tail, __ATOMIC_ACQUIRE))
+        {
+            __atomic_store_n(&queue.waiting, 1, __ATOMIC_SEQ_CST);
+
+            if (head == __atomic_load_n(&queue.tail, __ATOMIC_SEQ_CST))
+            {
+                if (poll(&fds[1], 1, -1) == 1 && read(queue.wakefd, &counter, sizeof (counter)) == -1 && errno != EAGAIN)
+                    break;
+            }
+
+            __atomic_store_n(&queue.waiting, 0, __ATOMIC_RELAXED);
+            continue;
+        }
+
+        const uint32_t slot = head % queue.slot_num;
+
+        const ssize_t ret = read(queue.fd, queue.bufs[slot].begin(), queue.slot_size);
+        if (ret == -1)
+        {
+            if (errno == EINTR)
+                continue;
+
+            if (errno != EAGAIN)
+                break;
+
+            if (poll(fds, 2, -1) == -1 && errno != EINTR)
+                break;
+
+            /* a wake of a full ring already gone, or the stop checked by the loop */
+            if ((fds[1].revents & POLLIN) && read(queue.wakefd, &counter, sizeof (counter)) == -1 && errno != EAGAIN)
+                break;
+
+            continue;
+        }
+
+        queue.slot_len[slot] = ret;
+
+        __atomic_store_n(&queue.head, head + 1, __ATOMIC_SEQ_CST);
+
+        /* the core is woken only when it could have seen this ring empty */
+        if (__atomic_load_n(&queue.reaped, __ATOMIC_SEQ_CST) == head && !signalEventfd(queue.netio->tun_eventfd))
+            break;
+    }
+
+    if (!__atomic_load_n(&queue.stop, __ATOMIC_ACQUIRE))
+    {
+        __atomic_store_n(&queue.error, errno, __ATOMIC_RELEASE);
+        signalEventfd(queue.netio->tun_eventfd);
+    }
+
+    return NULL;
+}
+
+/* the workers start in the service process: the buffers are of the conntrack thread */
+void NetIO::startTunWorkers()
+{
+    if (tun_queues_num == 1)
+        return;
+
+    for (uint16_t i = 0; i < tun_queues_num; ++i)
+    {
+        struct tunQueue &queue = tun_queues[i];
+
+        queue.bufs = new PacketBuffer[queue.slot_num];
+        for (uint32_t slot = 0; slot < queue.slot_num; ++slot)
+            queue.bufs[slot].reserve(queue.slot_size);
+
+        queue.tail = queue.slot_num;
+    }
+
+    for (uint16_t i = 0; i < tun_queues_num; ++i)
+    {
+        int ret = pthread_create(&tun_queues[i].worker, NULL, tunQueueWorker, &tun_queues[i]);
+        if (ret)
+            RUNTIME_EXCEPTION("unable to start the worker of tun queue %u: %s", i, strerror(ret));
+    }
+
+    tun_workers = true;
+
+    LOG_VERBOSE("started %u tun queue workers", tun_queues_num);
+}
+
+void NetIO::stopTunWorkers()
+{
+    /* a worker checks the flag after every read and every wait, wakefd ends the wait */
+    for (uint16_t i = 0; i < tun_queues_num; ++i)
+    {
+        __atomic_store_n(&tun_queues[i].stop, 1, __ATOMIC_RELEASE);
+        signalEventfd(tun_queues[i].wakefd);
+    }
+
+    for (uint16_t i = 0; i < tun_queues_num; ++i)
+        pthread_join(tun_queues[i].worker, NULL);
+
+    tun_workers = false;
+}
+
+void NetIO::mapXskRing(struct xskRing &ring, const struct xdp_ring_offset &off, size_t descsize, off_t pgoff)
+{
+    ring.map_len = off.desc + XSK_RING_SIZE * descsize;
+    ring.map = (unsigned char *) mmap(NULL, ring.map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, xskfd, pgoff);
+    if (ring.map == MAP_FAILED)
+    {
+        ring.map = NULL;
+        RUNTIME_EXCEPTION("unable to mmap an AF_XDP ring: %s", strerror(errno));
+    }
+
+    ring.producer = (volatile uint32_t *) (ring.map + off.producer);
+    ring.consumer = (volatile uint32_t *) (ring.map + off.consumer);
+    ring.flags = (volatile uint32_t *) (ring.map + off.flags);
+    ring.desc = ring.map + off.desc;
+}
+
+void NetIO::loadXskProgram(int ifindex)
+{
+    union bpf_attr attr;
+
+    /* the program is built here to match the gateway MAC address without a compiler */
+    const uint16_t ethertype = htons(ETH_P_IP);
+    uint32_t gw_mac_lo;
+    uint16_t gw_mac_hi;
+    memcpy(&gw_mac_lo, userconf->runcfg.gw_mac_addr, sizeof (gw_mac_lo));
+    memcpy(&gw_mac_hi, userconf->runcfg.gw_mac_addr + sizeof (gw_mac_lo), sizeof (gw_mac_hi));
+
+    memset(&attr, 0x00, sizeof (attr));
+    attr.map_type = BPF_MAP_TYPE_XSKMAP;
+    attr.key_size = sizeof (uint32_t);
+    attr.value_size = sizeof (uint32_t);
+    attr.max_entries = XSK_QUEUE_ID + 1;
+
+    if ((xsk_mapfd = sj_bpf(BPF_MAP_CREATE, &attr)) != -1)
+        LOG_DEBUG("XSKMAP for the AF_XDP socket created successfully");
+    else
+        RUNTIME_EXCEPTION("unable to create the XSKMAP (BPF_MAP_CREATE): %s", strerror(errno));
+
+    /*
+     * IPv4 frames coming from the gateway are redirected to the socket of
+     * their queue; a queue without socket, ARP and any other frame take the
+     * XDP_PASS to the kernel stack, where netfd continues to see them.
+     */
+    struct bpf_insn prog[] = {
+        SJ_BPF_INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, data), 0),
+        SJ_BPF_INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_3, BPF_REG_1, offsetof(struct xdp_md, data_end), 0),
+        SJ_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_X, BPF_REG_4, BPF_REG_2, 0, 0),
+        SJ_BPF_INSN(BPF_ALU64 | BPF_ADD | BPF_K, BPF_REG_4, 0, 0, ETH_HLEN),
+        SJ_BPF_INSN(BPF_JMP | BPF_JGT | BPF_X, BPF_REG_4, BPF_REG_3, 12, 0),
+        SJ_BPF_INSN(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_4, BPF_REG_2, offsetof(struct ether_header, ether_type), 0),
+        SJ_BPF_INSN(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_4, 0, 10, ethertype),
+        SJ_BPF_INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_4, BPF_REG_2, offsetof(struct ether_header, ether_shost), 0),
+        SJ_BPF_INSN(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_4, 0, 8, (int32_t) gw_mac_lo),
+        SJ_BPF_INSN(BPF_LDX | BPF_H | BPF_MEM, BPF_REG_4, BPF_REG_2, offsetof(struct ether_header, ether_shost) + sizeof (gw_mac_lo), 0),
+        SJ_BPF_INSN(BPF_JMP32 | BPF_JNE | BPF_K, BPF_REG_4, 0, 6, gw_mac_hi),
+        SJ_BPF_INSN(BPF_LDX | BPF_W | BPF_MEM, BPF_REG_2, BPF_REG_1, offsetof(struct xdp_md, rx_queue_index), 0),
+        SJ_BPF_INSN(BPF_LD | BPF_DW | BPF_IMM, BPF_REG_1, BPF_PSEUDO_MAP_FD, 0, xsk_mapfd),
+        SJ_BPF_INSN(0, 0, 0, 0, 0),
+        SJ_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_3, 0, 0, XDP_PASS), /* the action when the queue has no socket */
+        SJ_BPF_INSN(BPF_JMP | BPF_CALL, 0, 0, 0, BPF_FUNC_redirect_map),
+        SJ_BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0),
+        SJ_BPF_INSN(BPF_ALU64 | BPF_MOV | BPF_K, BPF_REG_0, 0, 0, XDP_PASS),
+        SJ_BPF_INSN(BPF_JMP | BPF_EXIT, 0, 0, 0, 0)
+    };
+
+    memset(&attr, 0x00, sizeof (attr));
+    attr.prog_type = BPF_PROG_TYPE_XDP;
+    attr.insns = (uintptr_t) prog;
+    attr.insn_cnt = sizeof (prog) / sizeof (prog[0]);
+    attr.license = (uintptr_t) "GPL";
+
+    if ((xsk_progfd = sj_bpf(BPF_PROG_LOAD, &attr)) != -1)
+        LOG_DEBUG("XDP program of %u instructions loaded successfully", attr.insn_cnt);
+    else
+        RUNTIME_EXCEPTION("unable to load the XDP program (BPF_PROG_LOAD): %s", strerror(errno));
+
+    /* the native mode is required by the zero-copy, the generic one works on every interface */
+    memset(&attr, 0x00, sizeof (attr));
+    attr.link_create.prog_fd = xsk_progfd;
+    attr.link_create.target_ifindex = ifindex;
+    attr.link_create.attach_type = BPF_XDP;
+    attr.link_create.flags = XDP_FLAGS_DRV_MODE;
+
+    if ((xsk_linkfd = sj_bpf(BPF_LINK_CREATE, &attr)) != -1)
+    {
+        LOG_VERBOSE("XDP program attached in native mode on %s", userconf->runcfg.net_iface_name);
+        return;
+    }
+
+    LOG_DEBUG("XDP native mode unavailable on %s (%s): using the generic mode", userconf->runcfg.net_iface_name, strerror(errno));
+
+    attr.link_create.flags = XDP_FLAGS_SKB_MODE;
+
+    if ((xsk_linkfd = sj_bpf(BPF_LINK_CREATE, &attr)) != -1)
+        LOG_VERBOSE("XDP program attached in generic mode on %s", userconf->runcfg.net_iface_name);
+    else
+        RUNTIME_EXCEPTION("unable to attach the XDP program on %s (BPF_LINK_CREATE): %s", userconf->runcfg.net_iface_name, strerror(errno));
+}
+
+void NetIO::setupXsk()
+{
+    int tmpfd;
+    struct ifreq tmpifr;
+    int ringsize = XSK_RING_SIZE;
+    struct xdp_umem_reg umemreg;
+    struct xdp_mmap_offsets off;
+    socklen_t off_len = sizeof (off);
+    struct sockaddr_xdp sxdp;
+
+    if (userconf->runcfg.net_iface_mtu + ETH_HLEN > XSK_FRAME_SIZE - XDP_PACKET_HEADROOM)
+        RUNTIME_EXCEPTION("mtu %u is too big for the AF_XDP frames of %u bytes", userconf->runcfg.net_iface_mtu, XSK_FRAME_SIZE);
+
+    /* the frames sent by xskfd are complete ethernet frames, from our MAC to the gateway */
+    memset(&tmpifr, 0x00, sizeof (tmpifr));
+    const size_t namelen = strnlen(userconf->runcfg.net_iface_name, sizeof (tmpifr.ifr_name) - 1);
+    memcpy(tmpifr.ifr_name, userconf->runcfg.net_iface_name, namelen);
+    tmpifr.ifr_name[namelen] = 0x00;
+
+    tmpfd = socket(AF_INET, SOCK_DGRAM, IPPROTO_IP);
+
+    if (ioctl(tmpfd, SIOCGIFHWADDR, &tmpifr) != -1)
+        LOG_DEBUG("mac address of %s correctly read (SIOCGIFHWADDR)", userconf->runcfg.net_iface_name);
+    else
+        RUNTIME_EXCEPTION("unable to get the mac address of %s (SIOCGIFHWADDR): %s", userconf->runcfg.net_iface_name, strerror(errno));
+
+    close(tmpfd);
+
+    struct ether_header *eth = (struct ether_header *) xsk_ethhdr;
+    memcpy(eth->ether_dhost, userconf->runcfg.gw_mac_addr, ETH_ALEN);
+    memcpy(eth->ether_shost, tmpifr.ifr_hwaddr.sa_data, ETH_ALEN);
+    eth->ether_type = htons(ETH_P_IP);
+
+    if ((xskfd = socket(AF_XDP, SOCK_RAW | SOCK_CLOEXEC, 0)) != -1)
+        LOG_DEBUG("AF_XDP socket opened successfully");
+    else
+        RUNTIME_EXCEPTION("unable to open the AF_XDP socket: %s", strerror(errno));
+
+    xsk_umem_len = (size_t) XSK_FRAME_SIZE * XSK_FRAME_NUM;
+    xsk_umem = (unsigned char *) mmap(NULL, xsk_umem_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_POPULATE, -1, 0);
+    if (xsk_umem != MAP_FAILED)
+        LOG_DEBUG("UMEM of %u frames allocated successfully", XSK_FRAME_NUM);
+    else
+    {
+        xsk_umem = NULL;
+        RUNTIME_EXCEPTION("unable to allocate the UMEM: %s", strerror(errno));
+    }
+
+    memset(&umemreg, 0x00, sizeof (umemreg));
+    umemreg.addr = (uintptr_t) xsk_umem;
+    umemreg.len = xsk_umem_len;
+    umemreg.chunk_size = XSK_FRAME_SIZE;
+
+    if (setsockopt(xskfd, SOL_XDP, XDP_UMEM_REG, &umemreg, sizeof (umemreg)) != -1)
+        LOG_DEBUG("UMEM registered successfully on xskfd (XDP_UMEM_REG)");
+    else
+        RUNTIME_EXCEPTION("unable to register the UMEM on xskfd (XDP_UMEM_REG): %s", strerror(errno));
+
+    if (setsockopt(xskfd, SOL_XDP, XDP_UMEM_FILL_RING, &ringsize, sizeof (ringsize)) == -1 ||
+            setsockopt(xskfd, SOL_XDP, XDP_UMEM_COMPLETION_RING, &ringsize, sizeof (ringsize)) == -1 ||
+            setsockopt(xskfd, SOL_XDP, XDP_RX_RING, &ringsize, sizeof (ringsize)) == -1 ||
+            setsockopt(xskfd, SOL_XDP, XDP_TX_RING, &ringsize, sizeof (ringsize)) == -1)
+        RUNTIME_EXCEPTION("unable to size the rings of xskfd: %s", strerror(errno));
+
+    if (getsockopt(xskfd, SOL_XDP, XDP_MMAP_OFFSETS, &off, &off_len) == -1)
+        RUNTIME_EXCEPTION("unable to get the ring offsets of xskfd (XDP_MMAP_OFFSETS): %s", strerror(errno));
+
+    mapXskRing(xsk_fill, off.fr, sizeof (uint64_t), XDP_UMEM_PGOFF_FILL_RING);
+    mapXskRing(xsk_comp, off.cr, sizeof (uint64_t), XDP_UMEM_PGOFF_COMPLETION_RING);
+    mapXskRing(xsk_rx, off.rx, sizeof (struct xdp_desc), XDP_PGOFF_RX_RING);
+    mapXskRing(xsk_tx, off.tx, sizeof (struct xdp_desc), XDP_PGOFF_TX_RING);
+
+    /* the first XSK_RING_SIZE frames are given to the kernel for the reception */
+    uint64_t *fill = (uint64_t *) xsk_fill.desc;
+    for (uint32_t i = 0; i < XSK_RING_SIZE; ++i)
+        fill[i] = (uint64_t) i * XSK_FRAME_SIZE;
+
+    __sync_synchronize();
+    *xsk_fill.producer = XSK_RING_SIZE;
+
+    for (uint32_t i = XSK_RING_SIZE; i < XSK_FRAME_NUM; ++i)
+        xsk_tx_frames.push_back((uint64_t) i * XSK_FRAME_SIZE);
+
+    loadXskProgram(send_ll.sll_ifindex);
+
+    memset(&sxdp, 0x00, sizeof (sxdp));
+    sxdp.sxdp_family = AF_XDP;
+    sxdp.sxdp_ifindex = send_ll.sll_ifindex;
+    sxdp.sxdp_queue_id = XSK_QUEUE_ID;
+    sxdp.sxdp_flags = XDP_ZEROCOPY | XDP_USE_NEED_WAKEUP;
+
+    if (bind(xskfd, (struct sockaddr *) &sxdp, sizeof (sxdp)) != -1)
+    {
+        xsk_zerocopy = true;
+        LOG_VERBOSE("AF_XDP socket bound in zero-copy mode on %s queue %u", userconf->runcfg.net_iface_name, XSK_QUEUE_ID);
+    }
+    else
+    {
+        LOG_DEBUG("AF_XDP zero-copy unavailable on %s (%s): using the copy mode", userconf->runcfg.net_iface_name, strerror(errno));
+
+        sxdp.sxdp_flags = XDP_COPY | XDP_USE_NEED_WAKEUP;
+
+        if (bind(xskfd, (struct sockaddr *) &sxdp, sizeof (sxdp)) != -1)
+            LOG_VERBOSE("AF_XDP socket bound in copy mode on %s queue %u", userconf->runcfg.net_iface_name, XSK_QUEUE_ID);
+        else
+            RUNTIME_EXCEPTION("unable to bind the AF_XDP socket on %s: %s", userconf->runcfg.net_iface_name, strerror(errno));
+    }
+
+    /* from now the frames of the gateway reach xskfd */
+    uint32_t key = XSK_QUEUE_ID;
+
+    union bpf_attr attr;
+    memset(&attr, 0x00, sizeof (attr));
+    attr.map_fd = xsk_mapfd;
+    attr.key = (uintptr_t) &key;
+    attr.value = (uintptr_t) &xskfd;
+
+    if (sj_bpf(BPF_MAP_UPDATE_ELEM, &attr) != -1)
+        LOG_DEBUG("AF_XDP socket inserted successfully in the XSKMAP");
+    else
+        RUNTIME_EXCEPTION("unable to insert the AF_XDP socket in the XSKMAP: %s", strerror(errno));
+}
+
+void NetIO::setupUringBufGroup(struct uringBufGroup &group, uint16_t bgid, uint32_t buf_size, uint16_t buf_num)
+{
+    struct io_uring_buf_reg reg;
+
+    group.bgid = bgid;
+    group.buf_size = buf_size;
+    group.buf_num = buf_num;
+    group.bufs = new PacketBuffer[buf_num];
+    group.unrecycled = new uint16_t[buf_num];
+    group.unrecycled_num = 0;
+
+    /* the ring of the buffer descriptors must be page aligned memory */
+    group.ring_len = buf_num * sizeof (struct io_uring_buf);
+    group.ring = (struct io_uring_buf_ring *) mmap(NULL, group.ring_len, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (group.ring == MAP_FAILED)
+    {
+        group.ring = NULL;
+        RUNTIME_EXCEPTION("unable to allocate the io_uring buffer ring %u: %s", bgid, strerror(errno));
+    }
+
+    memset(&reg, 0x00, sizeof (reg));
+    reg.ring_addr = (uintptr_t) group.ring;
+    reg.ring_entries = buf_num;
+    reg.bgid = bgid;
+
+    if (syscall(__NR_io_uring_register, uring_fd, IORING_REGISTER_PBUF_RING, &reg, 1) != -1)
+        LOG_DEBUG("io_uring buffer group %u of %u buffers registered successfully (IORING_REGISTER_PBUF_RING)", bgid, buf_num);
+    else
+        RUNTIME_EXCEPTION("unable to register the io_uring buffer group %u (IORING_REGISTER_PBUF_RING): %s", bgid, strerror(errno));
+
+    for (uint16_t bid = 0; bid < buf_num; ++bid)
+        recycleUringBuf(group, bid);
+}
+
+void NetIO::setupUring()
+{
+    struct io_uring_params params;
+
+    /* SINGLE_ISSUER and COOP_TASKRUN are only hints, an older kernel refuses them */
+    memset(&params, 0x00, sizeof (params));
+    params.flags = IORING_SETUP_SINGLE_ISSUER | IORING_SETUP_COOP_TASKRUN;
+
+    uring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    if (uring_fd == -1 && errno == EINVAL)
+    {
+        memset(&params, 0x00, sizeof (params));
+        uring_fd = syscall(__NR_io_uring_setup, URING_ENTRIES, &params);
+    }
+
+    if (uring_fd != -1)
+        LOG_DEBUG("io_uring of %u entries opened successfully", params.sq_entries);
+    else
+        RUNTIME_EXCEPTION("unable to open the io_uring: %s", strerror(errno));
+
+    if (!(params.features & IORING_FEAT_SINGLE_MMAP))
+        RUNTIME_EXCEPTION("the io_uring of this kernel is too old: IORING_FEAT_SINGLE_MMAP is required");
+
+    const size_t sq_len = params.sq_off.array + params.sq_entries * sizeof (uint32_t);
+    const size_t cq_len = params.cq_off.cqes + params.cq_entries * sizeof (struct io_uring_cqe);
+
+    uring.map_len = (sq_len > cq_len) ? sq_len : cq_len;
+    uring.map = (unsigned char *) mmap(NULL, uring.map_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring_fd, IORING_OFF_SQ_RING);
+    if (uring.map == MAP_FAILED)
+    {
+        uring.map = NULL;
+        RUNTIME_EXCEPTION("unable to mmap the io_uring rings: %s", strerror(errno));
+    }
+
+    uring.sqes_len = params.sq_entries * sizeof (struct io_uring_sqe);
+    uring.sqes = (struct io_uring_sqe *) mmap(NULL, uring.sqes_len, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_POPULATE, uring_fd, IORING_OFF_SQES);
+    if (uring.sqes == MAP_FAILED)
+    {
+        uring.sqes = NULL;
+        RUNTIME_EXCEPTION("unable to mmap the io_uring submission entries: %s", strerror(errno));
+    }
+
+    uring.sq_head = (volatile uint32_t *) (uring.map + params.sq_off.head);
+    uring.sq_tail = (volatile uint32_t *) (uring.map + params.sq_off.tail);
+    uring.sq_array = (uint32_t *) (uring.map + params.sq_off.array);
+    uring.sq_mask = *(uint32_t *) (uring.map + params.sq_off.ring_mask);
+    uring.sq_entries = params.sq_entries;
+    uring.sq_tail_local = *uring.sq_tail;
+
+    uring.cq_head = (volatile uint32_t *) (uring.map + params.cq_off.head);
+    uring.cq_tail = (volatile uint32_t *) (uring.map + params.cq_off.tail);
+    uring.cqes = (struct io_uring_cqe *) (uring.map + params.cq_off.cqes);
+    uring.cq_mask = *(uint32_t *) (uring.map + params.cq_off.ring_mask);
+
+    /* every submission entry is always used from the same slot of the array */
+    for (uint32_t i = 0; i < uring.sq_entries; ++i)
+        uring.sq_array[i] = i;
+
+    setupUringBufGroup(uring_tunbufs, 0, tun_readsize, tun_gso ? URING_GSO_BUFS : URING_BUFS);
+    setupUringBufGroup(uring_netbufs, 1, userconf->runcfg.net_iface_mtu, URING_BUFS);
+
+    for (uint32_t i = 0; i < URING_WRITE_SLOTS; ++i)
+        uring_free_writes.push_back(i);
+
+    for (uint16_t i = 0; i < tun_queues_num; ++i)
+        postUringRead(i);
+
+    postUringRecv();
+
+    submitUring();
+
+    fds[5].fd = uring_fd;
+    fds[5].events = POLLIN;
+
+    LOG_VERBOSE("io_uring I/O enabled for %u tun queues and netfd", tun_queues_num);
+}
+
+NetIO::NetIO(void) :
+txfd(-1),
+tun_queues(NULL),
+tun_queues_num(userconf->runcfg.tun_read_queues),
+tun_workers(false),
+tun_eventfd(-1),
+xskfd(-1),
+uring_fd(-1),
+epfd(-1),
+timerfd(-1),
+timer_deadline(0),
+tun_gso(userconf->runcfg.tun_gso),
+tx_count(0),
+tx_sent(0),
+rx_ring(NULL),
+rx_ring_len(0),
+rx_ring_block(0),
+rx_ring_drops(0),
+tx_ring(NULL),
+tx_ring_len(0),
+tx_ring_head(0),
+tx_ring_drops(0),
+xsk_mapfd(-1),
+xsk_progfd(-1),
+xsk_linkfd(-1),
+xsk_zerocopy(false),
+xsk_umem(NULL),
+xsk_umem_len(0),
+uring_multishot_read(true),
+uring_multishot_recv(true)
 {
     LOG_DEBUG("");
 
@@ -162,11 +860,70 @@ NetIO::NetIO(void)
     if (strlen(userconf->runcfg.gw_mac_str) != 17)
         RUNTIME_EXCEPTION("invalid mac address [%s] is not a MAC, check the config", userconf->runcfg.gw_mac_str);
 
+    tun_queues = new tunQueue[tun_queues_num];
+    for (uint16_t i = 0; i < tun_queues_num; ++i)
+    {
+        tun_queues[i].wakefd = -1;
+        tun_queues[i].bufs = NULL;
+    }
+
     setupNET();
     setupTUN();
 
+    memset(&tun_vnet_hdr, 0x00, sizeof (tun_vnet_hdr));
+    tun_vnet_hdr.gso_type = SJ_VNET_HDR_GSO_NONE;
+
+    tun_readsize = tun_gso ? TUN_GSO_READSIZE : userconf->runcfg.tun_iface_mtu;
+    pktbuf.resize(tun_readsize > userconf->runcfg.net_iface_mtu ? tun_readsize : userconf->runcfg.net_iface_mtu);
+
+    /* the pool buffers keep the biggest packet read, a GSO super-packet included */
+    PacketBuffer::setMaxPacket(pktbuf.size());
+
+    /* in io_uring mode every tun queue is read by the io_uring, without workers */
+    if (tun_queues_num > 1 && !userconf->runcfg.io_uring)
+        setupTunQueues();
+
+    if (userconf->runcfg.batch_io)
+        setupBatch();
+
+    if (userconf->runcfg.rx_ring)
+        setupRxRing();
+
+    if (userconf->runcfg.tx_ring)
+        setupTxRing();
+
+    memset(&xsk_fill, 0x00, sizeof (xsk_fill));
+    memset(&xsk_comp, 0x00, sizeof (xsk_comp));
+    memset(&xsk_rx, 0x00, sizeof (xsk_rx));
+    memset(&xsk_tx, 0x00, sizeof (xsk_tx));
+
+    if (userconf->runcfg.xdp)
+        setupXsk();
+
+    /*
+     * a negative fd is ignored by poll: fds[2] is active only in tx ring mode,
+     * fds[3] only in multiqueue mode and fds[4] only in xdp mode.
+     */
+    memset(fds, 0x00, sizeof (fds));
+    memset(fds_watched, 0x00, sizeof (fds_watched));
+
     fds[0].fd = tunfd;
     fds[1].fd = netfd;
+    fds[2].fd = txfd;
+    fds[3].fd = tun_eventfd;
+    fds[3].events = POLLIN;
+    fds[4].fd = xskfd;
+    fds[5].fd = uring_fd;
+
+    memset(&uring, 0x00, sizeof (uring));
+    uring_tunbufs.ring = NULL;
+    uring_tunbufs.bufs = NULL;
+    uring_tunbufs.unrecycled = NULL;
+    uring_netbufs.ring = NULL;
+    uring_netbufs.bufs = NULL;
+    uring_netbufs.unrecycled = NULL;
+    for (uint32_t i = 0; i < URING_WRITE_SLOTS; ++i)
+        uring_writes[i].pkt = NULL;
 
     snprintf(cmd, sizeof (cmd), "route del default");
     LOG_VERBOSE("deleting default gateway in routing table");
@@ -208,98 +965,1035 @@ NetIO::~NetIO(void)
         execOSCmd(cmd);
     }
 
-    close(tunfd);
-    close(netfd);
-}
+    if (tun_workers)
+        stopTunWorkers();
 
-void NetIO::prepareConntrack(TCPTrack *ct)
-{
-    conntrack = ct;
-}
+    /* packets extracted for a burst but never flushed */
+    while (tx_sent < tx_count)
+        delete tx_pkts[tx_sent++];
 
-void NetIO::networkIO(void)
-{
-    /*
-     * This is a critical function for sniffjoke operativity.
+    if (rx_ring != NULL)
+        munmap(rx_ring, rx_ring_len);
+
+    if (tx_ring != NULL)
+    {
+        munmap(tx_ring, tx_ring_len);
+        close(txfd);
+    }
+
+    if (epfd != -1)
+        close(epfd);
+
+    /* closing the io_uring cancels the requests still in flight */
+    if (uring_fd != -1)
+        close(uring_fd);
+
+    if (uring.map != NULL)
+        munmap(uring.map, uring.map_len);
+    if (uring.sqes != NULL)
+        munmap(uring.sqes, uring.sqes_len);
+    if (uring_tunbufs.ring != NULL)
+        munmap(uring_tunbufs.ring, uring_tunbufs.ring_len);
+    if (uring_netbufs.ring != NULL)
+        munmap(uring_netbufs.ring, uring_netbufs.ring_len);
+
+    delete[] uring_tunbufs.bufs;
+    delete[] uring_netbufs.bufs;
+    delete[] uring_tunbufs.unrecycled;
+    delete[] uring_netbufs.unrecycled;
+
+    for (uint32_t i = 0; i < URING_WRITE_SLOTS; ++i)
+        delete uring_writes[i].pkt;
+
+    if (timerfd != -1)
+        close(timerfd);
+
+    /* closing the last reference to the link detaches the XDP program */
+    if (xsk_fill.map != NULL)
+        munmap(xsk_fill.map, xsk_fill.map_len);
+    if (xsk_comp.map != NULL)
+        munmap(xsk_comp.map, xsk_comp.map_len);
+    if (xsk_rx.map != NULL)
+        munmap(xsk_rx.map, xsk_rx.map_len);
+    if (xsk_tx.map != NULL)
+        munmap(xsk_tx.map, xsk_tx.map_len);
+
+    if (xskfd != -1)
+        close(xskfd);
+    if (xsk_linkfd != -1)
+        close(xsk_linkfd);
+    if (xsk_progfd != -1)
+        close(xsk_progfd);
+    if (xsk_mapfd != -1)
+        close(xsk_mapfd);
+
+    if (xsk_umem != NULL)
+        munmap(xsk_umem, xsk_umem_len);
+
+    for (uint16_t i = 0; i < tun_queues_num; ++i)
+    {
+        if (i)
+            close(tun_queues[i].fd);
+        if (tun_queues[i].wakefd != -1)
+            close(tun_queues[i].wakefd);
+        delete[] tun_queues[i].bufs;
+    }
+
+    if (tun_eventfd != -1)
+        close(tun_eventfd);
+
+    delete[] tun_queues;
+
+    close(tunfd);
+    close(netfd);
+}
+
+void NetIO::prepareConntrack(TCPTrack *ct)
+{
+    conntrack = ct;
+
+    /* threads do not survive fork(): the workers start in the service process, like the io_uring */
+    if (userconf->runcfg.io_uring)
+        setupUring();
+    else
+        startTunWorkers();
+
+    setupEventLoop();
+}
+
+/*
+ * the epoll instance is created in the service process, where it is the only
+ * wait of the main loop: the network descriptors, timerfd and the descriptors
+ * of the caller (signalfd and the admin socket) are watched together.
+ */
+void NetIO::setupEventLoop()
+{
+    struct epoll_event ev;
+
+    if ((epfd = epoll_create1(EPOLL_CLOEXEC)) != -1)
+        LOG_DEBUG("epoll instance created successfully");
+    else
+        RUNTIME_EXCEPTION("unable to create the epoll instance: %s", strerror(errno));
+
+    if ((timerfd = timerfd_create(CLOCK_MONOTONIC, TFD_NONBLOCK | TFD_CLOEXEC)) != -1)
+        LOG_DEBUG("timerfd for the conntrack deadlines opened successfully");
+    else
+        RUNTIME_EXCEPTION("unable to open the timerfd: %s", strerror(errno));
+
+    memset(&ev, 0x00, sizeof (ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = NETIO_TIMER_TAG;
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, timerfd, &ev) == -1)
+        RUNTIME_EXCEPTION("unable to watch the timerfd: %s", strerror(errno));
+
+    /* registered without events: waitEvents sets the ones required by every cycle */
+    for (uint32_t i = 0; i < NETIO_FDS; ++i)
+    {
+        if (fds[i].fd == -1)
+            continue;
+
+        memset(&ev, 0x00, sizeof (ev));
+        ev.data.u32 = i;
+        if (epoll_ctl(epfd, EPOLL_CTL_ADD, fds[i].fd, &ev) == -1)
+            RUNTIME_EXCEPTION("unable to watch the descriptor %d: %s", fds[i].fd, strerror(errno));
+
+        fds_watched[i] = 0;
+    }
+}
+
+/* a descriptor of the caller: when readable networkIO returns its event */
+void NetIO::watchEvent(int fd, uint32_t event)
+{
+    struct epoll_event ev;
+
+    memset(&ev, 0x00, sizeof (ev));
+    ev.events = EPOLLIN;
+    ev.data.u32 = NETIO_EXTERNAL_TAG | event;
+
+    if (epoll_ctl(epfd, EPOLL_CTL_ADD, fd, &ev) == -1)
+        RUNTIME_EXCEPTION("unable to watch the descriptor %d: %s", fd, strerror(errno));
+}
+
+int NetIO::waitEvents(int timeout, uint32_t &events)
+{
+    struct epoll_event ready[NETIO_FDS + 3];
+    struct epoll_event ev;
+
+    /* epoll_ctl is called only when a descriptor needs different events than the last cycle */
+    for (uint32_t i = 0; i < NETIO_FDS; ++i)
+    {
+        fds[i].revents = 0;
+
+        if (fds[i].fd == -1 || fds[i].events == fds_watched[i])
+            continue;
+
+        memset(&ev, 0x00, sizeof (ev));
+        ev.events = fds[i].events;
+        ev.data.u32 = i;
+        if (epoll_ctl(epfd, EPOLL_CTL_MOD, fds[i].fd, &ev) == -1)
+            RUNTIME_EXCEPTION("unable to change the events of the descriptor %d: %s", fds[i].fd, strerror(errno));
+
+        fds_watched[i] = fds[i].events;
+    }
+
+    int ret = epoll_wait(epfd, ready, sizeof (ready) / sizeof (ready[0]), timeout);
+    if (ret == -1)
+    {
+        if (errno == EINTR)
+            return 0;
+
+        RUNTIME_EXCEPTION("strange and dangerous error in epoll_wait: %s", strerror(errno));
+    }
+
+    /* the EPOLL* values are the same of POLL*: the handlers of networkIO read the revents */
+    for (int i = 0; i < ret; ++i)
+    {
+        const uint32_t tag = ready[i].data.u32;
+
+        if (tag < NETIO_FDS)
+        {
+            fds[tag].revents = ready[i].events;
+        }
+        else if (tag == NETIO_TIMER_TAG)
+        {
+            uint64_t expirations;
+            if (read(timerfd, &expirations, sizeof (expirations)) == -1 && errno != EAGAIN)
+                RUNTIME_EXCEPTION("error reading the timerfd: %s", strerror(errno));
+
+            timer_deadline = 0;
+        }
+        else
+        {
+            events |= (tag & ~NETIO_EXTERNAL_TAG);
+        }
+    }
+
+    return ret;
+}
+
+void NetIO::armTimer(void)
+{
+    struct itimerspec its;
+    const uint64_t deadline = conntrack->nextDeadline();
+
+    /* nothing changed, or no deadline with the timer already disarmed */
+    if (deadline == timer_deadline)
+        return;
+
+    memset(&its, 0x00, sizeof (its));
+
+    /* a deadline already reached paces the conntrack like the ttl probes require */
+    if (deadline && deadline <= sj_clock_msec)
+    {
+        its.it_value.tv_nsec = NETIO_TIMER_PACE;
+    }
+    else if (deadline)
+    {
+        its.it_value.tv_sec = (deadline - sj_clock_msec) / 1000;
+        its.it_value.tv_nsec = ((deadline - sj_clock_msec) % 1000) * 1000000;
+    }
+
+    if (timerfd_settime(timerfd, 0, &its, NULL) == -1)
+        RUNTIME_EXCEPTION("unable to arm the timerfd: %s", strerror(errno));
+
+    timer_deadline = deadline;
+}
+
+void NetIO::loadNetBurst(void)
+{
+    tx_sent = 0;
+    tx_count = conntrack->readpacketBurst(TUNNEL, tx_pkts, NETIOBATCHSIZE);
+
+    for (uint32_t i = 0; i < tx_count; ++i)
+    {
+        tx_iovs[i].iov_base = &(tx_pkts[i]->pbuf[0]);
+        tx_iovs[i].iov_len = tx_pkts[i]->pbuf.size();
+    }
+}
+
+void NetIO::sendNetBurst(void)
+{
+    int ret = sendmmsg(netfd, &tx_msgs[tx_sent], tx_count - tx_sent, 0x00);
+
+    if (ret == -1) /* like sendto, after a poll this happens only on error's case */
+        RUNTIME_EXCEPTION("error writing in network: %s", strerror(errno));
+
+    /* correctly written in netfd: a partial write keeps the remaining for the next POLLOUT */
+    for (int i = 0; i < ret; ++i)
+        delete tx_pkts[tx_sent++];
+
+    if (tx_sent == tx_count)
+        loadNetBurst();
+}
+
+void NetIO::recvNetBurst(void)
+{
+    int ret = recvmmsg(netfd, rx_msgs, NETIOBATCHSIZE, MSG_DONTWAIT, NULL);
+
+    if (ret == -1)
+    {
+        if (errno == EAGAIN || errno == EWOULDBLOCK)
+            return;
+
+        RUNTIME_EXCEPTION("error reading from network: %s", strerror(errno));
+    }
+
+    for (int i = 0; i < ret; ++i)
+        conntrack->writepacket(NETWORK, (unsigned char *) rx_iovs[i].iov_base, rx_msgs[i].msg_len);
+}
+
+void NetIO::recvNetRing(void)
+{
+    /*
+     * every retired block is walked frame by frame and the IP packet is
+     * passed to the conntrack directly from the shared memory; the block
+     * is returned to the kernel only when all its frames are consumed.
+     */
+    for (uint32_t walked = 0; walked < RXRING_BLOCK_NUM; ++walked)
+    {
+        struct tpacket_block_desc *block = (struct tpacket_block_desc *) (rx_ring + (size_t) rx_ring_block * RXRING_BLOCK_SIZE);
+
+        if (!(block->hdr.bh1.block_status & TP_STATUS_USER))
+            break;
+
+        __sync_synchronize();
+
+        struct tpacket3_hdr *frame = (struct tpacket3_hdr *) ((unsigned char *) block + block->hdr.bh1.offset_to_first_pkt);
+        for (uint32_t i = 0; i < block->hdr.bh1.num_pkts; ++i)
+        {
+            conntrack->writepacket(NETWORK, (unsigned char *) frame + frame->tp_net, frame->tp_snaplen);
+            frame = (struct tpacket3_hdr *) ((unsigned char *) frame + frame->tp_next_offset);
+        }
+
+        __sync_synchronize();
+
+        block->hdr.bh1.block_status = TP_STATUS_KERNEL;
+        rx_ring_block = (rx_ring_block + 1) % RXRING_BLOCK_NUM;
+    }
+}
+
+void NetIO::sendNetRing(void)
+{
+    uint32_t queued = 0;
+
+    /*
+     * the burst is copied in the free frames starting from our head;
+     * when the head frame is still owned by the kernel the ring is full
+     * and the remaining packets wait for the next POLLOUT on txfd.
+     */
+    while (tx_sent < tx_count)
+    {
+        struct tpacket2_hdr *frame = (struct tpacket2_hdr *) (tx_ring + (size_t) tx_ring_head * TXRING_FRAME_SIZE);
+
+        if (frame->tp_status == TP_STATUS_WRONG_FORMAT)
+            ++tx_ring_drops; /* rejected by the kernel: the frame is reused */
+        else if (frame->tp_status != TP_STATUS_AVAILABLE)
+            break;
+
+        Packet *pkt = tx_pkts[tx_sent++];
+
+        memcpy((unsigned char *) frame + TPACKET2_HDRLEN - sizeof (struct sockaddr_ll), &(pkt->pbuf[0]), pkt->pbuf.size());
+        frame->tp_len = pkt->pbuf.size();
+
+        __sync_synchronize();
+
+        frame->tp_status = TP_STATUS_SEND_REQUEST;
+        tx_ring_head = (tx_ring_head + 1) % TXRING_FRAME_NUM;
+        ++queued;
+
+        delete pkt;
+
+        if (tx_sent == tx_count)
+            loadNetBurst();
+    }
+
+    if (!queued)
+        return;
+
+    /* a single kick for the whole burst */
+    if (sendto(txfd, NULL, 0, MSG_DONTWAIT, (struct sockaddr *) &send_ll, sizeof (send_ll)) == -1)
+    {
+        if (errno != EAGAIN && errno != ENOBUFS && errno != EINVAL)
+            RUNTIME_EXCEPTION("error flushing the tx ring: %s", strerror(errno));
+
+        LOG_DEBUG("tx ring flush deferred: %s", strerror(errno));
+    }
+}
+
+void NetIO::recvNetXsk(void)
+{
+    const uint32_t mask = XSK_RING_SIZE - 1;
+    struct xdp_desc *rx = (struct xdp_desc *) xsk_rx.desc;
+    uint64_t *fill = (uint64_t *) xsk_fill.desc;
+
+    uint32_t rx_cons = *xsk_rx.consumer;
+    const uint32_t rx_prod = *xsk_rx.producer;
+    uint32_t fill_prod = *xsk_fill.producer;
+
+    __sync_synchronize();
+
+    /*
+     * the frames are copied in a Packet and go back to the fill ring at
+     * once: the fill ring has a slot for every frame used in reception,
+     * so it can't overflow. the UMEM is not shared with the PacketPool:
+     * a frame kept by a Packet (KEEP waits up to max-keep-time) would be
+     * missing from the fill ring, and the UMEM would have to be the whole
+     * pinned slab of the pool buffers with the frame layout of the XDP.
+     */
+    for (; rx_cons != rx_prod; ++rx_cons)
+    {
+        const struct xdp_desc &desc = rx[rx_cons & mask];
+
+        if (desc.len > ETH_HLEN)
+            conntrack->writepacket(NETWORK, xsk_umem + desc.addr + ETH_HLEN, desc.len - ETH_HLEN);
+
+        fill[fill_prod++ & mask] = desc.addr - (desc.addr % XSK_FRAME_SIZE);
+    }
+
+    __sync_synchronize();
+
+    *xsk_rx.consumer = rx_cons;
+    *xsk_fill.producer = fill_prod;
+}
+
+void NetIO::sendNetXsk(void)
+{
+    const uint32_t mask = XSK_RING_SIZE - 1;
+    struct xdp_desc *tx = (struct xdp_desc *) xsk_tx.desc;
+    uint64_t *comp = (uint64_t *) xsk_comp.desc;
+    uint32_t queued = 0;
+
+    /* the frames completed by the kernel are free again */
+    uint32_t comp_cons = *xsk_comp.consumer;
+    const uint32_t comp_prod = *xsk_comp.producer;
+
+    __sync_synchronize();
+
+    for (; comp_cons != comp_prod; ++comp_cons)
+        xsk_tx_frames.push_back(comp[comp_cons & mask]);
+
+    __sync_synchronize();
+
+    *xsk_comp.consumer = comp_cons;
+
+    /*
+     * the burst is copied in free frames behind our ethernet header; without
+     * free frames or descriptors the remaining packets wait the next POLLOUT.
+     */
+    uint32_t tx_prod = *xsk_tx.producer;
+    const uint32_t tx_cons = *xsk_tx.consumer;
+
+    while (tx_sent < tx_count && !xsk_tx_frames.empty() && tx_prod - tx_cons < XSK_RING_SIZE)
+    {
+        Packet *pkt = tx_pkts[tx_sent++];
+
+        const uint64_t addr = xsk_tx_frames.back();
+        xsk_tx_frames.pop_back();
+
+        memcpy(xsk_umem + addr, xsk_ethhdr, ETH_HLEN);
+        memcpy(xsk_umem + addr + ETH_HLEN, &(pkt->pbuf[0]), pkt->pbuf.size());
+
+        tx[tx_prod & mask].addr = addr;
+        tx[tx_prod & mask].len = ETH_HLEN + pkt->pbuf.size();
+        tx[tx_prod & mask].options = 0;
+        ++tx_prod;
+        ++queued;
+
+        delete pkt;
+
+        if (tx_sent == tx_count)
+            loadNetBurst();
+    }
+
+    if (!queued)
+        return;
+
+    __sync_synchronize();
+
+    *xsk_tx.producer = tx_prod;
+
+    /* a single kick for the whole burst, only when the kernel asks for it */
+    if (!(*xsk_tx.flags & XDP_RING_NEED_WAKEUP))
+        return;
+
+    if (sendto(xskfd, NULL, 0, MSG_DONTWAIT, NULL, 0) == -1)
+    {
+        if (errno != EAGAIN && errno != EBUSY && errno != ENOBUFS && errno != ENETDOWN)
+            RUNTIME_EXCEPTION("error flushing the AF_XDP tx ring: %s", strerror(errno));
+
+        LOG_DEBUG("AF_XDP tx flush deferred: %s", strerror(errno));
+    }
+}
+
+struct io_uring_sqe *NetIO::getUringSqe(void)
+{
+    /* a full submission queue is flushed to the kernel */
+    if (uring.sq_tail_local - *uring.sq_head == uring.sq_entries)
+        submitUring();
+
+    struct io_uring_sqe *sqe = &uring.sqes[uring.sq_tail_local & uring.sq_mask];
+    memset(sqe, 0x00, sizeof (*sqe));
+    ++uring.sq_tail_local;
+
+    return sqe;
+}
+
+void NetIO::submitUring(void)
+{
+    const uint32_t to_submit = uring.sq_tail_local - *uring.sq_tail;
+
+    if (!to_submit)
+        return;
+
+    __sync_synchronize();
+
+    *uring.sq_tail = uring.sq_tail_local;
+
+    /* the entries not consumed on EAGAIN/EBUSY are published, the next enter takes them */
+    if (syscall(__NR_io_uring_enter, uring_fd, to_submit, 0, 0, NULL, 0) == -1)
+    {
+        if (errno != EAGAIN && errno != EBUSY && errno != EINTR)
+            RUNTIME_EXCEPTION("unable to submit to the io_uring: %s", strerror(errno));
+
+        LOG_DEBUG("io_uring submission deferred: %s", strerror(errno));
+    }
+}
+
+void NetIO::postUringRead(uint16_t queue)
+{
+    struct io_uring_sqe *sqe = getUringSqe();
+
+    sqe->opcode = uring_multishot_read ? SJ_IORING_OP_READ_MULTISHOT : IORING_OP_READ;
+    sqe->fd = tun_queues[queue].fd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->buf_group = uring_tunbufs.bgid;
+    sqe->len = uring_multishot_read ? 0 : uring_tunbufs.buf_size;
+    sqe->user_data = ((uint64_t) URING_TAG_READ << 32) | queue;
+}
+
+void NetIO::postUringRecv(void)
+{
+    struct io_uring_sqe *sqe = getUringSqe();
+
+    sqe->opcode = IORING_OP_RECV;
+    sqe->fd = netfd;
+    sqe->flags = IOSQE_BUFFER_SELECT;
+    sqe->ioprio = uring_multishot_recv ? IORING_RECV_MULTISHOT : 0;
+    sqe->buf_group = uring_netbufs.bgid;
+    sqe->len = uring_multishot_recv ? 0 : uring_netbufs.buf_size;
+    sqe->user_data = ((uint64_t) URING_TAG_RECV << 32);
+}
+
+/* false when the pool can't give a new buffer: the bid is left out of the ring */
+bool NetIO::refillUringBuf(struct uringBufGroup &group, uint16_t bid)
+{
+    /* a buffer adopted by a Packet is replaced, one not used is given back as it is */
+    try
+    {
+        group.bufs[bid].reserve(group.buf_size);
+    }
+    catch (bad_alloc &e)
+    {
+        return false;
+    }
+
+    /*
+     * in C++ the empty struct of __DECLARE_FLEX_ARRAY moves io_uring_buf_ring.bufs
+     * to offset 8: the descriptors are indexed from the start of the ring instead
+     */
+    const uint16_t tail = group.ring->tail;
+    struct io_uring_buf &buf = ((struct io_uring_buf *) group.ring)[tail & (group.buf_num - 1)];
+
+    buf.addr = (uintptr_t) group.bufs[bid].begin();
+    buf.len = group.buf_size;
+    buf.bid = bid;
+
+    __sync_synchronize();
+
+    *(volatile uint16_t *) &(group.ring->tail) = tail + 1;
+
+    return true;
+}
+
+void NetIO::recycleUringBuf(struct uringBufGroup &group, uint16_t bid)
+{
+    if (refillUringBuf(group, bid))
+        return;
+
+    group.unrecycled[group.unrecycled_num++] = bid;
+    conntrack->countPoolDrop();
+}
+
+/* the bids left out by an exhausted pool, until the first still refused */
+void NetIO::retryUringBufs(struct uringBufGroup &group)
+{
+    while (group.unrecycled_num && refillUringBuf(group, group.unrecycled[group.unrecycled_num - 1]))
+        --group.unrecycled_num;
+}
+
+void NetIO::reapUring(void)
+{
+    retryUringBufs(uring_tunbufs);
+    retryUringBufs(uring_netbufs);
+
+    uint32_t head = *uring.cq_head;
+    const uint32_t tail = *uring.cq_tail;
+
+    __sync_synchronize();
+
+    for (; head != tail; ++head)
+    {
+        const struct io_uring_cqe cqe = uring.cqes[head & uring.cq_mask];
+        const uint32_t tag = cqe.user_data >> 32;
+        const uint32_t index = cqe.user_data & 0xFFFFFFFF;
+
+        if (tag == URING_TAG_WRITE)
+        {
+            struct uringWrite &write = uring_writes[index];
+
+            /* a failed write cancels the rest of its chain */
+            if (cqe.res < 0 && cqe.res != -ECANCELED && cqe.res != -EAGAIN && cqe.res != -ENOBUFS)
+                RUNTIME_EXCEPTION("error writing in %s: %s", write.msg.msg_name ? "network" : "tunnel", strerror(-cqe.res));
+
+            if (cqe.res < 0)
+                LOG_DEBUG("packet dropped by the io_uring write: %s", strerror(-cqe.res));
+
+            delete write.pkt;
+            write.pkt = NULL;
+            uring_free_writes.push_back(index);
+
+            continue;
+        }
+
+        struct uringBufGroup &group = (tag == URING_TAG_READ) ? uring_tunbufs : uring_netbufs;
+        bool &multishot = (tag == URING_TAG_READ) ? uring_multishot_read : uring_multishot_recv;
+
+        if (cqe.res >= 0 && (cqe.flags & IORING_CQE_F_BUFFER))
+        {
+            const uint16_t bid = cqe.flags >> IORING_CQE_BUFFER_SHIFT;
+            PacketBuffer &buf = group.bufs[bid];
+
+            /* the packets take the buffers read, without a copy */
+            if (tag == URING_TAG_RECV)
+                conntrack->writepacket(NETWORK, buf, 0, cqe.res);
+            else
+                tunToConntrack(buf, cqe.res);
+
+            recycleUringBuf(group, bid);
+        }
+        else if (cqe.res == -EINVAL && multishot)
+        {
+            LOG_VERBOSE("multishot %s unsupported by the kernel: using single shot reads", tag == URING_TAG_READ ? "read" : "recv");
+            multishot = false;
+        }
+        else if (cqe.res < 0 && cqe.res != -ENOBUFS && cqe.res != -EAGAIN && cqe.res != -EINTR)
+        {
+            RUNTIME_EXCEPTION("error reading from %s: %s", tag == URING_TAG_READ ? "tunnel" : "network", strerror(-cqe.res));
+        }
+
+        /* the read is over (single shot, buffers exhausted, unsupported multishot): post it again */
+        if (!(cqe.flags & IORING_CQE_F_MORE))
+        {
+            if (tag == URING_TAG_READ)
+                postUringRead(index);
+            else
+                postUringRecv();
+        }
+    }
+
+    __sync_synchronize();
+
+    *uring.cq_head = head;
+
+    submitUring();
+}
+
+/*
+ * the packets of the SEND queue are written in two chains of linked
+ * entries, one for tunfd and one for netfd, so that the kernel keeps
+ * their order; URING_ENTRIES is greater than URING_WRITE_SLOTS plus
+ * the posted reads, so a chain is never split by a full queue.
+ */
+void NetIO::submitUringWrites(void)
+{
+    const source_t destinations[2] = { NETWORK, TUNNEL };
+    Packet *pkts[NETIOBATCHSIZE];
+
+    for (uint32_t d = 0; d < 2; ++d)
+    {
+        struct io_uring_sqe *last = NULL;
+
+        while (!uring_free_writes.empty())
+        {
+            const uint32_t maxpkts = (uring_free_writes.size() < NETIOBATCHSIZE) ? uring_free_writes.size() : NETIOBATCHSIZE;
+            const uint32_t count = conntrack->readpacketBurst(destinations[d], pkts, maxpkts);
+
+            if (!count)
+                break;
+
+            for (uint32_t i = 0; i < count; ++i)
+            {
+                const uint32_t slot = uring_free_writes.back();
+                uring_free_writes.pop_back();
+
+                struct uringWrite &write = uring_writes[slot];
+                struct io_uring_sqe *sqe = getUringSqe();
+
+                write.pkt = pkts[i];
+                memset(&write.msg, 0x00, sizeof (write.msg));
+
+                if (destinations[d] == NETWORK) /* the packets received from the network go in the tunnel */
+                {
+                    write.iov[0].iov_base = &tun_vnet_hdr;
+                    write.iov[0].iov_len = sizeof (tun_vnet_hdr);
+                    write.iov[1].iov_base = &(write.pkt->pbuf[0]);
+                    write.iov[1].iov_len = write.pkt->pbuf.size();
+
+                    /* without GSO the vnet header is skipped */
+                    sqe->opcode = IORING_OP_WRITEV;
+                    sqe->fd = tunfd;
+                    sqe->addr = (uintptr_t) (tun_gso ? &write.iov[0] : &write.iov[1]);
+                    sqe->len = tun_gso ? 2 : 1;
+                }
+                else
+                {
+                    write.iov[0].iov_base = &(write.pkt->pbuf[0]);
+                    write.iov[0].iov_len = write.pkt->pbuf.size();
+                    write.msg.msg_name = &send_ll;
+                    write.msg.msg_namelen = sizeof (send_ll);
+                    write.msg.msg_iov = &write.iov[0];
+                    write.msg.msg_iovlen = 1;
+
+                    sqe->opcode = IORING_OP_SENDMSG;
+                    sqe->fd = netfd;
+                    sqe->addr = (uintptr_t) &write.msg;
+                    sqe->len = 1;
+                }
+
+                sqe->flags = IOSQE_IO_LINK;
+                sqe->user_data = ((uint64_t) URING_TAG_WRITE << 32) | slot;
+                last = sqe;
+            }
+        }
+
+        if (last != NULL)
+            last->flags &= ~IOSQE_IO_LINK;
+    }
+
+    submitUring();
+}
+
+/*
+ * the buffers given to the conntrack are replaced: with the pool exhausted
+ * the slots stay empty, retried at the next call, and the worker waits.
+ */
+void NetIO::refillTunQueue(struct tunQueue &queue)
+{
+    uint32_t tail = queue.tail;
+
+    try
+    {
+        for (; tail != queue.reaped + queue.slot_num; ++tail)
+            queue.bufs[tail % queue.slot_num].reserve(queue.slot_size);
+    }
+    catch (bad_alloc &e)
+    {
+        conntrack->countPoolDrop();
+    }
+
+    if (tail == queue.tail)
+        return;
+
+    __atomic_store_n(&queue.tail, tail, __ATOMIC_SEQ_CST);
+
+    if (__atomic_load_n(&queue.waiting, __ATOMIC_SEQ_CST) && !signalEventfd(queue.wakefd))
+        RUNTIME_EXCEPTION("unable to wake the worker of a tunnel queue: %s", strerror(errno));
+}
+
+void NetIO::recvTunQueues(void)
+{
+    /* the eventfd is cleared before draining: a signal sent during the drain is not lost */
+    clearEventfd(tun_eventfd);
+
+    drainTunQueues();
+}
+
+/*
+ * called also at every networkIO: a ring stopped by an exhausted pool is
+ * not signaled again by its worker, waiting for the slots to be refilled.
+ */
+void NetIO::drainTunQueues(void)
+{
+    /* every ring is drained in FIFO order: the packets of a flow stay in sequence */
+    for (uint16_t i = 0; i < tun_queues_num; ++i)
+    {
+        struct tunQueue &queue = tun_queues[i];
+
+        refillTunQueue(queue);
+
+        /* a packet is taken only when the slots before it have been refilled */
+        while (queue.tail == queue.reaped + queue.slot_num && queue.reaped != __atomic_load_n(&queue.head, __ATOMIC_SEQ_CST))
+        {
+            const uint32_t slot = queue.reaped % queue.slot_num;
+            tunToConntrack(queue.bufs[slot], queue.slot_len[slot]);
+
+            __atomic_store_n(&queue.reaped, queue.reaped + 1, __ATOMIC_SEQ_CST);
+
+            refillTunQueue(queue);
+        }
+
+        const int error = __atomic_load_n(&queue.error, __ATOMIC_ACQUIRE);
+        if (error)
+            RUNTIME_EXCEPTION("error reading from tunnel queue %u: %s", i, strerror(error));
+    }
+}
+
+/* the offload requested by the vnet header in front of a GSO read */
+bool NetIO::readVnetHdr(const unsigned char *buf, ssize_t len, uint16_t &gso_size, bool &needs_csum)
+{
+    if (len < (ssize_t) sizeof (struct sj_vnet_hdr))
+    {
+        LOG_ALL("truncated read from tunnel: %d bytes without vnet header", len);
+        return false;
+    }
+
+    const struct sj_vnet_hdr *vnet = (const struct sj_vnet_hdr *) buf;
+
+    /* only TCPV4 is enabled by TUNSETOFFLOAD, the ECN bit does not change the segmentation */
+    gso_size = 0;
+    if ((vnet->gso_type & ~SJ_VNET_HDR_GSO_ECN) == SJ_VNET_HDR_GSO_TCPV4)
+        gso_size = vnet->gso_size;
+
+    needs_csum = vnet->flags & SJ_VNET_HDR_F_NEEDS_CSUM;
+
+    return true;
+}
+
+void NetIO::tunToConntrack(unsigned char *buf, ssize_t len)
+{
+    if (!tun_gso)
+    {
+        conntrack->writepacket(TUNNEL, buf, len);
+        return;
+    }
+
+    uint16_t gso_size;
+    bool needs_csum;
+
+    if (readVnetHdr(buf, len, gso_size, needs_csum))
+        conntrack->writepacket(TUNNEL, buf + sizeof (struct sj_vnet_hdr), len - sizeof (struct sj_vnet_hdr),
+                               gso_size, needs_csum);
+}
+
+/* the packet takes the buffer read, without a copy */
+void NetIO::tunToConntrack(PacketBuffer &buf, ssize_t len)
+{
+    if (!tun_gso)
+    {
+        conntrack->writepacket(TUNNEL, buf, 0, len);
+        return;
+    }
+
+    uint16_t gso_size;
+    bool needs_csum;
+
+    if (readVnetHdr(buf.begin(), len, gso_size, needs_csum))
+        conntrack->writepacket(TUNNEL, buf, sizeof (struct sj_vnet_hdr), len - sizeof (struct sj_vnet_hdr),
+                               gso_size, needs_csum);
+}
+
+ssize_t NetIO::writeTun(const Packet &pkt)
+{
+    if (!tun_gso)
+        return write(tunfd, &(pkt.pbuf[0]), pkt.pbuf.size());
+
+    /* the packets for the tunnel are complete: an empty vnet header is enough */
+    struct iovec iov[2];
+    iov[0].iov_base = &tun_vnet_hdr;
+    iov[0].iov_len = sizeof (tun_vnet_hdr);
+    iov[1].iov_base = (void *) &(pkt.pbuf[0]);
+    iov[1].iov_len = pkt.pbuf.size();
+
+    return writev(tunfd, iov, 2);
+}
+
+void NetIO::ringStats(struct netio_ring_stats &stats)
+{
+    memset(&stats, 0x00, sizeof (stats));
+
+    if (rx_ring != NULL)
+    {
+        struct tpacket_stats_v3 kstats;
+        socklen_t kstats_len = sizeof (kstats);
+
+        /* PACKET_STATISTICS resets the kernel counters on every read */
+        if (getsockopt(netfd, SOL_PACKET, PACKET_STATISTICS, &kstats, &kstats_len) != -1)
+            rx_ring_drops += kstats.tp_drops;
+
+        stats.rx_ring = true;
+        stats.rx_blocks = RXRING_BLOCK_NUM;
+        stats.rx_drops = rx_ring_drops;
+        for (uint32_t i = 0; i < RXRING_BLOCK_NUM; ++i)
+        {
+            struct tpacket_block_desc *block = (struct tpacket_block_desc *) (rx_ring + (size_t) i * RXRING_BLOCK_SIZE);
+            if (block->hdr.bh1.block_status & TP_STATUS_USER)
+                ++stats.rx_blocks_used;
+        }
+    }
+
+    if (tx_ring != NULL)
+    {
+        stats.tx_ring = true;
+        stats.tx_frames = TXRING_FRAME_NUM;
+        stats.tx_drops = tx_ring_drops;
+        for (uint32_t i = 0; i < TXRING_FRAME_NUM; ++i)
+        {
+            struct tpacket2_hdr *frame = (struct tpacket2_hdr *) (tx_ring + (size_t) i * TXRING_FRAME_SIZE);
+            if (frame->tp_status != TP_STATUS_AVAILABLE)
+                ++stats.tx_frames_used;
+        }
+    }
+}
+
+uint32_t NetIO::networkIO(void)
+{
+    /*
+     * This is a critical function for sniffjoke operativity.
      *
-     * this function implements a variable poll step
+     * this function implements a variable wait step on epfd
 
-     * if there is some data to send out the poll timout is set to
+     * if there is some data to send out the wait timout is set to
      * infinite because it's important to force data flush.
      *
-     * if there is no data to send out the poll timeout is always
-     * set to 1 ms;
-     *
-     * with a max cycle count of 10 and a poll timeout of 1ms
-     * we will exit if:
+     * if there is no data to send out the first wait is infinite too:
+     * an idle host sleeps until a packet, the timerfd armed on the
+     * conntrack deadlines, a signal or an admin command. after the
+     * first event the ready descriptors are only drained, with a zero
+     * timeout, and we exit when nothing more is ready or if:
      *    - a burst of 20 pkts (10 network + 10 tunnel) has been received;
-     *    - a delay of 10ms has passed.
+     *    - a signal or an admin command has arrived, returned to the
+     *      caller as NETIO_EVENT_* flags.
+     *
+     * in batch mode the network side moves up to NETIOBATCHSIZE
+     * packets for every readiness event: recvmmsg drains netfd and
+     * sendmmsg flushes a burst extracted with readpacketBurst.
+     * in rx ring mode the input of netfd is consumed directly from the
+     * TPACKET_V3 blocks retired by the kernel.
+     * in tx ring mode the bursts for the network are written in the
+     * PACKET_TX_RING of txfd, whose POLLOUT is watched in fds[2].
+     * in multiqueue mode tunfd is read by the queue workers, and
+     * the core drains their rings when tun_eventfd is signaled.
+     * in xdp mode the frames of the gateway arrive on xskfd, fds[4],
+     * and the bursts for the network are written in its tx ring.
+     * in io_uring mode tunfd and netfd are not polled at all: the reads
+     * and the writes are requests of the ring, whose completions wake
+     * up uring_fd, fds[5]; the SEND queue is submitted at every call.
      *
      * read, read, read and than re-read all comments hundred times
      * before thinking to change this :P
      *
      */
     uint32_t max_cycle = NETIOBURSTSIZE;
+    uint32_t events = 0;
+    bool woken = false;
+    int timeout;
 
-    vector<unsigned char> pktbuf(userconf->runcfg.net_iface_mtu);
+    const bool batch_io = userconf->runcfg.batch_io;
+    const bool tx_ring_io = (tx_ring != NULL);
+    const bool xsk_io = (xskfd != -1);
+    const bool uring_io = (uring_fd != -1);
+    const short tun_pollin = (tun_workers || uring_io) ? 0 : POLLIN;
+    const short net_pollin = uring_io ? 0 : POLLIN;
 
     ssize_t ret;
 
-    Packet *pkt_tun = conntrack->readpacket(TUNNEL);
-    Packet *pkt_net = conntrack->readpacket(NETWORK);
+    Packet *pkt_tun = NULL;
+    Packet *pkt_net = NULL;
+
+    if (tun_workers)
+        drainTunQueues();
+
+    if (uring_io)
+    {
+        submitUringWrites();
+    }
+    else
+    {
+        pkt_net = conntrack->readpacket(NETWORK);
+
+        if (batch_io || tx_ring_io || xsk_io)
+            loadNetBurst();
+        else
+            pkt_tun = conntrack->readpacket(TUNNEL);
+    }
+
+    bool net_pending = (pkt_tun != NULL || tx_sent < tx_count);
 
-    while (pkt_tun != NULL || pkt_net != NULL || max_cycle)
+    while (net_pending || pkt_net != NULL || max_cycle)
     {
         if (max_cycle != 0) max_cycle--;
 
-        if (pkt_tun != NULL || pkt_net != NULL)
+        if (net_pending || pkt_net != NULL)
         {
             /*
-             * if there is some data to flush out the poll
+             * if there is some data to flush out the wait
              * timeout is set to infinite
              */
 
-            fds[0].events = (pkt_net != NULL) ? POLLIN | POLLOUT : POLLIN;
-            fds[1].events = (pkt_tun != NULL) ? POLLIN | POLLOUT : POLLIN;
+            fds[0].events = (pkt_net != NULL) ? tun_pollin | POLLOUT : tun_pollin;
+            fds[1].events = (net_pending && !tx_ring_io && !xsk_io) ? POLLIN | POLLOUT : net_pollin;
+            fds[2].events = net_pending ? POLLOUT : 0;
+            fds[4].events = net_pending ? POLLIN | POLLOUT : POLLIN;
 
-            nfds = poll(fds, 2, -1);
+            timeout = -1;
         }
         else
         {
             /*
-             * if there are not data to flush out the poll
-             * timeout is set to 1ms
+             * if there are not data to flush out the wait
+             * is infinite only before the first event
              */
 
-            fds[0].events = POLLIN;
-            fds[1].events = POLLIN;
+            fds[0].events = tun_pollin;
+            fds[1].events = net_pollin;
+            fds[2].events = 0;
+            fds[4].events = POLLIN;
 
-            timespec timeout;
-            timeout.tv_sec = 0;
-            timeout.tv_nsec = 1000000;
-            nfds = ppoll(fds, 2, &timeout, NULL);
+            timeout = woken ? 0 : -1;
         }
 
+        nfds = waitEvents(timeout, events);
+
+        if (!nfds && !timeout)
+            break;
+
         if (!nfds)
             continue;
 
-        /* in the three cases poll/ppoll is set, now we check the nfds return value */
-        if (nfds == -1)
-            RUNTIME_EXCEPTION("strange and dangerous error in ppoll: %s", strerror(errno));
+        woken = true;
+
+        /* signals and admin commands are served by the caller as soon as the output is flushed */
+        if (events)
+            max_cycle = 0;
+
+        if (fds[3].revents & POLLIN) /* some tun queue worker has packets for us */
+        {
+            recvTunQueues();
+        }
 
         if (fds[0].revents & POLLIN) /* it's possibile to read from tunfd */
         {
-            ret = read(tunfd, &(pktbuf[0]), userconf->runcfg.tun_iface_mtu);
+            ret = read(tunfd, &(pktbuf[0]), tun_readsize);
 
             if (ret == -1)
                 RUNTIME_EXCEPTION("error reading from tunnel: %s", strerror(errno));
 
-            conntrack->writepacket(TUNNEL, &(pktbuf[0]), ret);
+            tunToConntrack(&(pktbuf[0]), ret);
         }
 
         if (fds[0].revents & POLLOUT) /* it's possibile to write in tunfd */
         {
-            ret = write(tunfd, &(pkt_net->pbuf[0]), pkt_net->pbuf.size());
+            ret = writeTun(*pkt_net);
 
             if (ret == -1) /* on single thread applications after a poll a write returns -1 only on error's case. */
                 RUNTIME_EXCEPTION("error writing in tunnel: %s", strerror(errno));
@@ -309,7 +2003,15 @@ void NetIO::networkIO(void)
             pkt_net = conntrack->readpacket(NETWORK);
         }
 
-        if (fds[1].revents & POLLIN) /* it's possible to read from netfd */
+        if ((fds[1].revents & POLLIN) && rx_ring != NULL)
+        {
+            recvNetRing();
+        }
+        else if ((fds[1].revents & POLLIN) && batch_io)
+        {
+            recvNetBurst();
+        }
+        else if (fds[1].revents & POLLIN) /* it's possible to read from netfd */
         {
             ret = recv(netfd, &(pktbuf[0]), userconf->runcfg.net_iface_mtu, 0);
 
@@ -319,7 +2021,11 @@ void NetIO::networkIO(void)
             conntrack->writepacket(NETWORK, &(pktbuf[0]), ret);
         }
 
-        if (fds[1].revents & POLLOUT) /* it's possibile to write in netfd */
+        if ((fds[1].revents & POLLOUT) && batch_io)
+        {
+            sendNetBurst();
+        }
+        else if (fds[1].revents & POLLOUT) /* it's possibile to write in netfd */
         {
             ret = sendto(netfd, &(pkt_tun->pbuf[0]), pkt_tun->pbuf.size(), 0x00, (struct sockaddr *) &send_ll, sizeof (send_ll));
 
@@ -330,14 +2036,41 @@ void NetIO::networkIO(void)
             delete pkt_tun;
             pkt_tun = conntrack->readpacket(TUNNEL);
         }
+
+        if (fds[2].revents & POLLOUT) /* there are free frames in the tx ring */
+        {
+            sendNetRing();
+        }
+
+        if (fds[4].revents & POLLIN) /* the XDP program has redirected some frame */
+        {
+            recvNetXsk();
+        }
+
+        if (fds[4].revents & POLLOUT) /* there are free descriptors in the AF_XDP tx ring */
+        {
+            sendNetXsk();
+        }
+
+        if (fds[5].revents & POLLIN) /* some io_uring request has completed */
+        {
+            reapUring();
+            submitUringWrites();
+        }
+
+        net_pending = (pkt_tun != NULL || tx_sent < tx_count);
     }
 
     /*
      * If the flow control arrives here:
      *   - output data has been flushed entirely
      *   - there is some input data to handle (maximum 20 pkts i/o) or
-     *     a max delay of 10ms it's passed.
+     *     the wait has been woken by the timer, a signal or an admin command.
      */
     conntrack->analyzePacketQueue();
+
+    armTimer();
+
+    return events;
 }
 
@@ -24,35 +24,304 @@
 #define SJ_NETIO_H
 
 #include "Utils.h"
-#include "TCPTrack.h"
+#include "PacketIO.h"
 
 #include <poll.h>
-#include <netpacket/packet.h>
+#include <pthread.h>
+#include <sys/socket.h>
+#include <linux/if_packet.h>
+#include <linux/if_xdp.h>
+#include <linux/io_uring.h>
+#include <sys/uio.h>
 
-class NetIO
+/*
+ * the virtio_net_hdr prepended by the tun in IFF_VNET_HDR mode;
+ * linux/virtio_net.h can't be included by a C++ source, so the
+ * 10 bytes legacy layout used by the tun is reported here.
+ */
+struct sj_vnet_hdr
 {
-private:
+    uint8_t flags;
+    uint8_t gso_type;
+    uint16_t hdr_len;
+    uint16_t gso_size;
+    uint16_t csum_start;
+    uint16_t csum_offset;
+};
+
+#define SJ_VNET_HDR_F_NEEDS_CSUM    1
+#define SJ_VNET_HDR_GSO_NONE        0
+#define SJ_VNET_HDR_GSO_TCPV4       1
+#define SJ_VNET_HDR_GSO_ECN         0x80
+
+/* the pointers to a ring shared with the kernel by the AF_XDP socket */
+struct xskRing
+{
+    volatile uint32_t *producer;
+    volatile uint32_t *consumer;
+    volatile uint32_t *flags;
+    void *desc;
+    unsigned char *map;
+    size_t map_len;
+};
+
+/*
+ * the rings shared with the kernel by the io_uring, mapped together in map;
+ * sq_tail_local is the next free entry, published in sq_tail on submission.
+ */
+struct uringRings
+{
+    unsigned char *map;
+    size_t map_len;
+    struct io_uring_sqe *sqes;
+    size_t sqes_len;
+
+    volatile uint32_t *sq_head;
+    volatile uint32_t *sq_tail;
+    uint32_t *sq_array;
+    uint32_t sq_mask;
+    uint32_t sq_entries;
+    uint32_t sq_tail_local;
+
+    volatile uint32_t *cq_head;
+    volatile uint32_t *cq_tail;
+    struct io_uring_cqe *cqes;
+    uint32_t cq_mask;
+};
+
+/*
+ * a group of provided buffers: they are PacketPool buffers, the one read
+ * is adopted by the Packet and replaced in the ring by a new one. with
+ * the pool exhausted the bid stays out of the ring, in unrecycled, and
+ * it is retried at the next reap.
+ */
+struct uringBufGroup
+{
+    struct io_uring_buf_ring *ring;
+    size_t ring_len;
+    PacketBuffer *bufs;
+    uint16_t *unrecycled;
+    uint16_t unrecycled_num;
+    uint32_t buf_size;
+    uint16_t buf_num;
+    uint16_t bgid;
+};
+
+/* a packet written by the io_uring: it lives until its completion */
+struct uringWrite
+{
+    Packet *pkt;
+    struct iovec iov[2];
+    struct msghdr msg;
+};
+
+class NetIO;
+
+/*
+ * in multiqueue mode every tun queue is read by a worker thread; the
+ * worker reads in a single producer single consumer ring of PacketPool
+ * buffers of the core, and wakes the core by the NetIO eventfd when the
+ * ring was empty. the core gives the buffers read to the Packets without
+ * a copy, like the io_uring, and puts new ones in their slots.
+ * the workers offload only the read syscalls: the conntrack, the plugins
+ * and the writes (all through queue 0) stay single threaded in the core.
+ *
+ * a worker with its ring full sleeps on wakefd, written by the core when
+ * it gives back a slot or stops the worker; a read error stops the
+ * worker and is raised by the core. the indexes and the flags are
+ * accessed with the __atomic builtins.
+ */
+struct tunQueue
+{
+    NetIO *netio;
+    int fd;
+    int wakefd;
+    pthread_t worker;
+
+    PacketBuffer *bufs; /* slot_num buffers of the core */
+    uint32_t slot_len[TUNQUEUE_RING_SLOTS];
+    uint32_t slot_size;
+    uint32_t slot_num;
+
+    uint32_t head; /* packets read, written by the worker */
+    uint32_t reaped; /* packets given to the conntrack, written by the core */
+    uint32_t tail; /* the worker reads up to here, written by the core */
+
+    uint32_t waiting; /* the worker sleeps on wakefd */
+    uint32_t stop;
+    int error; /* the errno that stopped the worker */
+};
 
-    TCPTrack *conntrack;
+/* the PacketIO of the tun and the network interface */
+class NetIO : public PacketIO
+{
+    friend void *tunQueueWorker(void *);
+
+private:
 
     /* tunfd/netfd: file descriptor for I/O purpose */
     int tunfd;
     int netfd;
 
+    /* txfd: the socket keeping the PACKET_TX_RING, -1 when not used */
+    int txfd;
+
     /*
      * these data are required for handle
      * tunnel/ethernet man in the middle
      */
     struct sockaddr_ll send_ll;
 
-    /* poll variables, two file descriptors */
-    struct pollfd fds[2];
+    /* tun_queues[0].fd is tunfd; the others exist only in multiqueue mode */
+    struct tunQueue *tun_queues;
+    uint16_t tun_queues_num;
+    bool tun_workers;
+    int tun_eventfd;
+
+    /* xskfd: the AF_XDP socket, -1 when not used */
+    int xskfd;
+
+    /* uring_fd: the io_uring, -1 when not used */
+    int uring_fd;
+
+    /*
+     * event loop: fds keeps the events wanted for tunfd, netfd, txfd,
+     * tun_eventfd, xskfd and uring_fd, and receives their revents from epfd;
+     * fds_watched are the events registered in epfd, changed only when
+     * fds asks for different ones. timerfd is armed on the deadline
+     * of the conntrack, timer_deadline (0 when disarmed).
+     */
+    struct pollfd fds[NETIO_FDS];
+    short fds_watched[NETIO_FDS];
     int nfds;
+    int epfd;
+    int timerfd;
+    uint64_t timer_deadline;
 
     int size;
 
+    /* input buffer for tunfd and netfd, sized on the biggest read */
+    vector<unsigned char> pktbuf;
+    uint32_t tun_readsize;
+
+    /*
+     * GSO mode: tunfd has IFF_VNET_HDR, every read begins with a
+     * sj_vnet_hdr and every write is preceded by an empty one.
+     */
+    bool tun_gso;
+    struct sj_vnet_hdr tun_vnet_hdr;
+
+    /*
+     * batch mode: netfd is drained with recvmmsg and the packets
+     * directed to the network are flushed with sendmmsg; the vectors
+     * are allocated once, when the MTU of the interface is known.
+     */
+    vector<unsigned char> rx_batchbuf;
+    struct mmsghdr rx_msgs[NETIOBATCHSIZE];
+    struct iovec rx_iovs[NETIOBATCHSIZE];
+
+    Packet *tx_pkts[NETIOBATCHSIZE];
+    struct mmsghdr tx_msgs[NETIOBATCHSIZE];
+    struct iovec tx_iovs[NETIOBATCHSIZE];
+    uint32_t tx_count; /* packets loaded in tx_pkts */
+    uint32_t tx_sent; /* packets of tx_pkts already flushed */
+
+    /*
+     * rx ring mode: netfd has a TPACKET_V3 ring mmap'd; the kernel
+     * fills and retires blocks, we walk the frames in place and give
+     * back the block.
+     */
+    unsigned char *rx_ring;
+    size_t rx_ring_len;
+    uint32_t rx_ring_block;
+    uint32_t rx_ring_drops;
+
+    /*
+     * tx ring mode: the packets of a burst are copied in the TPACKET_V2
+     * frames of txfd and the kernel is kicked with a single sendto.
+     */
+    unsigned char *tx_ring;
+    size_t tx_ring_len;
+    uint32_t tx_ring_head;
+    uint32_t tx_ring_drops;
+
+    /*
+     * xdp mode: an XDP program redirects the IPv4 frames of the gateway
+     * to xskfd, the other traffic continues to reach netfd. the UMEM is
+     * split in the frames owned by the fill ring for the reception and
+     * the frames in xsk_tx_frames, free for the transmission.
+     */
+    int xsk_mapfd;
+    int xsk_progfd;
+    int xsk_linkfd;
+    bool xsk_zerocopy;
+    unsigned char *xsk_umem;
+    size_t xsk_umem_len;
+    struct xskRing xsk_fill;
+    struct xskRing xsk_comp;
+    struct xskRing xsk_rx;
+    struct xskRing xsk_tx;
+    vector<uint64_t> xsk_tx_frames;
+    unsigned char xsk_ethhdr[ETH_HLEN];
+
+    /*
+     * io_uring mode: every tun queue and netfd have a multishot read
+     * posted on a group of provided buffers (a single shot read when
+     * the kernel does not support the multishot one); the packets to
+     * send are written in linked chains, one for each destination,
+     * from the free uring_writes.
+     */
+    struct uringRings uring;
+    struct uringBufGroup uring_tunbufs;
+    struct uringBufGroup uring_netbufs;
+    bool uring_multishot_read;
+    bool uring_multishot_recv;
+    struct uringWrite uring_writes[URING_WRITE_SLOTS];
+    vector<uint32_t> uring_free_writes;
+
     void setupTUN();
     void setupNET();
+    void setupBatch();
+    void setupRxRing();
+    void setupTxRing();
+    void setupTunQueues();
+    void setupEventLoop();
+    void setupUring();
+    void setupUringBufGroup(struct uringBufGroup &, uint16_t, uint32_t, uint16_t);
+    void setupXsk();
+    void loadXskProgram(int);
+    void mapXskRing(struct xskRing &, const struct xdp_ring_offset &, size_t, off_t);
+    void startTunWorkers();
+    void stopTunWorkers();
+
+    void recvNetRing(void);
+    void sendNetRing(void);
+    void recvTunQueues(void);
+    void drainTunQueues(void);
+    void recvNetXsk(void);
+    void sendNetXsk(void);
+    bool readVnetHdr(const unsigned char *, ssize_t, uint16_t &, bool &);
+    void tunToConntrack(unsigned char *, ssize_t);
+    void tunToConntrack(PacketBuffer &, ssize_t);
+    void refillTunQueue(struct tunQueue &);
+    ssize_t writeTun(const Packet &);
+
+    struct io_uring_sqe *getUringSqe(void);
+    void submitUring(void);
+    void postUringRead(uint16_t);
+    void postUringRecv(void);
+    bool refillUringBuf(struct uringBufGroup &, uint16_t);
+    void recycleUringBuf(struct uringBufGroup &, uint16_t);
+    void retryUringBufs(struct uringBufGroup &);
+    void reapUring(void);
+    void submitUringWrites(void);
+
+    int waitEvents(int, uint32_t &);
+    void armTimer(void);
+
+    void loadNetBurst(void);
+    void sendNetBurst(void);
+    void recvNetBurst(void);
 
 public:
 
@@ -63,8 +332,10 @@ public:
 
     NetIO(void);
     ~NetIO(void);
-    void prepareConntrack(TCPTrack *);
-    void networkIO(void);
+    virtual void prepareConntrack(TCPTrack *);
+    virtual void watchEvent(int, uint32_t);
+    virtual uint32_t networkIO(void);
+    virtual void ringStats(struct netio_ring_stats &);
 };
 
 #endif /* SJ_NETIO_H */
@@ -28,6 +28,7 @@
 #endif
 
 #include "Packet.h"
+#include "Checksum.h"
 #include "HDRoptions.h"
 #include "UserConf.h"
 
@@ -48,9 +49,38 @@ choosableScramble(0),
 chainflag(HACKUNASSIGNED),
 fragment(false),
 fragFakeMTU(0),
-pbuf(size)
+gso_size(0),
+needs_csum(false),
+keep_timestamp(0),
+keep_next(NULL),
+payload_sum_valid(false),
+payload_sum(0)
 {
-    memcpy(&(pbuf[0]), buff, size);
+    pbuf.assign(buff, buff + size);
+    updatePacketMetadata(0, 0);
+}
+
+Packet::Packet(PacketBuffer &readbuf, uint16_t offset, uint16_t size) :
+prev(NULL),
+next(NULL),
+queue(QUEUEUNASSIGNED),
+SjPacketId(++SjPacketIdCounter),
+source(SOURCEUNASSIGNED),
+proto(PROTOUNASSIGNED),
+position(POSITIONUNASSIGNED),
+wtf(JUDGEUNASSIGNED),
+choosableScramble(0),
+chainflag(HACKUNASSIGNED),
+fragment(false),
+fragFakeMTU(0),
+gso_size(0),
+needs_csum(false),
+keep_timestamp(0),
+keep_next(NULL),
+payload_sum_valid(false),
+payload_sum(0)
+{
+    pbuf.adopt(readbuf, offset, size);
     updatePacketMetadata(0, 0);
 }
 
@@ -67,8 +97,18 @@ choosableScramble(0),
 chainflag(pkt.chainflag),
 fragment(false),
 fragFakeMTU(0),
-pbuf(pkt.pbuf)
+gso_size(0),
+needs_csum(pkt.needs_csum),
+keep_timestamp(0),
+keep_next(NULL),
+payload_sum_valid(pkt.payload_sum_valid),
+payload_sum(pkt.payload_sum)
 {
+    /*
+     * only the headers are copied: the plugins change them by pointer,
+     * the payload is shared with pkt until it is resized or fetched.
+     */
+    pbuf.share(pkt.pbuf, pkt.iphdrlen + pkt.tcphdrlen);
     updatePacketMetadata(0, 0);
     this->SELFLOG("newly generated packet from: sjI#%d", pkt.SjPacketId);
 }
@@ -86,8 +126,17 @@ choosableScramble(0),
 chainflag(pkt.chainflag),
 fragment(true),
 fragFakeMTU(fakeMTU),
-pbuf(fragdatalen + sizeof(struct iphdr))
+gso_size(0),
+needs_csum(false),
+keep_timestamp(0),
+keep_next(NULL),
+payload_sum_valid(false),
+payload_sum(0)
 {
+    pbuf.resize(fragdatalen + sizeof(struct iphdr));
+
+    pkt.pbuf.fetch();
+
     /* copy of the IP header */
     memcpy(&(pbuf[0]), &(pkt.pbuf[0]), sizeof(struct iphdr));
 
@@ -110,6 +159,21 @@ pbuf(fragdatalen + sizeof(struct iphdr))
                 ipdataoff, fragdatalen, fakeMTU, pkt.SjPacketId);
 }
 
+void *Packet::operator new(size_t size)
+{
+    void * const pkt = PacketPool::objects().get(size);
+
+    if (pkt == NULL)
+        throw std::bad_alloc();
+
+    return pkt;
+}
+
+void Packet::operator delete(void *pkt)
+{
+    PacketPool::objects().put(pkt);
+}
+
 uint32_t Packet::maxMTU(void)
 {
     /* when a fragment is created, also a fake MTU is passed as value */
@@ -252,19 +316,10 @@ void Packet::updatePacketMetadata(uint16_t forceHDRsize, uint16_t forceTOTsize)
     }
 }
 
+/* the sum is done by the fastest kernel of the cpu, see Checksum.h */
 uint32_t Packet::computeHalfSum(const unsigned char* data, uint16_t len)
 {
-    const uint16_t *usdata = (uint16_t *) data;
-    const uint16_t *end = (uint16_t *) data + (len / sizeof (uint16_t));
-    uint32_t sum = 0;
-
-    while (usdata != end)
-        sum += *usdata++;
-
-    if (len % 2)
-        sum += *(uint8_t *) usdata;
-
-    return sum;
+    return sj_csum->halfsum(data, len);
 }
 
 uint16_t Packet::computeSum(uint32_t sum)
@@ -292,9 +347,15 @@ void Packet::fixIPTCPSum(void)
 
     uint32_t sum = computeHalfSum((const unsigned char *) &ip->saddr, 8);
     sum += htons(IPPROTO_TCP + ippayloadlen);
-    sum += computeHalfSum((const unsigned char *) tcp, ippayloadlen);
+    sum += computeHalfSum((const unsigned char *) tcp, tcphdrlen);
+
+    if (!payload_sum_valid)
+    {
+        payload_sum = computeHalfSum(tcppayload, tcppayloadlen);
+        payload_sum_valid = true;
+    }
 
-    tcp->check = computeSum(sum);
+    tcp->check = computeSum(sum + payload_sum);
 }
 
 void Packet::fixIPUDPSum(void)
@@ -305,13 +366,24 @@ void Packet::fixIPUDPSum(void)
 
     uint32_t sum = computeHalfSum((const unsigned char *) &ip->saddr, 8);
     sum += htons(IPPROTO_UDP + ippayloadlen);
-    sum += computeHalfSum((const unsigned char *) udp, ippayloadlen);
+    sum += computeHalfSum((const unsigned char *) udp, udphdrlen);
 
-    udp->check = computeSum(sum);
+    if (!payload_sum_valid)
+    {
+        payload_sum = computeHalfSum(udppayload, udppayloadlen);
+        payload_sum_valid = true;
+    }
+
+    udp->check = computeSum(sum + payload_sum);
 }
 
 void Packet::fixSum(void)
 {
+    /* a shared payload is copied here: the packet is complete before the output */
+    pbuf.fetch();
+
+    needs_csum = false;
+
     if (fragment == false)
     {
         switch (proto)
@@ -332,6 +404,45 @@ void Packet::fixSum(void)
     }
 }
 
+/*
+ * the checksum of a received packet is assumed correct: the sum of its
+ * payload is derived from it, and the header changes applied before
+ * the output (ttl, id, seq, ports, options...) don't need a full pass.
+ * the payload sum is the complement of the sum of the pseudo header and
+ * of the transport header including the checksum (RFC 1624).
+ */
+void Packet::trustSum(void)
+{
+    uint32_t sum;
+
+    payload_sum_valid = false;
+
+    if (fragment == true || needs_csum == true)
+        return;
+
+    switch (proto)
+    {
+    case TCP:
+        sum = computeHalfSum((const unsigned char *) &ip->saddr, 8);
+        sum += htons(IPPROTO_TCP + ippayloadlen);
+        sum += computeHalfSum((const unsigned char *) tcp, tcphdrlen);
+        break;
+    case UDP:
+        /* a zero checksum is not computed by the sender */
+        if (udp->check == 0)
+            return;
+        sum = computeHalfSum((const unsigned char *) &ip->saddr, 8);
+        sum += htons(IPPROTO_UDP + ippayloadlen);
+        sum += computeHalfSum((const unsigned char *) udp, udphdrlen);
+        break;
+    default:
+        return;
+    }
+
+    payload_sum = computeSum(sum);
+    payload_sum_valid = true;
+}
+
 void Packet::corruptSum(void)
 {
     if (fragment == false)
@@ -394,7 +505,7 @@ errorinfo:
 
 void Packet::randomizeID(void)
 {
-    ip->id = htons(ntohs(ip->id) - 10 + (random() % 20));
+    ip->id = htons(ntohs(ip->id) - 10 + (sj_random() % 20));
 }
 
 void Packet::iphdrResize(uint8_t size)
@@ -412,10 +523,13 @@ void Packet::iphdrResize(uint8_t size)
      *   pktlen - iphdrlen + size : must be <= maxMTU().
      */
 
-    /* its important to update values into hdr before vector insert call because it can cause relocation */
+    /*
+     * its important to update values into hdr before the insert call: the
+     * IP header is moved back in the headroom of pbuf, the payload stays.
+     */
     ip->ihl = size / 4;
 
-    vector<unsigned char>::iterator it = pbuf.begin();
+    PacketBuffer::iterator it = pbuf.begin();
 
     if (iphdrlen < size)
     {
@@ -450,10 +564,13 @@ void Packet::tcphdrResize(uint8_t size)
      *   - pktlen - tcphdrlen + size : must be <= maxMTU().
      */
 
-    /* its important to update values into hdr before vector insert call because it can cause relocation */
+    /*
+     * its important to update values into hdr before the insert call: the
+     * IP and TCP headers are moved back in the headroom of pbuf, the payload stays.
+     */
     tcp->doff = size / 4;
 
-    vector<unsigned char>::iterator it = pbuf.begin() + iphdrlen;
+    PacketBuffer::iterator it = pbuf.begin() + iphdrlen;
 
     if (tcphdrlen < size)
     {
@@ -472,8 +589,14 @@ void Packet::tcphdrResize(uint8_t size)
 
 void Packet::ippayloadResize(uint16_t size)
 {
+    /* the caller is going to write the payload: it can't stay shared */
+    payload_sum_valid = false;
+
     if (size == ippayloadlen)
+    {
+        pbuf.unshare();
         return;
+    }
 
     const uint16_t pktlen = pbuf.size();
 
@@ -494,8 +617,14 @@ void Packet::ippayloadResize(uint16_t size)
 
 void Packet::tcppayloadResize(uint16_t size)
 {
+    /* the caller is going to write the payload: it can't stay shared */
+    payload_sum_valid = false;
+
     if (size == tcppayloadlen)
+    {
+        pbuf.unshare();
         return;
+    }
 
     const uint16_t pktlen = pbuf.size();
 
@@ -516,8 +645,14 @@ void Packet::tcppayloadResize(uint16_t size)
 
 void Packet::udppayloadResize(uint16_t size)
 {
+    /* the caller is going to write the payload: it can't stay shared */
+    payload_sum_valid = false;
+
     if (size == udppayloadlen)
+    {
+        pbuf.unshare();
         return;
+    }
 
     const uint16_t pktlen = pbuf.size();
 
@@ -541,16 +676,22 @@ void Packet::udppayloadResize(uint16_t size)
 
 void Packet::ippayloadRandomFill(void)
 {
+    payload_sum_valid = false;
+    pbuf.unshare(false);
     memset_random(ippayload, pbuf.size() - iphdrlen);
 }
 
 void Packet::tcppayloadRandomFill(void)
 {
+    payload_sum_valid = false;
+    pbuf.unshare(false);
     memset_random(tcppayload, pbuf.size() - (iphdrlen + tcphdrlen));
 }
 
 void Packet::udppayloadRandomFill(void)
 {
+    payload_sum_valid = false;
+    pbuf.unshare(false);
     memset_random(udppayload, pbuf.size() - (iphdrlen + udphdrlen));
 }
 
@@ -577,11 +718,8 @@ void Packet::payloadRandomFill(void)
     }
 }
 
-void Packet::selflog(const char *func, const char *format, ...) const
+void Packet::selflogFormat(const char *func, const char *format, ...) const
 {
-    if (debug.level() == SUPPRESS_LEVEL)
-        return;
-
     char loginfo[LARGEBUF] = {0};
     va_list arguments;
     va_start(arguments, format);
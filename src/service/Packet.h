@@ -24,6 +24,8 @@
 #define SJ_PACKET_H
 
 #include "Utils.h"
+#include "PacketPool.h"
+#include "PacketBuffer.h"
 
 #include <arpa/inet.h>
 #include <netinet/in.h>
@@ -118,6 +120,20 @@ public:
     bool fragment;
     uint16_t fragFakeMTU;
 
+    /* tun GSO mode: segment size of a TCP super-packet (0 when it is a
+     * plain packet) and checksum left to be completed before the output */
+    uint16_t gso_size;
+    bool needs_csum;
+
+    /* sj_clock_msec of the insertion in KEEP, the start of the wait */
+    uint64_t keep_timestamp;
+    Packet *keep_next; /* the next packet in the KeepChain of the destination */
+
+    /* the sum of the transport payload, valid until the payload is written:
+     * fixSum() uses it to compute only the headers (RFC 1624) */
+    bool payload_sum_valid;
+    uint32_t payload_sum;
+
     struct iphdr *ip;
     uint8_t iphdrlen; /* [20 - 60] bytes */
     unsigned char *ippayload;
@@ -151,10 +167,17 @@ public:
         uint16_t icmppayloadlen; /* [0 - 65527] bytes */
     };
 
-    vector<unsigned char> pbuf;
+    /* the bytes of the packet, with a headroom for the header options */
+    PacketBuffer pbuf;
+
+    /* the Packet objects live in the slots of PacketPool::objects() */
+    static void *operator new(size_t);
+    static void operator delete(void *);
 
     /* pkt creation from readed buffer */
     Packet(const unsigned char *, uint16_t);
+    /* pkt creation taking the buffer filled by a reader, from an offset */
+    Packet(PacketBuffer &, uint16_t, uint16_t);
     /* pkt creation from exisiting Packet object */
     Packet(const Packet &);
     /* pkt fragment creation from an existing packet */
@@ -174,6 +197,7 @@ public:
     void fixIPTCPSum(void);
     void fixIPUDPSum(void);
     void fixSum(void);
+    void trustSum(void);
     void corruptSum(void);
 
     /* autochecking */
@@ -196,7 +220,12 @@ public:
     bool injectTCPOpts(bool, bool);
 
     /* utilities */
-    void selflog(const char *, const char *, ...) const;
+    __attribute__((always_inline)) void selflog(const char *func, const char *format, ...) const
+    {
+        if (debug.enabled(PACKET_LEVEL))
+            selflogFormat(func, format, __builtin_va_arg_pack());
+    }
+    void selflogFormat(const char *, const char *, ...) const;
     const char *getWtfStr(judge_t) const;
     const char *getSourceStr(source_t) const;
     const char *getChainStr(chaining_t) const;
@@ -0,0 +1,306 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PacketBuffer.h"
+#include "PacketPool.h"
+
+#include <new>
+
+/*
+ * the reference counter of a buffer is kept in front of it, in a word
+ * of 8 bytes to keep the alignment of the pool slot; the packets live
+ * in the conntrack thread only, so the counter is not atomic.
+ */
+#define SLOT_REFS_SIZE  8
+
+static inline uint32_t &slotRefs(unsigned char *slot)
+{
+    return *(uint32_t *) (slot - SLOT_REFS_SIZE);
+}
+
+/* a packet bigger than a pool buffer, or an exhausted pool, is a bad_alloc */
+static unsigned char *allocSlot(uint32_t capacity)
+{
+    unsigned char * const refs = (unsigned char *) PacketPool::buffers().get(capacity + SLOT_REFS_SIZE);
+
+    if (refs == NULL)
+        throw std::bad_alloc();
+
+    unsigned char * const slot = refs + SLOT_REFS_SIZE;
+
+    slotRefs(slot) = 1;
+
+    return slot;
+}
+
+static void releaseSlot(unsigned char *slot)
+{
+    if (slot != NULL && --slotRefs(slot) == 0)
+        PacketPool::buffers().put(slot - SLOT_REFS_SIZE);
+}
+
+PacketBuffer::PacketBuffer(void) :
+slot(NULL),
+capacity(0),
+head(PACKETBUF_HEADROOM),
+len(0),
+shared_slot(NULL),
+shared_off(0),
+shared_at(0)
+{
+}
+
+PacketBuffer::~PacketBuffer(void)
+{
+    releaseSlot(shared_slot);
+    releaseSlot(slot);
+}
+
+/*
+ * the pool buffers are sized on the biggest packet read, with its
+ * headroom and the reference counter in front.
+ */
+void PacketBuffer::setMaxPacket(uint32_t size)
+{
+    PacketPool::setBufferSize(SLOT_REFS_SIZE + PACKETBUF_HEADROOM + size);
+}
+
+/*
+ * moves the packet in a new buffer, with newhead bytes of headroom and
+ * room for size bytes: the whole pool buffer becomes the capacity.
+ */
+void PacketBuffer::relocate(uint32_t newhead, uint32_t size)
+{
+    unsigned char * const newslot = allocSlot(newhead + size);
+    const uint32_t newcapacity = PacketPool::buffers().slotSize() - SLOT_REFS_SIZE;
+
+    /* the shared bytes are not yet in the old buffer */
+    const uint32_t valid = (shared_slot != NULL && shared_at < len) ? shared_at : len;
+
+    if (valid)
+        memcpy(newslot + newhead, slot + head, valid);
+
+    releaseSlot(slot);
+
+    slot = newslot;
+    capacity = newcapacity;
+    head = newhead;
+}
+
+/* a buffer referenced by other packets is copied before a write */
+void PacketBuffer::detach(void)
+{
+    if (slot != NULL && slotRefs(slot) > 1)
+        relocate(head, len);
+}
+
+void PacketBuffer::reserve(uint32_t size)
+{
+    if (slot == NULL || head + size > capacity)
+        relocate(PACKETBUF_HEADROOM, size);
+}
+
+void PacketBuffer::assign(const unsigned char *first, const unsigned char *last)
+{
+    const uint32_t size = last - first;
+
+    /* the old content is dropped, the headroom is restored */
+    releaseSlot(shared_slot);
+    shared_slot = NULL;
+
+    if (slot != NULL && slotRefs(slot) > 1)
+    {
+        releaseSlot(slot);
+        slot = NULL;
+    }
+
+    len = 0;
+    head = PACKETBUF_HEADROOM;
+    if (slot == NULL || head + size > capacity)
+        relocate(PACKETBUF_HEADROOM, size);
+
+    memcpy(slot + head, first, size);
+    len = size;
+}
+
+/*
+ * like vector::resize the new bytes are zeroed; a shrink of a shared
+ * buffer copies only the bytes kept.
+ */
+void PacketBuffer::resize(uint32_t size)
+{
+    if (size < len)
+        len = size;
+
+    unshare();
+
+    if (slot == NULL || head + size > capacity)
+        relocate(head, size);
+
+    if (size > len)
+        memset(slot + head + len, 0x00, size - len);
+
+    len = size;
+}
+
+/*
+ * the smaller side of the buffer is moved: for an option added to the
+ * IP or TCP header the headers go back in the headroom, the payload
+ * stays where it is.
+ */
+void PacketBuffer::insert(iterator pos, uint32_t n, unsigned char val)
+{
+    const uint32_t offset = pos - begin();
+
+    unshare();
+
+    const bool front = (head >= n && offset <= len - offset);
+
+    if (!front && head + len + n > capacity)
+        relocate(head, len + n);
+
+    if (front)
+    {
+        memmove(slot + head - n, slot + head, offset);
+        head -= n;
+    }
+    else
+    {
+        memmove(slot + head + offset + n, slot + head + offset, len - offset);
+    }
+
+    memset(slot + head + offset, val, n);
+    len += n;
+}
+
+void PacketBuffer::erase(iterator first, iterator last)
+{
+    const uint32_t offset = first - begin();
+    const uint32_t n = last - first;
+
+    unshare();
+
+    if (offset <= len - offset - n)
+    {
+        memmove(slot + head + n, slot + head, offset);
+        head += n;
+    }
+    else
+    {
+        memmove(slot + head + offset, slot + head + offset + n, len - offset - n);
+    }
+
+    len -= n;
+}
+
+/*
+ * the pool buffer of src, where a reader wrote size bytes from offset,
+ * becomes the buffer of the packet; src is left empty.
+ */
+void PacketBuffer::adopt(PacketBuffer &src, uint32_t offset, uint32_t size)
+{
+    releaseSlot(shared_slot);
+    shared_slot = NULL;
+    releaseSlot(slot);
+
+    slot = src.slot;
+    capacity = src.capacity;
+    head = src.head + offset;
+    len = size;
+
+    src.slot = NULL;
+    src.capacity = 0;
+    src.head = PACKETBUF_HEADROOM;
+    src.len = 0;
+}
+
+/*
+ * the buffer becomes a copy of src: the first keep bytes are copied,
+ * the others are referenced in the buffer of src. when src is itself
+ * a copy not yet fetched, the reference goes to the same buffer.
+ */
+void PacketBuffer::share(const PacketBuffer &src, uint32_t keep)
+{
+    unsigned char *from;
+    uint32_t from_off;
+
+    if (src.shared_slot != NULL)
+    {
+        keep = src.shared_at;
+        from = src.shared_slot;
+        from_off = src.shared_off;
+    }
+    else
+    {
+        if (keep > src.len)
+            keep = src.len;
+        from = src.slot;
+        from_off = src.head + keep;
+    }
+
+    assign(src.begin(), src.begin() + keep);
+
+    if (head + src.len > capacity)
+        relocate(head, src.len);
+
+    len = src.len;
+
+    if (len > keep)
+    {
+        shared_slot = from;
+        ++slotRefs(shared_slot);
+        shared_off = from_off;
+        shared_at = keep;
+    }
+}
+
+/* the shared bytes are copied: the content of the buffer does not change */
+void PacketBuffer::fetch(void) const
+{
+    if (shared_slot == NULL)
+        return;
+
+    if (len > shared_at)
+        memcpy(slot + head + shared_at, shared_slot + shared_off, len - shared_at);
+
+    releaseSlot(shared_slot);
+    shared_slot = NULL;
+}
+
+/*
+ * after unshare() every byte of the buffer can be written; keep is false
+ * when the caller is going to overwrite all the shared bytes.
+ */
+void PacketBuffer::unshare(bool keep)
+{
+    if (keep)
+    {
+        fetch();
+    }
+    else
+    {
+        releaseSlot(shared_slot);
+        shared_slot = NULL;
+    }
+
+    detach();
+}
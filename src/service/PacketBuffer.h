@@ -0,0 +1,132 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SJ_PACKETBUFFER_H
+#define SJ_PACKETBUFFER_H
+
+#include "Utils.h"
+
+/*
+ * PacketBuffer is the storage of Packet::pbuf, with the subset of the
+ * vector interface used by sniffjoke. the bytes of the packet begin
+ * after PACKETBUF_HEADROOM free bytes of a PacketPool buffer: when the
+ * IP or TCP header grows or shrinks, insert() and erase() move the
+ * bytes in front of the change (the headers) inside the headroom
+ * instead of the payload behind it.
+ *
+ * the pool buffers are reference counted: share() makes a copy of the
+ * first bytes of an other buffer (the headers) and keeps a reference
+ * to the rest (the payload), copied only when it is needed. the bytes
+ * after the shared_at index are not readable until fetch() is called,
+ * and the buffers referenced by others are never written: the methods
+ * changing the size of the buffer call unshare() when required, the
+ * writes done by pointer must be preceded by unshare().
+ *
+ * a reader (the io_uring) can fill an empty PacketBuffer after reserve(),
+ * writing from begin(): adopt() moves its pool buffer in the buffer of a
+ * Packet, and the reader reserves a new one.
+ *
+ * when the pool can't give a buffer, std::bad_alloc is thrown.
+ */
+class PacketBuffer
+{
+private:
+
+    unsigned char *slot;
+    uint32_t capacity;
+    uint32_t head;
+    uint32_t len;
+
+    /* the bytes [shared_at, len) are at shared_slot + shared_off */
+    mutable unsigned char *shared_slot;
+    uint32_t shared_off;
+    uint32_t shared_at;
+
+    /* a buffer is owned by a single Packet */
+    PacketBuffer(const PacketBuffer &);
+    PacketBuffer &operator=(const PacketBuffer &);
+
+    void relocate(uint32_t, uint32_t);
+    void detach(void);
+
+public:
+
+    typedef unsigned char *iterator;
+    typedef const unsigned char *const_iterator;
+
+    PacketBuffer(void);
+    ~PacketBuffer(void);
+
+    uint32_t size(void) const
+    {
+        return len;
+    }
+
+    unsigned char &operator[](uint32_t i)
+    {
+        return slot[head + i];
+    }
+
+    const unsigned char &operator[](uint32_t i) const
+    {
+        return slot[head + i];
+    }
+
+    iterator begin(void)
+    {
+        return slot + head;
+    }
+
+    iterator end(void)
+    {
+        return slot + head + len;
+    }
+
+    const_iterator begin(void) const
+    {
+        return slot + head;
+    }
+
+    const_iterator end(void) const
+    {
+        return slot + head + len;
+    }
+
+    void reserve(uint32_t);
+    void assign(const unsigned char *, const unsigned char *);
+    void resize(uint32_t);
+    void insert(iterator, uint32_t, unsigned char);
+    void erase(iterator, iterator);
+
+    /* the biggest packet read, set before the first buffer is used */
+    static void setMaxPacket(uint32_t);
+
+    /* the buffer filled by a reader is taken without a copy */
+    void adopt(PacketBuffer &, uint32_t, uint32_t);
+
+    /* copy-on-write */
+    void share(const PacketBuffer &, uint32_t);
+    void fetch(void) const;
+    void unshare(bool keep = true);
+};
+
+#endif /* SJ_PACKETBUFFER_H */
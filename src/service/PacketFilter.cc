@@ -38,92 +38,186 @@ ip_daddr(pkt.ip->daddr)
 {
 }
 
-bool FilterEntry::operator<(FilterEntry comp) const
+/* the fields mixed by the murmur3 finalizer */
+uint32_t FilterEntry::hash(void) const
 {
-    if (ip_id < comp.ip_id)
-        return true;
-    else if (ip_id > comp.ip_id)
-        return false;
-    else
-    {
-        if (ip_totallen < comp.ip_totallen)
-            return true;
-        else if (ip_totallen > comp.ip_totallen)
-            return false;
-        else
-        {
-            if (ip_saddr < comp.ip_saddr)
-                return true;
-            else if (ip_saddr > comp.ip_saddr)
-                return false;
-            else
-            {
-                if (ip_daddr < comp.ip_daddr)
-                    return true;
-                else
-                    return false;
-            }
-        }
-    }
+    uint32_t h = ip_saddr ^ (ip_daddr * 0xCC9E2D51) ^ ((((uint32_t) ip_id << 16) | ip_totallen) * 0x1B873593);
+
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+
+    return h;
 }
 
-FilterMultiset::FilterMultiset(void) :
+FilterHash::FilterHash(void) :
 timeout_len(PLUGINHASH_EXPIRYTIME),
 manage_timeout(sj_clock + timeout_len),
 first(&fm[0]),
 second(&fm[1])
 {
+    for (uint8_t i = 0; i < 2; ++i)
+    {
+        fm[i].slots = new filterSlot[FILTERHASH_SLOTS];
+        memset(fm[i].slots, 0, sizeof (filterSlot) * FILTERHASH_SLOTS);
+        fm[i].size = 0;
+    }
+}
+
+FilterHash::~FilterHash(void)
+{
+    delete[] fm[0].slots;
+    delete[] fm[1].slots;
+}
+
+/* returns the slot of the filter, FILTERHASH_SLOTS if not present */
+uint32_t FilterHash::find(const filterGeneration &generation, const FilterEntry &hash)
+{
+    uint32_t index = hash.hash() & (FILTERHASH_SLOTS - 1);
+    uint16_t distance = 0;
+
+    while (generation.slots[index].count && generation.slots[index].probe_distance >= distance)
+    {
+        const filterSlot &slot = generation.slots[index];
+
+        if (slot.ip_id == hash.ip_id && slot.ip_totallen == hash.ip_totallen &&
+                slot.ip_saddr == hash.ip_saddr && slot.ip_daddr == hash.ip_daddr)
+            return index;
+
+        index = (index + 1) & (FILTERHASH_SLOTS - 1);
+        ++distance;
+    }
+
+    return FILTERHASH_SLOTS;
+}
+
+/*
+ * robin hood insertion of a filter not present: on its way the filter takes
+ * the slot of the first one nearer to its own slot, that continues in its place.
+ */
+void FilterHash::place(filterGeneration &generation, const FilterEntry &hash)
+{
+    filterSlot moving;
+    moving.ip_saddr = hash.ip_saddr;
+    moving.ip_daddr = hash.ip_daddr;
+    moving.ip_id = hash.ip_id;
+    moving.ip_totallen = hash.ip_totallen;
+    moving.count = 1;
+    moving.probe_distance = 0;
+
+    uint32_t index = hash.hash() & (FILTERHASH_SLOTS - 1);
+
+    while (generation.slots[index].count)
+    {
+        if (generation.slots[index].probe_distance < moving.probe_distance)
+            swap(moving, generation.slots[index]);
+
+        index = (index + 1) & (FILTERHASH_SLOTS - 1);
+        ++moving.probe_distance;
+    }
+
+    generation.slots[index] = moving;
+    ++generation.size;
+}
+
+/* the filters following the erased one are moved back of a slot, until one is in its own */
+void FilterHash::erase(filterGeneration &generation, uint32_t index)
+{
+    uint32_t next = (index + 1) & (FILTERHASH_SLOTS - 1);
+
+    while (generation.slots[next].count && generation.slots[next].probe_distance)
+    {
+        generation.slots[index] = generation.slots[next];
+        --generation.slots[index].probe_distance;
+
+        index = next;
+        next = (next + 1) & (FILTERHASH_SLOTS - 1);
+    }
+
+    memset(&generation.slots[index], 0, sizeof (filterSlot));
+    --generation.size;
+}
+
+/* a filter found is counted down, and removed with the last count */
+bool FilterHash::release(filterGeneration &generation, const FilterEntry &hash)
+{
+    const uint32_t index = find(generation, hash);
+
+    if (index == FILTERHASH_SLOTS)
+        return false;
+
+    if (!--generation.slots[index].count)
+        erase(generation, index);
+
+    return true;
 }
 
-FilterMultiset::~FilterMultiset(void)
+/* the older generation is dropped and its table becomes the newer */
+void FilterHash::rotate(void)
 {
-    first->clear();
-    second->clear();
+    filterGeneration *tmp = first;
+    first = second;
+    second = tmp;
+
+    if (second->size)
+    {
+        memset(second->slots, 0, sizeof (filterSlot) * FILTERHASH_SLOTS);
+        second->size = 0;
+    }
+
+    manage_timeout = sj_clock + timeout_len;
 }
 
 /*
  * tests the existance of the entry;
  * returns:
- *      - true:  if found, and automatically does remove the entry;
- *               due to the multiset entry can be duplicated, this is
- *               a feature much important that permit a fine count
- *               during packet filtering.
+ *      - true:  if found, and automatically does remove one count of
+ *               the entry; due to the entry can be added more times,
+ *               this is a feature much important that permit a fine
+ *               count during packet filtering.
  * 
  *      - false: if not found.
  */
-bool FilterMultiset::check(const FilterEntry &hash)
+bool FilterHash::check(const FilterEntry &hash)
 {
     manage();
 
-    if (first->erase(hash) || second->erase(hash))
-        return true;
-
-    return false;
+    return release(*first, hash) || release(*second, hash);
 }
 
 /*
- * inserts a new entry; due to the use of multiset entry can be
- * duplicate; this is particular important to permit multiple
+ * inserts a new entry, or counts once more an entry already present;
+ * this is particular important to permit multiple
  * packet to define multiple filters.
  * so repeated filters works as a fine counter during packet filtering.
  *
  */
-void FilterMultiset::add(const FilterEntry &hash)
+void FilterHash::add(const FilterEntry &hash)
 {
-    second->insert(hash);
+    const uint32_t index = find(*second, hash);
+
+    if (index != FILTERHASH_SLOTS)
+    {
+        if (second->slots[index].count != 0xFFFF)
+            ++second->slots[index].count;
+        return;
+    }
+
+    /* a generation is kept at most 7/8 full: the older is dropped before */
+    if ((second->size + 1) * 8 > FILTERHASH_SLOTS * 7)
+        rotate();
+
+    place(*second, hash);
 }
 
-void FilterMultiset::manage(void)
+void FilterHash::manage(void)
 {
     if (manage_timeout > sj_clock - timeout_len)
         return;
 
-    multiset<FilterEntry> *tmp = first;
-    first = second;
-    second = tmp;
-    second->clear();
-
-    manage_timeout = sj_clock + timeout_len;
+    rotate();
 }
 
 bool PacketFilter::filterICMPErrors(const Packet &pkt)
@@ -132,7 +226,7 @@ bool PacketFilter::filterICMPErrors(const Packet &pkt)
     {
         const struct iphdr *ip = (struct iphdr*) pkt.icmppayload;
         FilterEntry filter(ip->id, ip->tot_len, ip->saddr, ip->daddr);
-        return filter_multiset.check(filter);
+        return filter_hash.check(filter);
     }
 
     return false;
@@ -141,7 +235,7 @@ bool PacketFilter::filterICMPErrors(const Packet &pkt)
 void PacketFilter::add(const Packet& pkt)
 {
     FilterEntry hash(pkt);
-    filter_multiset.add(hash);
+    filter_hash.add(hash);
 }
 
 bool PacketFilter::match(const Packet& pkt)
@@ -33,24 +33,55 @@ public:
 
     FilterEntry(uint16_t, uint16_t, uint32_t, uint32_t);
     FilterEntry(const Packet &);
-    bool operator<(FilterEntry) const;
+    uint32_t hash(void) const;
 };
 
-class FilterMultiset
+/*
+ * FilterHash keeps the filters in two generations, the older is dropped
+ * every PLUGINHASH_EXPIRYTIME seconds or when the newer is full: a
+ * generation is an open addressing table with robin hood probing of
+ * FILTERHASH_SLOTS slots allocated once, the same filter added more times
+ * is counted in its slot, so the memory is bounded whatever the number of
+ * the packets injected.
+ */
+class FilterHash
 {
 private:
+
+    struct filterSlot
+    {
+        uint32_t ip_saddr;
+        uint32_t ip_daddr;
+        uint16_t ip_id;
+        uint16_t ip_totallen;
+        uint16_t count; /* 0 marks an empty slot */
+        uint16_t probe_distance; /* distance from the slot of its hash */
+    };
+
+    struct filterGeneration
+    {
+        filterSlot *slots;
+        uint32_t size;
+    };
+
     const uint32_t timeout_len;
     uint32_t manage_timeout;
-    multiset<FilterEntry> fm[2];
-    multiset<FilterEntry> *first;
-    multiset<FilterEntry> *second;
+    filterGeneration fm[2];
+    filterGeneration *first;
+    filterGeneration *second;
+
+    static uint32_t find(const filterGeneration &, const FilterEntry &);
+    static void place(filterGeneration &, const FilterEntry &);
+    static void erase(filterGeneration &, uint32_t);
+    static bool release(filterGeneration &, const FilterEntry &);
+    void rotate(void);
 
     /* called automagically */
     void manage(void);
 
 public:
-    FilterMultiset(void);
-    ~FilterMultiset(void);
+    FilterHash(void);
+    ~FilterHash(void);
     bool check(const FilterEntry &);
     void add(const FilterEntry &);
 };
@@ -58,7 +89,7 @@ public:
 class PacketFilter
 {
 private:
-    FilterMultiset filter_multiset;
+    FilterHash filter_hash;
 
     bool filterICMPErrors(const Packet &pkt);
 
@@ -0,0 +1,77 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SJ_PACKETIO_H
+#define SJ_PACKETIO_H
+
+#include "Utils.h"
+#include "TCPTrack.h"
+
+/* occupancy and drop counters of the mmap rings, exposed by the admin socket */
+struct netio_ring_stats
+{
+    bool rx_ring;
+    uint32_t rx_blocks_used;
+    uint32_t rx_blocks;
+    uint32_t rx_drops;
+    bool tx_ring;
+    uint32_t tx_frames_used;
+    uint32_t tx_frames;
+    uint32_t tx_drops;
+};
+
+/* the events returned by networkIO for the descriptors watched on behalf of the caller */
+#define NETIO_EVENT_SIGNAL      1
+#define NETIO_EVENT_ADMIN       2
+/* the source of the packets is exhausted and the conntrack has nothing more to do */
+#define NETIO_EVENT_END         4
+
+/*
+ * PacketIO is the generic source and sink of the packets handled by the
+ * conntrack: NetIO moves them between the tun and the network interface,
+ * PcapIO replays them from capture files. every networkIO call gives the
+ * input to the conntrack, runs analyzePacketQueue and flushes the SEND queue.
+ */
+class PacketIO
+{
+protected:
+
+    TCPTrack *conntrack;
+
+public:
+
+    PacketIO(void) : conntrack(NULL) {}
+    virtual ~PacketIO(void) {}
+
+    /* called in the service process, when the conntrack exists */
+    virtual void prepareConntrack(TCPTrack *) = 0;
+    virtual void watchEvent(int, uint32_t) = 0;
+    virtual uint32_t networkIO(void) = 0;
+
+    /* only NetIO has mmap rings */
+    virtual void ringStats(struct netio_ring_stats &stats)
+    {
+        memset(&stats, 0x00, sizeof (stats));
+    }
+};
+
+#endif /* SJ_PACKETIO_H */
@@ -0,0 +1,127 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PacketPool.h"
+#include "Packet.h"
+
+#include <sys/mman.h>
+
+/* the pools are never destroyed: they live as long as their thread */
+static __thread PacketPool *thread_objects = NULL;
+static __thread PacketPool *thread_buffers = NULL;
+
+uint32_t PacketPool::buffer_size = 0;
+
+PacketPool::PacketPool(size_t size, uint32_t num) :
+slot_size((size + PACKETPOOL_ALIGN - 1) & ~((size_t) PACKETPOOL_ALIGN - 1)),
+slot_num(num),
+slab(NULL),
+carved(0),
+free_list(NULL),
+in_use(0),
+refused(0)
+{
+    slab = (unsigned char *) mmap(NULL, slot_size * slot_num, PROT_READ | PROT_WRITE,
+                                  MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (slab == MAP_FAILED)
+        RUNTIME_EXCEPTION("unable to reserve a packet pool of %u slots of %u bytes: %s", slot_num, slot_size, strerror(errno));
+
+    LOG_DEBUG("packet pool of %u slots of %u bytes reserved", slot_num, slot_size);
+}
+
+PacketPool::~PacketPool(void)
+{
+    munmap(slab, slot_size * slot_num);
+}
+
+void *PacketPool::get(size_t size)
+{
+    void *slot;
+
+    if (size > slot_size)
+    {
+        if (!refused++)
+            LOG_ALL("packet pool of %u slots of %u bytes: refused a request of %u bytes", slot_num, (uint32_t) slot_size, (uint32_t) size);
+
+        return NULL;
+    }
+
+    if (free_list != NULL)
+    {
+        slot = free_list;
+        free_list = free_list->next;
+    }
+    else if (carved < slot_num)
+    {
+        slot = slab + (size_t) carved * slot_size;
+        ++carved;
+    }
+    else
+    {
+        if (!refused++)
+            LOG_ALL("packet pool of %u slots of %u bytes exhausted", slot_num, (uint32_t) slot_size);
+
+        return NULL;
+    }
+
+    ++in_use;
+
+    return slot;
+}
+
+void PacketPool::put(void *slot)
+{
+    if (slot == NULL)
+        return;
+
+    freeSlot * const freed = (freeSlot *) slot;
+    freed->next = free_list;
+    free_list = freed;
+
+    --in_use;
+}
+
+void PacketPool::setBufferSize(uint32_t size)
+{
+    buffer_size = size;
+}
+
+PacketPool &PacketPool::objects(void)
+{
+    if (thread_objects == NULL)
+        thread_objects = new PacketPool(sizeof (Packet), PACKETPOOL_SLOTS);
+
+    return *thread_objects;
+}
+
+PacketPool &PacketPool::buffers(void)
+{
+    if (thread_buffers == NULL)
+    {
+        if (!buffer_size)
+            RUNTIME_EXCEPTION("FATAL CODE [PKTP00LSIZE]: please send a notification to the developers");
+
+        thread_buffers = new PacketPool(buffer_size, PACKETPOOL_SLOTS);
+    }
+
+    return *thread_buffers;
+}
@@ -0,0 +1,98 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SJ_PACKETPOOL_H
+#define SJ_PACKETPOOL_H
+
+#include "Utils.h"
+
+#include <cstddef>
+#include <new>
+
+/*
+ * PacketPool is a slab of fixed size, cache aligned slots recycled by a
+ * free list. the whole slab is reserved once with MAP_NORESERVE and its
+ * pages are used only when a slot is carved for the first time, so the
+ * peak memory is bounded by the pool size and the packets never reach
+ * malloc. a request bigger than a slot, or arriving when every slot is
+ * in use, is refused and counted: the buffers are sized on the biggest
+ * packet read (the mtu, or the GSO super-packet) plus the headroom, and
+ * TCPTrack drops the packets read when the pool is near to exhaustion.
+ *
+ * every thread has its own pools (sniffjoke moves the packets in the
+ * conntrack thread only): a slot must be released by the thread that
+ * got it.
+ */
+class PacketPool
+{
+private:
+
+    struct freeSlot
+    {
+        freeSlot *next;
+    };
+
+    const size_t slot_size;
+    const uint32_t slot_num;
+
+    unsigned char *slab;
+    uint32_t carved;
+    freeSlot *free_list;
+
+    static uint32_t buffer_size;
+
+public:
+
+    uint32_t in_use;
+    uint32_t refused;
+
+    PacketPool(size_t, uint32_t);
+    ~PacketPool(void);
+
+    /* NULL when the request can't be served */
+    void *get(size_t);
+    void put(void *);
+
+    size_t slotSize(void) const
+    {
+        return slot_size;
+    }
+
+    uint32_t size(void) const
+    {
+        return slot_num;
+    }
+
+    uint32_t available(void) const
+    {
+        return slot_num - in_use;
+    }
+
+    /* the size of the buffers, set before the first buffer is used */
+    static void setBufferSize(uint32_t);
+
+    /* the pools of the calling thread, created on first use */
+    static PacketPool &objects(void);
+    static PacketPool &buffers(void);
+};
+
+#endif /* SJ_PACKETPOOL_H */
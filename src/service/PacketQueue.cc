@@ -30,19 +30,18 @@ next_pkt(NULL)
 {
     LOG_DEBUG("");
 
-    memset(front, 0, sizeof (Packet*)*(QUEUE_NUM));
-    memset(back, 0, sizeof (Packet*)*(QUEUE_NUM));
+    memset(front, 0, sizeof (Packet*)*(LIST_NUM));
+    memset(back, 0, sizeof (Packet*)*(LIST_NUM));
 }
 
 PacketQueue::~PacketQueue(void)
 {
     LOG_DEBUG("");
 
-    for (uint8_t i = FIRST_QUEUE; i <= LAST_QUEUE; ++i)
+    for (uint8_t i = 0; i < LIST_NUM; ++i)
     {
-        select((queue_t) i);
-        while (get() && cur_pkt != NULL)
-            delete cur_pkt;
+        while (front[i] != NULL)
+            drop(*front[i]);
     }
 }
 
@@ -57,19 +56,21 @@ void PacketQueue::insert(Packet &pkt, queue_t queue)
             pkt.next == NULL;
      */
 
+    const uint8_t l = list(queue, pkt.source);
+
     ++pkt_count;
     pkt.queue = queue;
-    if (front[queue] == NULL)
+    if (front[l] == NULL)
     {
-        front[queue] = &pkt;
-        back[queue] = &pkt;
+        front[l] = &pkt;
+        back[l] = &pkt;
     }
     else
     {
-        pkt.prev = back[queue];
+        pkt.prev = back[l];
         pkt.next = NULL;
-        back[queue]->next = &pkt;
-        back[queue] = &pkt;
+        back[l]->next = &pkt;
+        back[l] = &pkt;
     }
 }
 
@@ -84,15 +85,24 @@ void PacketQueue::insertBefore(Packet &pkt, Packet &ref)
             pkt.next == NULL;
      */
 
+    const uint8_t l = list(ref.queue, ref.source);
+
+    /* the order matters only between the packets of the same destination */
+    if (l != list(ref.queue, pkt.source))
+    {
+        insert(pkt, ref.queue);
+        return;
+    }
+
     ++pkt_count;
     pkt.queue = ref.queue;
 
-    if (front[ref.queue] == &ref)
+    if (front[l] == &ref)
     {
         pkt.prev = NULL;
         pkt.next = &ref;
         ref.prev = &pkt;
-        front[ref.queue] = &pkt;
+        front[l] = &pkt;
         return;
     }
 
@@ -117,14 +127,22 @@ void PacketQueue::insertAfter(Packet &pkt, Packet &ref)
             pkt.next == NULL;
      */
 
+    const uint8_t l = list(ref.queue, ref.source);
+
+    if (l != list(ref.queue, pkt.source))
+    {
+        insert(pkt, ref.queue);
+        return;
+    }
+
     ++pkt_count;
     pkt.queue = ref.queue;
 
-    if (back[ref.queue] == &ref)
+    if (back[l] == &ref)
     {
         pkt.prev = &ref;
         ref.next = &pkt;
-        back[ref.queue] = &pkt;
+        back[l] = &pkt;
         return;
     }
 
@@ -141,14 +159,14 @@ void PacketQueue::insertAfter(Packet &pkt, Packet &ref)
 void PacketQueue::extract(Packet &pkt)
 {
     --pkt_count;
-    queue_t queue = pkt.queue;
+    const uint8_t l = list(pkt.queue, pkt.source);
 
-    if (front[queue] == &pkt)
+    if (front[l] == &pkt)
     {
-        if (back[queue] == &pkt)
+        if (back[l] == &pkt)
         {
-            front[queue] = NULL;
-            back[queue] = NULL;
+            front[l] = NULL;
+            back[l] = NULL;
         }
         else
         {
@@ -156,19 +174,19 @@ void PacketQueue::extract(Packet &pkt)
              * in this case we have always a next;
              * so we can dereference it without checking != NULL
              */
-            front[queue] = front[queue]->next;
-            front[queue]->prev = NULL;
+            front[l] = front[l]->next;
+            front[l]->prev = NULL;
         }
         goto remove_reset_pkt;
     }
-    else if (back[queue] == &pkt)
+    else if (back[l] == &pkt)
     {
         /*
          * in this case we have always a prev;
          * so we can dereference it without checking != NULL
          */
-        back[queue] = back[queue]->prev;
-        back[queue]->next = NULL;
+        back[l] = back[l]->prev;
+        back[l]->next = NULL;
         goto remove_reset_pkt;
     }
 
@@ -194,6 +212,7 @@ void PacketQueue::drop(Packet &pkt)
     delete &pkt;
 }
 
+/* select(SEND) walks only the packets for the network, popSend() reads both */
 void PacketQueue::select(queue_t queue)
 {
     cur_queue = queue;
@@ -224,3 +243,18 @@ Packet* PacketQueue::getSource(source_t requestSrc)
     }
     return NULL; /* NOT FOUND */
 }
+
+/*
+ * extracts the first packet of SEND given a source as readpacket does:
+ * NETWORK returns the packets for the tunnel, every other source the
+ * packets for the network.
+ */
+Packet* PacketQueue::popSend(source_t source)
+{
+    Packet * const pkt = front[list(SEND, source)];
+
+    if (pkt != NULL)
+        extract(*pkt);
+
+    return pkt;
+}
@@ -30,16 +30,31 @@
 #define LAST_QUEUE  (SEND)
 #define QUEUE_NUM   (LAST_QUEUE + 1)
 
+/*
+ * the SEND queue is kept in two lists, one for every destination: a packet
+ * for the tunnel never waits behind the ones for the network, and the
+ * next packet for a destination is always the front of its list.
+ */
+#define SEND_NETWORK_LIST   (SEND)
+#define SEND_TUNNEL_LIST    (QUEUE_NUM)
+#define LIST_NUM            (QUEUE_NUM + 1)
+
 class PacketQueue
 {
 private:
     uint32_t pkt_count;
-    Packet *front[QUEUE_NUM];
-    Packet *back[QUEUE_NUM];
+    Packet *front[LIST_NUM];
+    Packet *back[LIST_NUM];
     queue_t cur_queue;
     Packet *cur_pkt;
     Packet *next_pkt;
 
+    /* the packets from the network are sent to the tunnel, all the others to the network */
+    static uint8_t list(queue_t queue, source_t source)
+    {
+        return (queue == SEND && source == NETWORK) ? SEND_TUNNEL_LIST : queue;
+    }
+
 public:
     PacketQueue(void);
     ~PacketQueue(void);
@@ -51,6 +66,7 @@ public:
     void select(queue_t);
     Packet* get(void);
     Packet* getSource(source_t);
+    Packet* popSend(source_t);
 
     uint32_t size(void)
     {
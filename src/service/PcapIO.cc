@@ -0,0 +1,369 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "PcapIO.h"
+#include "UserConf.h"
+
+#include <byteswap.h>
+#include <net/ethernet.h>
+
+extern auto_ptr<UserConf> userconf;
+
+static uint64_t monotonicUsec(void)
+{
+    struct timespec now;
+    clock_gettime(CLOCK_MONOTONIC, &now);
+
+    return (uint64_t) now.tv_sec * 1000000 + now.tv_nsec / 1000;
+}
+
+PcapIO::PcapIO(void) :
+output(NULL),
+replay_usec(0),
+written_tunnel(0),
+written_network(0),
+start_usec(0),
+cycles(0),
+cycle_usec_total(0),
+cycle_usec_max(0)
+{
+    LOG_DEBUG("");
+
+    const struct sj_cmdline_opts &opts = userconf->cmdline_opts;
+
+    if (opts.replay_output[0] && (!strcmp(opts.replay_output, opts.replay_tunnel) || !strcmp(opts.replay_output, opts.replay_network)))
+        RUNTIME_EXCEPTION("the output capture %s would overwrite a replayed one", opts.replay_output);
+
+    openCapture(tunnel, opts.replay_tunnel, TUNNEL);
+    openCapture(network, opts.replay_network, NETWORK);
+    openOutput(opts.replay_output);
+
+    /* there is no interface: the conntrack and the plugins see a common ethernet */
+    snprintf(userconf->runcfg.net_iface_name, sizeof (userconf->runcfg.net_iface_name), "replay");
+    userconf->runcfg.net_iface_mtu = REPLAY_MTU;
+    userconf->runcfg.tun_iface_mtu = REPLAY_MTU - TUN_IF_MTU_DIFF;
+
+    /* a bigger record is dropped by the conntrack, as a packet over the mtu */
+    PacketBuffer::setMaxPacket(REPLAY_MTU);
+}
+
+PcapIO::~PcapIO(void)
+{
+    LOG_DEBUG("");
+
+    if (tunnel.file != NULL)
+        fclose(tunnel.file);
+    if (network.file != NULL)
+        fclose(network.file);
+    if (output != NULL)
+        fclose(output);
+}
+
+/* an empty path is an empty capture */
+void PcapIO::openCapture(struct pcapReader &reader, const char *path, source_t source)
+{
+    struct sj_pcap_filehdr hdr;
+
+    reader.file = NULL;
+    reader.source = source;
+    reader.swapped = false;
+    reader.nsec = false;
+    reader.linktype = 0;
+    reader.pending = false;
+    reader.ts_usec = 0;
+    reader.offset = 0;
+    reader.len = 0;
+    reader.packets = 0;
+    reader.skipped = 0;
+
+    if (!path[0])
+        return;
+
+    if ((reader.file = fopen(path, "r")) == NULL)
+        RUNTIME_EXCEPTION("unable to open the capture %s: %s", path, strerror(errno));
+
+    if (fread(&hdr, sizeof (hdr), 1, reader.file) != 1)
+        RUNTIME_EXCEPTION("unable to read the header of the capture %s", path);
+
+    switch (hdr.magic)
+    {
+    case SJ_PCAP_MAGIC:
+        break;
+    case SJ_PCAP_MAGIC_NSEC:
+        reader.nsec = true;
+        break;
+    case SJ_PCAP_MAGIC_SWAPPED:
+        reader.swapped = true;
+        break;
+    case SJ_PCAP_MAGIC_NSEC_SWAPPED:
+        reader.swapped = true;
+        reader.nsec = true;
+        break;
+    default:
+        RUNTIME_EXCEPTION("%s is not a pcap capture (magic 0x%08x), pcapng is not supported", path, hdr.magic);
+    }
+
+    reader.linktype = reader.swapped ? bswap_32(hdr.linktype) : hdr.linktype;
+
+    if (reader.linktype != SJ_PCAP_LINKTYPE_ETHERNET && reader.linktype != SJ_PCAP_LINKTYPE_RAW &&
+            reader.linktype != SJ_PCAP_LINKTYPE_LINUX_SLL && reader.linktype != SJ_PCAP_LINKTYPE_IPV4)
+    {
+        RUNTIME_EXCEPTION("the capture %s has the unsupported link type %u", path, reader.linktype);
+    }
+
+    reader.buf.resize(REPLAY_SNAPLEN);
+
+    LOG_VERBOSE("replaying %s as %s traffic (link type %u)", path, source == TUNNEL ? "tunnel" : "network", reader.linktype);
+
+    loadRecord(reader);
+}
+
+void PcapIO::openOutput(const char *path)
+{
+    struct sj_pcap_filehdr hdr;
+
+    if (!path[0])
+    {
+        LOG_VERBOSE("replay without output capture: the packets sent are only counted");
+        return;
+    }
+
+    if ((output = fopen(path, "w")) == NULL)
+        RUNTIME_EXCEPTION("unable to open the output capture %s: %s", path, strerror(errno));
+
+    memset(&hdr, 0x00, sizeof (hdr));
+    hdr.magic = SJ_PCAP_MAGIC;
+    hdr.version_major = 2;
+    hdr.version_minor = 4;
+    hdr.snaplen = REPLAY_SNAPLEN;
+    hdr.linktype = SJ_PCAP_LINKTYPE_RAW;
+
+    if (fwrite(&hdr, sizeof (hdr), 1, output) != 1)
+        RUNTIME_EXCEPTION("unable to write the output capture %s: %s", path, strerror(errno));
+
+    LOG_VERBOSE("the packets sent will be written in %s", path);
+}
+
+/* reads the next IPv4 record of the capture, the others are skipped */
+bool PcapIO::loadRecord(struct pcapReader &reader)
+{
+    struct sj_pcap_rechdr rec;
+
+    reader.pending = false;
+
+    if (reader.file == NULL)
+        return false;
+
+    while (fread(&rec, sizeof (rec), 1, reader.file) == 1)
+    {
+        if (reader.swapped)
+        {
+            rec.ts_sec = bswap_32(rec.ts_sec);
+            rec.ts_frac = bswap_32(rec.ts_frac);
+            rec.incl_len = bswap_32(rec.incl_len);
+        }
+
+        if (rec.incl_len > REPLAY_SNAPLEN)
+            RUNTIME_EXCEPTION("corrupted capture: a record of %u bytes", rec.incl_len);
+
+        if (rec.incl_len && fread(&(reader.buf[0]), rec.incl_len, 1, reader.file) != 1)
+            break;
+
+        reader.ts_usec = (uint64_t) rec.ts_sec * 1000000 + (reader.nsec ? rec.ts_frac / 1000 : rec.ts_frac);
+
+        uint16_t ethertype = ETHERTYPE_IP;
+        switch (reader.linktype)
+        {
+        case SJ_PCAP_LINKTYPE_ETHERNET:
+            reader.offset = ETH_HLEN;
+            if (rec.incl_len >= ETH_HLEN)
+                ethertype = (reader.buf[12] << 8) | reader.buf[13];
+            break;
+        case SJ_PCAP_LINKTYPE_LINUX_SLL:
+            reader.offset = 16;
+            if (rec.incl_len >= 16)
+                ethertype = (reader.buf[14] << 8) | reader.buf[15];
+            break;
+        default:
+            reader.offset = 0;
+        }
+
+        if (ethertype == ETHERTYPE_IP && rec.incl_len > reader.offset && (reader.buf[reader.offset] >> 4) == 4)
+        {
+            reader.len = rec.incl_len - reader.offset;
+            reader.pending = true;
+            return true;
+        }
+
+        ++reader.skipped;
+    }
+
+    return false;
+}
+
+void PcapIO::writeRecord(const Packet &pkt)
+{
+    struct sj_pcap_rechdr rec;
+
+    if (output == NULL)
+        return;
+
+    rec.ts_sec = replay_usec / 1000000;
+    rec.ts_frac = replay_usec % 1000000;
+    rec.incl_len = rec.orig_len = pkt.pbuf.size();
+
+    if (fwrite(&rec, sizeof (rec), 1, output) != 1 || fwrite(&(pkt.pbuf[0]), rec.incl_len, 1, output) != 1)
+        RUNTIME_EXCEPTION("error writing the output capture: %s", strerror(errno));
+}
+
+/* both the destinations are written in the output, in the order of the SEND queue */
+void PcapIO::flushOutput(void)
+{
+    Packet *pkt;
+
+    while ((pkt = conntrack->readpacket(NETWORK)) != NULL)
+    {
+        writeRecord(*pkt);
+        ++written_tunnel;
+        delete pkt;
+    }
+
+    while ((pkt = conntrack->readpacket(TUNNEL)) != NULL)
+    {
+        writeRecord(*pkt);
+        ++written_network;
+        delete pkt;
+    }
+}
+
+void PcapIO::logSummary(void)
+{
+    const uint64_t elapsed = monotonicUsec() - start_usec;
+    const uint32_t read = tunnel.packets + network.packets;
+
+    LOG_ALL("replay completed: read %u packets from the tunnel and %u from the network (%u not IPv4 skipped)",
+            tunnel.packets, network.packets, tunnel.skipped + network.skipped);
+    LOG_ALL("replay completed: sent %u packets to the network and %u to the tunnel", written_network, written_tunnel);
+    LOG_ALL("replay completed: %u.%06u seconds, %u packets/s, cycle latency avg %u us max %u us (%u cycles)",
+            (uint32_t) (elapsed / 1000000), (uint32_t) (elapsed % 1000000),
+            elapsed ? (uint32_t) ((uint64_t) read * 1000000 / elapsed) : 0,
+            cycles ? (uint32_t) (cycle_usec_total / cycles) : 0, (uint32_t) cycle_usec_max, (uint32_t) cycles);
+
+    struct keep_wait_stats keepstats;
+    conntrack->keepWaitStats(keepstats);
+
+    LOG_ALL("replay completed: keep waits <1|2|4|8|16|32|64|128|256ms %u|%u|%u|%u|%u|%u|%u|%u|%u and longer %u, %u expired",
+            keepstats.waits[0], keepstats.waits[1], keepstats.waits[2], keepstats.waits[3], keepstats.waits[4],
+            keepstats.waits[5], keepstats.waits[6], keepstats.waits[7], keepstats.waits[8], keepstats.waits[9],
+            keepstats.expired);
+}
+
+void PcapIO::prepareConntrack(TCPTrack *ct)
+{
+    conntrack = ct;
+
+    /* the replay clock starts with the first record */
+    if (tunnel.pending && (!network.pending || tunnel.ts_usec <= network.ts_usec))
+        replay_usec = tunnel.ts_usec;
+    else if (network.pending)
+        replay_usec = network.ts_usec;
+
+    sj_clock = replay_usec / 1000000;
+    sj_clock_msec = replay_usec / 1000;
+
+    start_usec = monotonicUsec();
+}
+
+/* there is nothing to wait in replay mode, the caller descriptors are ignored */
+void PcapIO::watchEvent(int fd, uint32_t event)
+{
+    LOG_DEBUG("descriptor %d (event %u) not watched in replay mode", fd, event);
+}
+
+uint32_t PcapIO::networkIO(void)
+{
+    /*
+     * a cycle is the same of NetIO: a burst of input (at most 20 pkts),
+     * analyzePacketQueue and the flush of the SEND queue; when the
+     * captures are over the cycles run on the deadlines of the conntrack
+     * until it has nothing more to do.
+     */
+    const uint64_t cycle_start = monotonicUsec();
+    const uint64_t deadline = conntrack->nextDeadline();
+    uint32_t burst = 0;
+
+    while (burst < NETIOBURSTSIZE * 2)
+    {
+        struct pcapReader *reader;
+
+        if (tunnel.pending && (!network.pending || tunnel.ts_usec <= network.ts_usec))
+            reader = &tunnel;
+        else if (network.pending)
+            reader = &network;
+        else
+            break;
+
+        /* a deadline coming before the record has its own cycle, as with the timer of NetIO */
+        if (deadline > sj_clock_msec && reader->ts_usec > deadline * 1000)
+            break;
+
+        /* the clock never goes back, also with unordered captures */
+        if (reader->ts_usec > replay_usec)
+            replay_usec = reader->ts_usec;
+        sj_clock = replay_usec / 1000000;
+        sj_clock_msec = replay_usec / 1000;
+
+        conntrack->writepacket(reader->source, &(reader->buf[reader->offset]), reader->len);
+        ++reader->packets;
+        ++burst;
+
+        loadRecord(*reader);
+    }
+
+    if (!burst)
+    {
+        if (!deadline)
+        {
+            logSummary();
+            return NETIO_EVENT_END;
+        }
+
+        if (deadline > sj_clock_msec)
+        {
+            replay_usec = deadline * 1000;
+            sj_clock = replay_usec / 1000000;
+            sj_clock_msec = deadline;
+        }
+    }
+
+    conntrack->analyzePacketQueue();
+
+    flushOutput();
+
+    const uint64_t cycle_usec = monotonicUsec() - cycle_start;
+    cycle_usec_total += cycle_usec;
+    if (cycle_usec > cycle_usec_max)
+        cycle_usec_max = cycle_usec;
+    ++cycles;
+
+    return 0;
+}
@@ -0,0 +1,125 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SJ_PCAPIO_H
+#define SJ_PCAPIO_H
+
+#include "Utils.h"
+#include "PacketIO.h"
+
+/*
+ * the classic libpcap file format, handled without the library:
+ * the captures are read in both byte orders, with microseconds or
+ * nanoseconds timestamps; the output is written as raw IPv4.
+ */
+struct sj_pcap_filehdr
+{
+    uint32_t magic;
+    uint16_t version_major;
+    uint16_t version_minor;
+    int32_t thiszone;
+    uint32_t sigfigs;
+    uint32_t snaplen;
+    uint32_t linktype;
+};
+
+struct sj_pcap_rechdr
+{
+    uint32_t ts_sec;
+    uint32_t ts_frac;
+    uint32_t incl_len;
+    uint32_t orig_len;
+};
+
+#define SJ_PCAP_MAGIC               0xa1b2c3d4
+#define SJ_PCAP_MAGIC_NSEC          0xa1b23c4d
+#define SJ_PCAP_MAGIC_SWAPPED       0xd4c3b2a1
+#define SJ_PCAP_MAGIC_NSEC_SWAPPED  0x4d3cb2a1
+#define SJ_PCAP_LINKTYPE_ETHERNET   1
+#define SJ_PCAP_LINKTYPE_RAW        101
+#define SJ_PCAP_LINKTYPE_LINUX_SLL  113
+#define SJ_PCAP_LINKTYPE_IPV4       228
+
+/* a capture file and its next record, already read */
+struct pcapReader
+{
+    FILE *file;
+    source_t source;
+    bool swapped;
+    bool nsec;
+    uint32_t linktype;
+
+    bool pending;
+    uint64_t ts_usec;
+    vector<unsigned char> buf;
+    uint32_t offset; /* the link layer header, skipped */
+    uint32_t len;
+
+    uint32_t packets;
+    uint32_t skipped;
+};
+
+/*
+ * the PacketIO of the replay mode: the traffic of the tun and of the
+ * network is read from two capture files and merged in timestamp order,
+ * everything the conntrack sends is written in the output capture.
+ * sj_clock follows the timestamps of the captures, and when they are
+ * over it jumps to the next deadline of the conntrack: a replay runs at
+ * full speed and is not affected by the host load.
+ */
+class PcapIO : public PacketIO
+{
+private:
+
+    struct pcapReader tunnel;
+    struct pcapReader network;
+    FILE *output;
+
+    /* the timestamp of the last record read, used for the output records */
+    uint64_t replay_usec;
+
+    uint32_t written_tunnel;
+    uint32_t written_network;
+
+    /* wall clock measures, in microseconds */
+    uint64_t start_usec;
+    uint64_t cycles;
+    uint64_t cycle_usec_total;
+    uint64_t cycle_usec_max;
+
+    void openCapture(struct pcapReader &, const char *, source_t);
+    void openOutput(const char *);
+    bool loadRecord(struct pcapReader &);
+    void writeRecord(const Packet &);
+    void flushOutput(void);
+    void logSummary(void);
+
+public:
+
+    PcapIO(void);
+    ~PcapIO(void);
+    virtual void prepareConntrack(TCPTrack *);
+    virtual void watchEvent(int, uint32_t);
+    virtual uint32_t networkIO(void);
+};
+
+#endif /* SJ_PCAPIO_H */
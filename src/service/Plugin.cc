@@ -135,30 +135,39 @@ removeOrigPkt(false)
 judge_t Plugin::pktRandomDamage(uint8_t availableScrambles, uint8_t supportedScrambles)
 {
     uint8_t scrambles = (availableScrambles & supportedScrambles);
-    char availStr[MEDIUMBUF], supportStr[MEDIUMBUF], andedStr[MEDIUMBUF];
-
-    snprintfScramblesList(availStr, MEDIUMBUF, availableScrambles);
-    snprintfScramblesList(supportStr, MEDIUMBUF, supportedScrambles);
-    snprintfScramblesList(andedStr, MEDIUMBUF, scrambles);
+    judge_t choosed;
+    const char *choosedStr;
 
     if (ISSET_TTL(scrambles) && random_percent(70))
     {
-        LOG_PACKET("%s %s: avail [%s] init [%s] both [%s], choosed PRESCRIPTION",
-                   __func__, pluginName, availStr, supportStr, andedStr);
-
-        return PRESCRIPTION;
+        choosed = PRESCRIPTION;
+        choosedStr = "PRESCRIPTION";
+    }
+    else if (ISSET_MALFORMED(scrambles) && random_percent(95))
+    {
+        choosed = MALFORMED;
+        choosedStr = "MALFORMED";
     }
-    if (ISSET_MALFORMED(scrambles) && random_percent(95))
+    else
     {
-        LOG_PACKET("%s %s: avail [%s] init [%s] both [%s], choosed MALFORMED",
-                   __func__, pluginName, availStr, supportStr, andedStr);
-        return MALFORMED;
+        choosed = GUILTY;
+        choosedStr = "GUILTY";
     }
 
-    LOG_PACKET("%s %s: avail [%s] init [%s] both [%s], choosed GUILTY",
-               __func__, pluginName, availStr, supportStr, andedStr);
+    /* the scrambles lists are printed only for the packet log */
+    if (debug.enabled(PACKET_LEVEL))
+    {
+        char availStr[MEDIUMBUF], supportStr[MEDIUMBUF], andedStr[MEDIUMBUF];
+
+        snprintfScramblesList(availStr, MEDIUMBUF, availableScrambles);
+        snprintfScramblesList(supportStr, MEDIUMBUF, supportedScrambles);
+        snprintfScramblesList(andedStr, MEDIUMBUF, scrambles);
+
+        LOG_PACKET("%s %s: avail [%s] init [%s] both [%s], choosed %s",
+                   __func__, pluginName, availStr, supportStr, andedStr, choosedStr);
+    }
 
-    return GUILTY;
+    return choosed;
 }
 
 bool Plugin::condition(const Packet &, uint8_t availableScrambles)
@@ -24,6 +24,8 @@
 #include "UserConf.h"
 
 #include <fcntl.h>
+#include <pthread.h>
+#include <sys/signalfd.h>
 
 extern auto_ptr<UserConf> userconf;
 
@@ -90,6 +92,9 @@ int Process::detach(void)
 
         close(pdes[0]);
 
+        /* the root process keeps the sigtrap handler: a signal interrupts its waitpid */
+        pthread_sigmask(SIG_SETMASK, &sig_oset, NULL);
+
         return pid_child;
 
     }
@@ -109,6 +114,19 @@ int Process::detach(void)
 
         close(pdes[1]);
 
+        /* the service process keeps the signals blocked, they are read from sigtrapFd() */
+        struct sigaction action;
+        memset(&action, 0, sizeof (struct sigaction));
+        action.sa_handler = SIG_DFL;
+
+        sigaction(SIGINT, &action, NULL);
+        sigaction(SIGABRT, &action, NULL);
+        sigaction(SIGPIPE, &action, NULL);
+        sigaction(SIGTERM, &action, NULL);
+        sigaction(SIGQUIT, &action, NULL);
+        sigaction(SIGUSR1, &action, NULL);
+        sigaction(SIGUSR2, &action, NULL);
+
         LOG_DEBUG("forked child process, pid %d", getpid());
 
         return 0;
@@ -146,6 +164,12 @@ void Process::privilegesDowngrade(void)
                 getpid(), userinfo.pw_uid, groupinfo.gr_gid);
 }
 
+/*
+ * the trapped signals are blocked before the fork and before any thread
+ * exists, so that every thread inherits the mask: the root process
+ * unblocks them after the fork, the service process never does and
+ * receives them by a signalfd watched in the event loop of NetIO.
+ */
 void Process::sigtrapSetup(sig_t sigtrap_function)
 {
     sigemptyset(&sig_nset);
@@ -157,6 +181,10 @@ void Process::sigtrapSetup(sig_t sigtrap_function)
     sigaddset(&sig_nset, SIGTERM);
     sigaddset(&sig_nset, SIGQUIT);
 
+    sig_trapset = sig_nset;
+    sigaddset(&sig_trapset, SIGUSR1);
+    sigaddset(&sig_trapset, SIGUSR2);
+
     struct sigaction action;
     memset(&action, 0, sizeof (struct sigaction));
     action.sa_handler = sigtrap_function;
@@ -169,16 +197,20 @@ void Process::sigtrapSetup(sig_t sigtrap_function)
     sigaction(SIGQUIT, &action, NULL);
     sigaction(SIGUSR1, &action, NULL);
     sigaction(SIGUSR2, &action, NULL);
-}
 
-void Process::sigtrapEnable(void)
-{
-    sigprocmask(SIG_SETMASK, &sig_oset, NULL);
+    const int ret = pthread_sigmask(SIG_BLOCK, &sig_trapset, &sig_oset);
+    if (ret)
+        RUNTIME_EXCEPTION("unable to block the trapped signals: %s", strerror(ret));
 }
 
-void Process::sigtrapDisable(void)
+int Process::sigtrapFd(void)
 {
-    sigprocmask(SIG_BLOCK, &sig_nset, &sig_oset);
+    int fd;
+
+    if ((fd = signalfd(-1, &sig_trapset, SFD_NONBLOCK | SFD_CLOEXEC)) == -1)
+        RUNTIME_EXCEPTION("unable to open the signalfd: %s", strerror(errno));
+
+    return fd;
 }
 
 pid_t Process::readPidfile(void)
@@ -41,6 +41,7 @@ private:
     void* groupinfo_buf;
 
     sigset_t sig_nset;
+    sigset_t sig_trapset;
     sigset_t sig_oset;
 
 public:
@@ -55,8 +56,7 @@ public:
     void jail(void);
     void privilegesDowngrade(void);
     void sigtrapSetup(sig_t);
-    void sigtrapEnable(void);
-    void sigtrapDisable(void);
+    int sigtrapFd(void);
     void background(void);
     void isolation(void);
 };
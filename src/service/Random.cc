@@ -0,0 +1,168 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "Random.h"
+
+#include <cstring>
+
+/* ChaCha8: the randomness of the hacks does not need the 20 rounds of the cipher */
+#define RANDOM_CHACHA_ROUNDS    8
+
+typedef uint32_t random_vec __attribute__ ((vector_size (RANDOM_BLOCKS * sizeof (uint32_t))));
+
+#define ROTL(v, n) (((v) << (n)) | ((v) >> (32 - (n))))
+
+#define QUARTERROUND(a, b, c, d) \
+    a += b; d ^= a; d = ROTL(d, 16); \
+    c += d; b ^= c; b = ROTL(b, 12); \
+    a += b; d ^= a; d = ROTL(d, 8); \
+    c += d; b ^= c; b = ROTL(b, 7)
+
+static uint64_t random_seed;
+static uint32_t random_streams;
+static __thread Random *thread_random;
+
+/* the 64 bit constants are built by halves: ISO C++98 has no long long literals */
+#define U64(hi, lo) (((uint64_t) (hi) << 32) | (uint32_t) (lo))
+
+/* splitmix64, expands the seed in the key */
+static uint64_t splitmix64(uint64_t &state)
+{
+    uint64_t z = (state += U64(0x9E3779B9, 0x7F4A7C15));
+
+    z = (z ^ (z >> 30)) * U64(0xBF58476D, 0x1CE4E5B9);
+    z = (z ^ (z >> 27)) * U64(0x94D049BB, 0x133111EB);
+
+    return z ^ (z >> 31);
+}
+
+Random::Random(uint64_t seed, uint32_t stream) :
+available(0)
+{
+    /* "expand 32-byte k" */
+    input[0] = 0x61707865;
+    input[1] = 0x3320646e;
+    input[2] = 0x79622d32;
+    input[3] = 0x6b206574;
+
+    for (uint32_t i = 4; i < 12; i += 2)
+    {
+        const uint64_t k = splitmix64(seed);
+        input[i] = k;
+        input[i + 1] = k >> 32;
+    }
+
+    /* 64 bit block counter and the stream as nonce */
+    input[12] = 0;
+    input[13] = 0;
+    input[14] = stream;
+    input[15] = 0;
+}
+
+/* RANDOM_BLOCKS blocks of keystream, the lane j of the vectors computes the block counter + j */
+void Random::generate(uint32_t *out)
+{
+    random_vec in[RANDOM_BLOCK_WORDS];
+    random_vec x[RANDOM_BLOCK_WORDS];
+
+    for (uint32_t i = 0; i < RANDOM_BLOCK_WORDS; ++i)
+    {
+        for (uint32_t j = 0; j < RANDOM_BLOCKS; ++j)
+            in[i][j] = input[i];
+    }
+
+    for (uint32_t j = 0; j < RANDOM_BLOCKS; ++j)
+    {
+        in[12][j] = input[12] + j;
+        in[13][j] = input[13] + (in[12][j] < input[12]);
+    }
+
+    memcpy(x, in, sizeof (x));
+
+    for (uint32_t r = 0; r < RANDOM_CHACHA_ROUNDS; r += 2)
+    {
+        QUARTERROUND(x[0], x[4], x[8], x[12]);
+        QUARTERROUND(x[1], x[5], x[9], x[13]);
+        QUARTERROUND(x[2], x[6], x[10], x[14]);
+        QUARTERROUND(x[3], x[7], x[11], x[15]);
+        QUARTERROUND(x[0], x[5], x[10], x[15]);
+        QUARTERROUND(x[1], x[6], x[11], x[12]);
+        QUARTERROUND(x[2], x[7], x[8], x[13]);
+        QUARTERROUND(x[3], x[4], x[9], x[14]);
+    }
+
+    for (uint32_t i = 0; i < RANDOM_BLOCK_WORDS; ++i)
+    {
+        x[i] += in[i];
+        for (uint32_t j = 0; j < RANDOM_BLOCKS; ++j)
+            out[j * RANDOM_BLOCK_WORDS + i] = x[i][j];
+    }
+
+    const uint64_t counter = ((uint64_t) input[13] << 32 | input[12]) + RANDOM_BLOCKS;
+    input[12] = counter;
+    input[13] = counter >> 32;
+}
+
+void Random::fill(void *s, size_t n)
+{
+    unsigned char *cp = (unsigned char *) s;
+    uint32_t blocks[RANDOM_BLOCKS * RANDOM_BLOCK_WORDS];
+
+    while (n >= sizeof (blocks))
+    {
+        generate(blocks);
+        memcpy(cp, blocks, sizeof (blocks));
+        cp += sizeof (blocks);
+        n -= sizeof (blocks);
+    }
+
+    while (n >= sizeof (uint32_t))
+    {
+        const uint32_t word = get();
+        memcpy(cp, &word, sizeof (word));
+        cp += sizeof (word);
+        n -= sizeof (word);
+    }
+
+    if (n)
+    {
+        const uint32_t word = get();
+        memcpy(cp, &word, n);
+    }
+}
+
+Random &Random::engine(void)
+{
+    if (thread_random == NULL)
+        thread_random = new Random(random_seed, __sync_fetch_and_add(&random_streams, 1));
+
+    return *thread_random;
+}
+
+void Random::seed(uint64_t seed)
+{
+    random_seed = seed;
+    random_streams = 0;
+
+    delete thread_random;
+    thread_random = NULL;
+}
@@ -0,0 +1,82 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SJ_RANDOM_H
+#define SJ_RANDOM_H
+
+#include <stdint.h>
+#include <cstddef>
+
+/*
+ * Random is the random generator of sniffjoke: the keystream of ChaCha
+ * with RANDOM_CHACHA_ROUNDS rounds, keyed by a 64 bit seed. the blocks
+ * are generated RANDOM_BLOCKS at time, one for every lane of a vector,
+ * and fill() writes the whole blocks straight in the destination.
+ *
+ * every thread has its own engine, with the same seed and a different
+ * stream: the engines don't share a lock, and a fixed seed (--seed)
+ * gives the same sequence on every run.
+ */
+#define RANDOM_BLOCKS           4
+#define RANDOM_BLOCK_WORDS      16
+
+class Random
+{
+private:
+
+    uint32_t input[RANDOM_BLOCK_WORDS];
+    uint32_t keystream[RANDOM_BLOCKS * RANDOM_BLOCK_WORDS];
+    uint32_t available;
+
+    void generate(uint32_t *);
+
+public:
+
+    Random(uint64_t, uint32_t);
+
+    uint32_t get(void)
+    {
+        if (!available)
+        {
+            generate(keystream);
+            available = RANDOM_BLOCKS * RANDOM_BLOCK_WORDS;
+        }
+
+        return keystream[--available];
+    }
+
+    /* a value in [0, n) */
+    uint32_t below(uint32_t n)
+    {
+        return ((uint64_t) get() * n) >> 32;
+    }
+
+    void fill(void *, size_t);
+
+    /* the engine of the calling thread, created on first use */
+    static Random &engine(void);
+
+    /* the seed of the engines created from now on, and of the calling thread */
+    static void seed(uint64_t);
+};
+
+#endif /* SJ_RANDOM_H */
@@ -29,8 +29,25 @@
 
 #include "SessionTrack.h"
 
+extern auto_ptr<TimerWheel> timer_wheel;
+
+SessionTrack::SessionTrack(void) :
+access_timestamp(0),
+probe_distance(0),
+lru_node(LRU_NONE),
+proto(0),
+daddr(0),
+sport(0),
+dport(0),
+packet_number(0),
+injected_pktnumber(0)
+{
+}
+
 SessionTrack::SessionTrack(const Packet &pkt) :
 access_timestamp(0),
+probe_distance(0),
+lru_node(LRU_NONE),
 daddr(pkt.ip->daddr),
 packet_number(0),
 injected_pktnumber(0)
@@ -45,13 +62,14 @@ injected_pktnumber(0)
     {
         proto = IPPROTO_UDP;
         sport = pkt.udp->source;
-        dport = pkt.udp->source;
+        dport = pkt.udp->dest;
     }
 
     SELFLOG("New session created from Packet ID #%d", pkt.SjPacketId);
 }
 
-SessionTrack::~SessionTrack(void)
+/* called when the session is removed from the SessionTrackMap */
+void SessionTrack::expire(void)
 {
     SELFLOG("");
 
@@ -76,11 +94,8 @@ SessionTrack::~SessionTrack(void)
 #endif
 }
 
-void SessionTrack::selflog(const char *func, const char *format, ...) const
+void SessionTrack::selflogFormat(const char *func, const char *format, ...) const
 {
-    if (debug.level() == SUPPRESS_LEVEL)
-        return;
-
     char loginfo[LARGEBUF];
     va_list arguments;
     va_start(arguments, format);
@@ -96,142 +111,230 @@ void SessionTrack::selflog(const char *func, const char *format, ...) const
                 );
 }
 
-bool SessionTrackKey::operator<(SessionTrackKey comp) const
+SessionTrackKey::SessionTrackKey(const Packet &pkt) :
+daddr(pkt.ip->daddr)
 {
-    if (proto < comp.proto)
-        return true;
-    else if (proto > comp.proto)
-        return false;
-    else
+    if (pkt.proto == TCP)
     {
-        if (daddr < comp.daddr)
-            return true;
-        else if (daddr > comp.daddr)
-            return false;
-        else
-        {
-            if (sport < comp.sport)
-                return true;
-            else if (sport > comp.sport)
-                return false;
-            else
-            {
-                if (dport < comp.dport)
-                    return true;
-                else
-                    return false;
-            }
-        }
+        proto = IPPROTO_TCP;
+        sport = pkt.tcp->source;
+        dport = pkt.tcp->dest;
+    }
+    else /* (pkt.proto == UDP) */
+    {
+        proto = IPPROTO_UDP;
+        sport = pkt.udp->source;
+        dport = pkt.udp->dest;
     }
 }
 
-SessionTrackMap::SessionTrackMap(void) :
-manage_timeout(sj_clock)
+bool SessionTrackKey::operator==(const SessionTrack &sessiontrack) const
 {
-    LOG_DEBUG("");
+    return (daddr == sessiontrack.daddr && sport == sessiontrack.sport &&
+            dport == sessiontrack.dport && proto == sessiontrack.proto);
+}
+
+SessionTrackKey::SessionTrackKey(const SessionTrack &sessiontrack) :
+proto(sessiontrack.proto),
+daddr(sessiontrack.daddr),
+sport(sessiontrack.sport),
+dport(sessiontrack.dport)
+{
+}
+
+/* the ports mixed with the address by the murmur3 finalizer */
+uint32_t SessionTrackKey::hash(void) const
+{
+    uint32_t h = daddr ^ ((((uint32_t) sport << 16) | dport) * 0xCC9E2D51) ^ proto;
+
+    h ^= h >> 16;
+    h *= 0x85EBCA6B;
+    h ^= h >> 13;
+    h *= 0xC2B2AE35;
+    h ^= h >> 16;
+
+    return h;
+}
+
+/* the smallest power of two keeping capacity sessions at 7/8 of the slots */
+static uint32_t sessionTrackSlots(uint32_t capacity)
+{
+    uint32_t slots = 16;
+
+    while (slots / 8 * 7 < capacity)
+        slots *= 2;
+
+    return slots;
+}
+
+SessionTrackMap::SessionTrackMap(uint32_t capacity) :
+table(new SessionTrack[sessionTrackSlots(capacity)]),
+table_mask(sessionTrackSlots(capacity) - 1),
+table_size(0),
+lru(capacity),
+expiry_timer(TIMER_SESSIONTRACK_EXPIRY, this)
+{
+    LOG_DEBUG("capacity of %u sessions in %u slots", capacity, table_mask + 1);
 }
 
 SessionTrackMap::~SessionTrackMap(void)
 {
     LOG_DEBUG("");
 
-    for (SessionTrackMap::iterator it = begin(); it != end();)
+    for (uint32_t i = 0; i <= table_mask; ++i)
     {
-        delete &(*it->second);
-        erase(it++);
+        if (table[i].proto)
+            table[i].expire();
     }
+
+    timer_wheel->remove(expiry_timer);
+
+    delete[] table;
+}
+
+/*
+ * robin hood insertion of a session not present: on its way the session takes
+ * the slot of the first one nearer to its own slot, that continues in its place.
+ * every session moved updates the slot of its LRUList node.
+ * returns the slot of the session inserted.
+ */
+uint32_t SessionTrackMap::place(const SessionTrack &sessiontrack)
+{
+    SessionTrack moving = sessiontrack;
+    uint32_t index = SessionTrackKey(moving).hash() & table_mask;
+    uint32_t placed = table_mask + 1;
+
+    moving.probe_distance = 0;
+
+    while (table[index].proto)
+    {
+        if (table[index].probe_distance < moving.probe_distance)
+        {
+            swap(moving, table[index]);
+            lru.setSlot(table[index].lru_node, index);
+            if (placed > table_mask)
+                placed = index;
+        }
+
+        index = (index + 1) & table_mask;
+        ++moving.probe_distance;
+    }
+
+    table[index] = moving;
+    lru.setSlot(table[index].lru_node, index);
+    if (placed > table_mask)
+        placed = index;
+
+    ++table_size;
+
+    return placed;
+}
+
+/* the sessions following the erased one are moved back of a slot, until one is in its own */
+void SessionTrackMap::erase(uint32_t index)
+{
+    uint32_t next = (index + 1) & table_mask;
+
+    lru.release(table[index].lru_node);
+
+    while (table[next].proto && table[next].probe_distance)
+    {
+        table[index] = table[next];
+        --table[index].probe_distance;
+        lru.setSlot(table[index].lru_node, index);
+
+        index = next;
+        next = (next + 1) & table_mask;
+    }
+
+    table[index] = SessionTrack();
+
+    --table_size;
 }
 
 /* return a sessiontrack given a packet; return a new sessiontrack if no one exists */
 SessionTrack& SessionTrackMap::get(const Packet &pkt)
 {
-    SessionTrack *sessiontrack;
+    const SessionTrackKey key(pkt);
+    uint32_t index = key.hash() & table_mask;
+    uint16_t distance = 0;
 
-    /* create map key */
-    SessionTrackKey key;
-    key.daddr = pkt.ip->daddr;
-    if (pkt.proto == TCP)
+    /* check if the key it's already present */
+    while (table[index].proto && table[index].probe_distance >= distance)
     {
-        key.proto = IPPROTO_TCP;
-        key.sport = pkt.tcp->source;
-        key.dport = pkt.tcp->dest;
+        if (key == table[index])
+        {
+            /* on hit: update access timestamp using global clock */
+            table[index].access_timestamp = sj_clock;
+            lru.touch(table[index].lru_node);
+            return table[index];
+        }
+
+        index = (index + 1) & table_mask;
+        ++distance;
     }
-    else /* (pkt.proto == UDP) */
+
+    /* on miss: with the map full the least recently used session is evicted */
+    if (lru.full())
     {
-        key.proto = IPPROTO_UDP;
-        key.sport = pkt.udp->source;
-        key.dport = pkt.udp->dest;
+        const uint32_t oldest = lru.getSlot(lru.getOldest());
+
+        table[oldest].expire();
+        erase(oldest);
     }
 
-    /* check if the key it's already present */
-    SessionTrackMap::iterator it = find(key);
-    if (it != end()) /* on hit: return the sessiontrack object. */
-        sessiontrack = it->second;
-    else /* on miss: create a new sessiontrack and insert it into the map */
-        sessiontrack = insert(pair<SessionTrackKey, SessionTrack*>(key, new SessionTrack(pkt))).first->second;
+    SessionTrack newsession(pkt);
+    newsession.access_timestamp = sj_clock;
+    newsession.lru_node = lru.acquire();
+
+    const uint32_t placed = place(newsession);
 
-    /* update access timestamp using global clock */
-    sessiontrack->access_timestamp = sj_clock;
+    if (!expiry_timer.armed())
+        scheduleExpiry();
 
-    return *sessiontrack;
+    return table[placed];
 }
 
-void SessionTrackMap::manage(void)
+const SessionTrack* SessionTrackMap::getNext(uint32_t &index) const
 {
-    /* timeout check */
-    if (manage_timeout < sj_clock - SESSIONTRACKMAP_MANAGE_ROUTINE_TIMER)
+    for (; index <= table_mask; ++index)
     {
-        manage_timeout = sj_clock; /* update the next manage timeout */
-        for (SessionTrackMap::iterator it = begin(); it != end();)
-        {
-            if ((*it).second->access_timestamp + SESSIONTRACK_EXPIRYTIME < sj_clock)
-            {
-                delete &(*it->second);
-                erase(it++);
-            }
-            else
-            {
-                it++;
-            }
-        }
+        if (table[index].proto)
+            return &table[index++];
     }
 
-    /* size check */
-    uint32_t map_size = size();
-    uint32_t index;
-    if (map_size > SESSIONTRACKMAP_MEMORY_THRESHOLD)
+    return NULL;
+}
+
+/* the expiry_timer is armed on the expiry of the least recently used session */
+void SessionTrackMap::scheduleExpiry(void)
+{
+    const uint32_t node = lru.getOldest();
+
+    if (node == LRU_NONE)
+        return;
+
+    /* manage() removes the ones with access_timestamp + SESSIONTRACK_EXPIRYTIME < sj_clock */
+    const time_t expiry = table[lru.getSlot(node)].access_timestamp + SESSIONTRACK_EXPIRYTIME + 1;
+
+    timer_wheel->add(expiry_timer, sj_clock_msec + (expiry > sj_clock ? (uint64_t) (expiry - sj_clock) * 1000 : 0));
+}
+
+/* called by the conntrack when the expiry_timer expires */
+void SessionTrackMap::manage(void)
+{
+    /* the sessions are walked from the least recently used until the first not expired */
+    uint32_t node;
+    while ((node = lru.getOldest()) != LRU_NONE)
     {
-        /*
-         * we are forced to make a map cleanup.
-         * to solve this critical condition we decide to reset half
-         * of the map, and to do the best selection we reorder
-         * the map by the access timestamp.
-         * the complexity cost of this operation is O(NLogN)
-         * due to the sort algorithm.
-         * this is the worst case; (others operations are linear)
-         */
-        SessionTrack** tmp = new SessionTrack*[map_size];
-
-        index = 0;
-        for (SessionTrackMap::iterator it = begin(); it != end(); ++it)
-            tmp[index++] = it->second;
-
-        clear();
-
-        sort(tmp, tmp + map_size, sessiontrackTimestampComparison);
-
-        index = 0;
-        do
-        {
-            const SessionTrackKey key = {tmp[index]->daddr, tmp[index]->sport, tmp[index]->dport};
-            insert(pair<SessionTrackKey, SessionTrack *>(key, tmp[index]));
-        }
-        while (++index != SESSIONTRACKMAP_MEMORY_THRESHOLD / 2);
+        const uint32_t index = lru.getSlot(node);
 
-        do
-            delete tmp[index];
-        while (++index != map_size);
+        if (table[index].access_timestamp + SESSIONTRACK_EXPIRYTIME >= sj_clock)
+            break;
 
-        delete[] tmp;
+        table[index].expire();
+        erase(index);
     }
+
+    scheduleExpiry();
 }
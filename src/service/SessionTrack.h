@@ -25,6 +25,8 @@
 
 #include "Utils.h"
 #include "Packet.h"
+#include "LRUList.h"
+#include "TimerWheel.h"
 
 class SessionTrack
 {
@@ -32,10 +34,14 @@ class SessionTrack
 
 private:
     time_t access_timestamp; /* access timestamp used to decretee expiry */
+    uint16_t probe_distance; /* distance from the slot of its hash in the SessionTrackMap */
+    uint32_t lru_node; /* its node in the LRUList of the SessionTrackMap */
+
+    void expire(void);
 
 public:
 
-    uint8_t proto;
+    uint8_t proto; /* 0 marks an empty slot of the SessionTrackMap */
     uint32_t daddr;
     uint16_t sport;
     uint16_t dport;
@@ -43,11 +49,16 @@ public:
     uint32_t packet_number;
     uint32_t injected_pktnumber;
 
+    SessionTrack(void);
     SessionTrack(const Packet &);
-    ~SessionTrack(void);
 
     /* utilities */
-    void selflog(const char *func, const char *format, ...) const;
+    __attribute__((always_inline)) void selflog(const char *func, const char *format, ...) const
+    {
+        if (debug.enabled(SESSION_LEVEL))
+            selflogFormat(func, format, __builtin_va_arg_pack());
+    }
+    void selflogFormat(const char *, const char *, ...) const;
 };
 
 class SessionTrackKey
@@ -58,31 +69,54 @@ public:
     uint16_t sport;
     uint16_t dport;
 
-    bool operator<(SessionTrackKey) const;
+    SessionTrackKey(const Packet &);
+    SessionTrackKey(const SessionTrack &);
 
+    bool operator==(const SessionTrack &) const;
+    uint32_t hash(void) const;
 };
 
-class SessionTrackMap : public map<const SessionTrackKey, SessionTrack*>
+/*
+ * SessionTrackMap is an open addressing hash table with robin hood probing:
+ * the sessions are kept inline in the slots, a lookup reads the slot of the
+ * hash and the few following it, and is ended by the first slot with a
+ * session nearer to its own slot than the searched one would be.
+ *
+ * the sessions are at most the capacity given to the map, that sizes the
+ * table to keep it 7/8 full at most: a new session exceeding it evicts the
+ * least recently used one. the expiry_timer is armed on the expiry of the
+ * least recently used session, the conntrack calls manage() when it expires.
+ *
+ * the insertion of a new session can move the others, so a reference
+ * returned by get() is valid until the next get() or manage().
+ */
+class SessionTrackMap
 {
 private:
-    time_t manage_timeout;
+    SessionTrack *table;
+    uint32_t table_mask; /* slots - 1, the slots are a power of two */
+    uint32_t table_size;
+    LRUList lru;
+    Timer expiry_timer; /* the expiry of the least recently used session */
 
-    struct sessiontrack_timestamp_comparison
-    {
-
-        bool operator() (const SessionTrack *i, const SessionTrack * j)
-        {
-            return ( i->access_timestamp < j->access_timestamp);
-        }
-
-    } sessiontrackTimestampComparison;
+    uint32_t place(const SessionTrack &);
+    void erase(uint32_t);
+    void scheduleExpiry(void);
 
 public:
-    SessionTrackMap(void);
+    SessionTrackMap(uint32_t);
     ~SessionTrackMap(void);
 
     SessionTrack& get(const Packet &);
     void manage(void);
+
+    uint32_t size(void) const
+    {
+        return table_size;
+    }
+
+    /* the sessions are walked by slot: returns the first from *index on, NULL at the end */
+    const SessionTrack* getNext(uint32_t &) const;
 };
 
 #endif /* SJ_SESSIONTRACK_H */
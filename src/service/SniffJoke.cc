@@ -20,17 +20,24 @@
  *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
  */
 #include "SniffJoke.h"
+#include "Checksum.h"
+#include "NetIO.h"
+#include "PcapIO.h"
+#include "PacketPool.h"
 
 #include <fcntl.h>
+#include <sys/signalfd.h>
 #include <sys/types.h>
 #include <sys/wait.h>
 
 /* global variables */
 time_t sj_clock;
+uint64_t sj_clock_msec;
 char sj_clock_str[MEDIUMBUF];
 Debug debug;
 
 auto_ptr<UserConf> userconf;
+auto_ptr<TimerWheel> timer_wheel;
 auto_ptr<TTLFocusMap> ttlfocus_map;
 auto_ptr<SessionTrackMap> sessiontrack_map;
 auto_ptr<OptionPool> opt_pool;
@@ -42,19 +49,23 @@ void sigtrap(int);
 SniffJoke::SniffJoke(const struct sj_cmdline_opts &opts) :
 alive(true),
 opts(opts),
-service_pid(0)
+service_pid(0),
+signal_fd(-1)
 {
     updateClock();
 
     userconf = auto_ptr<UserConf > (new UserConf(opts));
-    proc = auto_ptr<Process > (new Process);
+
+    /* the replay mode runs in a single unprivileged process */
+    if (!opts.replay)
+        proc = auto_ptr<Process > (new Process);
 
     LOG_DEBUG("");
 }
 
 SniffJoke::~SniffJoke(void)
 {
-    if (getuid() || geteuid())
+    if (opts.replay || getuid() || geteuid())
     {
         LOG_DEBUG("service with user privileges [%d]", getpid());
         cleanServerUser();
@@ -70,6 +81,12 @@ SniffJoke::~SniffJoke(void)
 
 void SniffJoke::run(void)
 {
+    if (opts.replay)
+    {
+        runReplay();
+        return;
+    }
+
     pid_t old_service_pid = proc->readPidfile();
     if (old_service_pid != 0)
     {
@@ -113,9 +130,9 @@ void SniffJoke::run(void)
     userconf->networkSetup();
 
     /* the code flow reach here, SniffJoke is ready to instance network environment */
-    mitm = auto_ptr<NetIO > (new NetIO);
+    mitm = auto_ptr<PacketIO > (new NetIO);
 
-    /* sigtrap handler mapped the same in both Sj processes */
+    /* sigtrap handler for the root process, the signals are blocked before the fork and the threads */
     proc->sigtrapSetup(sigtrap);
 
     /* proc->detach: fork() into two processes,
@@ -157,8 +174,9 @@ void SniffJoke::run(void)
         proc->jail();
         proc->privilegesDowngrade();
 
-        sessiontrack_map = auto_ptr<SessionTrackMap > (new SessionTrackMap);
-        ttlfocus_map = auto_ptr<TTLFocusMap > (new TTLFocusMap);
+        timer_wheel = auto_ptr<TimerWheel > (new TimerWheel(sj_clock_msec));
+        sessiontrack_map = auto_ptr<SessionTrackMap > (new SessionTrackMap(userconf->runcfg.max_sessions));
+        ttlfocus_map = auto_ptr<TTLFocusMap > (new TTLFocusMap(userconf->runcfg.max_destinations));
         conntrack = auto_ptr<TCPTrack > (new TCPTrack);
 
         mitm->prepareConntrack(conntrack.get());
@@ -171,25 +189,75 @@ void SniffJoke::run(void)
 
         setupAdminSocket();
 
+        /* signals and admin commands wake the same wait of the network I/O */
+        signal_fd = proc->sigtrapFd();
+        mitm->watchEvent(signal_fd, NETIO_EVENT_SIGNAL);
+        mitm->watchEvent(admin_socket, NETIO_EVENT_ADMIN);
+
         /* main block */
         while (alive)
         {
             updateClock();
 
-            proc->sigtrapDisable();
-
-            mitm->networkIO();
+            const uint32_t events = mitm->networkIO();
 
-            handleAdminSocket();
+            if (events & NETIO_EVENT_SIGNAL)
+                handleSignal();
 
-            proc->sigtrapEnable();
+            if (events & NETIO_EVENT_ADMIN)
+                handleAdminSocket();
         }
     }
 }
 
+/*
+ * the replay mode: the conntrack, the plugins and the options work on the
+ * traffic of the captures, without tun, network, root privileges and fork.
+ */
+void SniffJoke::runReplay(void)
+{
+    LOG_ALL("SniffJoke started in replay mode: the traffic is read from the captures");
+
+    setupDebug();
+
+    mitm = auto_ptr<PacketIO > (new PcapIO);
+
+    plugin_pool = auto_ptr<PluginPool > (new PluginPool);
+    opt_pool = auto_ptr<OptionPool > (new OptionPool);
+
+    timer_wheel = auto_ptr<TimerWheel > (new TimerWheel(sj_clock_msec));
+    sessiontrack_map = auto_ptr<SessionTrackMap > (new SessionTrackMap(userconf->runcfg.max_sessions));
+    ttlfocus_map = auto_ptr<TTLFocusMap > (new TTLFocusMap(userconf->runcfg.max_destinations));
+    conntrack = auto_ptr<TCPTrack > (new TCPTrack);
+
+    mitm->prepareConntrack(conntrack.get());
+
+    createSjEnvironment();
+
+    plugin_pool->initializeAll(&autoptrList);
+
+    while (alive)
+    {
+        if (mitm->networkIO() & NETIO_EVENT_END)
+            alive = false;
+
+        updateClock();
+    }
+}
+
 void SniffJoke::updateClock(void)
 {
-    sj_clock = time(NULL);
+    /* in replay mode sj_clock follows the captures after the first record, PcapIO moves it */
+    if (!opts.replay || !sj_clock)
+    {
+        struct timespec now;
+        clock_gettime(CLOCK_REALTIME, &now);
+        sj_clock = now.tv_sec;
+
+        /* the timers are not moved by the changes of the date */
+        clock_gettime(CLOCK_MONOTONIC, &now);
+        sj_clock_msec = (uint64_t) now.tv_sec * 1000 + now.tv_nsec / 1000000;
+    }
     strftime(sj_clock_str, sizeof (sj_clock_str), "%F %T", localtime(&sj_clock));
 }
 
@@ -211,6 +279,16 @@ void SniffJoke::setupDebug(void)
 
     if (!debug.resetLevel())
         RUNTIME_EXCEPTION("executing debug resetLevel");
+
+    LOG_VERBOSE("the checksums are computed by the %s kernel", sj_csum->name);
+
+    /* from now the logs are formatted and written by the log writer thread */
+    debug.ring.start(opts.replay);
+
+#ifdef DISABLE_PACKET_LOG
+    if (debug.level() >= SESSION_LEVEL)
+        LOG_ALL("this build has the session and packet logging disabled (DISABLE_PACKET_LOG)");
+#endif
 }
 
 /* this function must not close the FILE *desc, because in the destructor of the
@@ -218,6 +296,9 @@ void SniffJoke::setupDebug(void)
  * and the descriptor are closed with the process, after. */
 void SniffJoke::cleanDebug(void)
 {
+    /* the writer drains the ring before to stop */
+    debug.ring.stop();
+
     if (debug.logstream != NULL && debug.logstream != stdout)
         fflush(debug.logstream);
     if (debug.packet_logstream != NULL && debug.packet_logstream != stdout)
@@ -303,6 +384,17 @@ void SniffJoke::createSjEnvironment(void)
     autoptrList.instanced_plugins = reinterpret_cast<void *> (plugin_pool.get());
 }
 
+void SniffJoke::handleSignal(void)
+{
+    struct signalfd_siginfo siginfo;
+
+    while (read(signal_fd, &siginfo, sizeof (siginfo)) == sizeof (siginfo))
+    {
+        LOG_VERBOSE("received signal %u, going to shutdown", siginfo.ssi_signo);
+        alive = false;
+    }
+}
+
 void SniffJoke::handleAdminSocket(void)
 {
     char r_buf[MEDIUMBUF] = {0};
@@ -615,6 +707,38 @@ void SniffJoke::writeSJStatus(uint8_t commandReceived)
     else if (userconf->runcfg.blacklist)
         accumulen += appendSJStatus(&io_buf[accumulen], STAT_BLACKLIST, sizeof (userconf->runcfg.blacklist), userconf->runcfg.blacklist);
 
+    /* the mmap rings counters are present only when the ring is used */
+    struct netio_ring_stats ringstats;
+    mitm->ringStats(ringstats);
+
+    if (ringstats.rx_ring)
+    {
+        accumulen += appendSJStatus(&io_buf[accumulen], STAT_RXRING_USED, sizeof (ringstats.rx_blocks_used), ringstats.rx_blocks_used);
+        accumulen += appendSJStatus(&io_buf[accumulen], STAT_RXRING_SIZE, sizeof (ringstats.rx_blocks), ringstats.rx_blocks);
+        accumulen += appendSJStatus(&io_buf[accumulen], STAT_RXRING_DROPS, sizeof (ringstats.rx_drops), ringstats.rx_drops);
+    }
+
+    if (ringstats.tx_ring)
+    {
+        accumulen += appendSJStatus(&io_buf[accumulen], STAT_TXRING_USED, sizeof (ringstats.tx_frames_used), ringstats.tx_frames_used);
+        accumulen += appendSJStatus(&io_buf[accumulen], STAT_TXRING_SIZE, sizeof (ringstats.tx_frames), ringstats.tx_frames);
+        accumulen += appendSJStatus(&io_buf[accumulen], STAT_TXRING_DROPS, sizeof (ringstats.tx_drops), ringstats.tx_drops);
+    }
+
+    struct keep_wait_stats keepstats;
+    conntrack->keepWaitStats(keepstats);
+
+    accumulen += appendSJStatus(&io_buf[accumulen], STAT_KEEPWAIT, sizeof (keepstats.waits), (const char *) keepstats.waits);
+    accumulen += appendSJStatus(&io_buf[accumulen], STAT_KEEPEXPIRED, sizeof (keepstats.expired), keepstats.expired);
+
+    /* the buffers of the conntrack thread, this one */
+    const PacketPool &pool = PacketPool::buffers();
+    const uint32_t pool_drops = conntrack->poolDrops();
+
+    accumulen += appendSJStatus(&io_buf[accumulen], STAT_POOL_USED, sizeof (pool.in_use), pool.in_use);
+    accumulen += appendSJStatus(&io_buf[accumulen], STAT_POOL_SIZE, sizeof (uint32_t), pool.size());
+    accumulen += appendSJStatus(&io_buf[accumulen], STAT_POOL_DROPS, sizeof (pool_drops), pool_drops);
+
     retInfo.cmd_len = accumulen;
     retInfo.cmd_type = commandReceived;
     memcpy(io_buf, &retInfo, sizeof (retInfo));
@@ -628,7 +752,9 @@ void SniffJoke::writeSJTTLmap(uint8_t type)
     /* clean the buffer and fix the starting pointer */
     memset(io_buf, 0x00, sizeof (io_buf));
 
-    for (TTLFocusMap::iterator it = ttlfocus_map->begin(); it != ttlfocus_map->end(); ++it)
+    uint32_t index = 0;
+    TTLFocus *it;
+    while ((it = ttlfocus_map->getNext(index)) != NULL)
     {
         if (accumulen > sizeof (io_buf) - sizeof (struct ttl_record))
         {
@@ -636,7 +762,7 @@ void SniffJoke::writeSJTTLmap(uint8_t type)
             break;
         }
 
-        TTLFocus &TT = *((*it).second);
+        TTLFocus &TT = *it;
         accumulen += appendSJTTLInfo(&io_buf[accumulen], TT);
     }
 
@@ -653,7 +779,9 @@ void SniffJoke::writeSJInfoDump(uint8_t type)
     /* clean the buffer and fix the starting pointer */
     memset(io_buf, 0x00, sizeof (io_buf));
 
-    for (SessionTrackMap::iterator it = sessiontrack_map->begin(); it != sessiontrack_map->end(); ++it)
+    uint32_t index = 0;
+    const SessionTrack *Tracked;
+    while ((Tracked = sessiontrack_map->getNext(index)) != NULL)
     {
         if (accumulen > sizeof (io_buf) - sizeof (struct sex_record))
         {
@@ -661,8 +789,7 @@ void SniffJoke::writeSJInfoDump(uint8_t type)
             break;
         }
 
-        SessionTrack &Tracked = *((*it).second);
-        accumulen += appendSJSessionInfo(&io_buf[accumulen], Tracked);
+        accumulen += appendSJSessionInfo(&io_buf[accumulen], *Tracked);
     }
 
     retInfo.cmd_len = accumulen;
@@ -693,6 +820,19 @@ uint32_t SniffJoke::appendSJStatus(uint8_t *p, int32_t WHO, uint32_t len, uint16
     return len + sizeof (singleData);
 }
 
+uint32_t SniffJoke::appendSJStatus(uint8_t *p, int32_t WHO, uint32_t len, uint32_t value)
+{
+    struct single_block singleData;
+
+    singleData.len = len;
+    singleData.WHO = WHO;
+    memcpy(p, &singleData, sizeof (singleData));
+    p += sizeof (singleData);
+    memcpy(p, &value, len);
+
+    return len + sizeof (singleData);
+}
+
 uint32_t SniffJoke::appendSJStatus(uint8_t *p, int32_t WHO, uint32_t len, bool value)
 {
     struct single_block singleData;
@@ -741,10 +881,10 @@ uint32_t SniffJoke::appendSJTTLInfo(uint8_t *p, const TTLFocus &TT)
     struct ttl_record ttlr;
 
     ttlr.access = TT.access_timestamp;
-    ttlr.nextprobe = TT.next_probe_time;
+    ttlr.nextprobe = TT.probe->next_probe_time;
     ttlr.daddr = TT.daddr;
-    ttlr.sentprobe = TT.sent_probe;
-    ttlr.receivedprobe = TT.received_probe;
+    ttlr.sentprobe = TT.probe->sent_probe;
+    ttlr.receivedprobe = TT.probe->received_probe;
     ttlr.synackval = TT.ttl_synack;
     ttlr.ttlestimate = TT.ttl_estimate;
 
@@ -26,7 +26,7 @@
 #include "Utils.h"
 #include "UserConf.h"
 #include "Process.h"
-#include "NetIO.h"
+#include "PacketIO.h"
 #include "TCPTrack.h"
 #include "TTLFocus.h"
 #include "SessionTrack.h"
@@ -46,7 +46,7 @@ private:
     const sj_cmdline_opts &opts;
 
     auto_ptr<Process> proc;
-    auto_ptr<NetIO> mitm;
+    auto_ptr<PacketIO> mitm;
     auto_ptr<TCPTrack> conntrack;
 
     /* after detach:
@@ -55,6 +55,8 @@ private:
      */
     pid_t service_pid;
 
+    int signal_fd;
+
     int admin_socket;
     int admin_socket_flags_blocking;
     int admin_socket_flags_nonblocking;
@@ -65,12 +67,14 @@ private:
     /* used to make public the singleton to the plugins */
     struct sjEnviron autoptrList;
 
+    void runReplay(void);
     void updateClock(void);
     void setupDebug(void);
     void cleanDebug(void);
     void cleanServerRoot(void);
     void cleanServerUser(void);
     void setupAdminSocket(void);
+    void handleSignal(void);
     void handleAdminSocket(void);
     void createSjEnvironment(void);
 
@@ -98,6 +102,7 @@ private:
 
     /* called by writeSJ* functions = answer building */
     uint32_t appendSJStatus(uint8_t *, int32_t, uint32_t, uint16_t);
+    uint32_t appendSJStatus(uint8_t *, int32_t, uint32_t, uint32_t);
     uint32_t appendSJStatus(uint8_t *, int32_t, uint32_t, bool);
     uint32_t appendSJStatus(uint8_t *, int32_t, uint32_t, const char *);
     uint32_t appendSJPortBlock(uint8_t *, uint16_t, uint16_t, uint16_t);
@@ -27,16 +27,23 @@
 #include "SessionTrack.h"
 #include "TTLFocus.h"
 #include "PluginPool.h"
+#include "PacketPool.h"
+
+#include <new>
 
 extern auto_ptr<UserConf> userconf;
 extern auto_ptr<SessionTrackMap> sessiontrack_map;
 extern auto_ptr<TTLFocusMap> ttlfocus_map;
 extern auto_ptr<PluginPool> plugin_pool;
+extern auto_ptr<TimerWheel> timer_wheel;
 
-TCPTrack::TCPTrack()
+TCPTrack::TCPTrack() :
+pool_drops(0)
 {
     LOG_DEBUG("");
 
+    memset(&keep_stats, 0, sizeof (keep_stats));
+
     mangled_proto_mask = ICMP;
 
     if (!userconf->runcfg.no_tcp)
@@ -155,7 +162,7 @@ bool TCPTrack::percentage(uint32_t packet_number, uint16_t hackFrequency, uint16
 
     aggressivity_percentage = derivePercentage(packet_number, userFrequency);
 
-    return ( ((uint32_t) random() % 100) < aggressivity_percentage);
+    return ( ((uint32_t) sj_random() % 100) < aggressivity_percentage);
 }
 
 uint16_t TCPTrack::getUserFrequency(const Packet &pkt)
@@ -222,41 +229,62 @@ void TCPTrack::injectTTLProbe(TTLFocus &ttlfocus)
         ttlfocus.status = TTL_BRUTEFORCE;
         /* do not break, continue inside TTL_BRUTEFORCE */
     case TTL_BRUTEFORCE:
-        if (ttlfocus.sent_probe == userconf->runcfg.max_ttl_probe)
+        if (ttlfocus.probe->sent_probe == userconf->runcfg.max_ttl_probe)
         {
-            if (!ttlfocus.probe_timeout)
+            if (!ttlfocus.probe->probe_timeout)
             {
-                ttlfocus.probe_timeout = sj_clock + 2;
+                ttlfocus.probe->probe_timeout = sj_clock_msec + TTLPROBE_TIMEOUT;
+                timer_wheel->add(ttlfocus.probe->probe_timer, ttlfocus.probe->probe_timeout);
             }
-            else if (ttlfocus.probe_timeout < sj_clock)
+            else if (ttlfocus.probe->probe_timeout <= sj_clock_msec)
             {
                 ttlfocus.status = TTL_UNKNOWN;
-                ttlfocus.sent_probe = 0;
-                ttlfocus.received_probe = 0;
+                releaseKeepPackets(ttlfocus);
+                ttlfocus.probe->sent_probe = 0;
+                ttlfocus.probe->received_probe = 0;
                 ttlfocus.ttl_estimate = 0xFF;
                 ttlfocus.ttl_synack = 0;
-                ttlfocus.next_probe_time = sj_clock + TTLPROBE_RETRY_ON_UNKNOWN;
+                ttlfocus.probe->next_probe_time = sj_clock + TTLPROBE_RETRY_ON_UNKNOWN;
+                timer_wheel->add(ttlfocus.probe->probe_timer, sj_clock_msec + (uint64_t) TTLPROBE_RETRY_ON_UNKNOWN * 1000);
+            }
+            else
+            {
+                /* the probe_timeout has been extended by an ICMP expired */
+                timer_wheel->add(ttlfocus.probe->probe_timer, ttlfocus.probe->probe_timeout);
             }
             break;
         }
         else
         {
-            ++ttlfocus.sent_probe;
-            injpkt = new Packet(ttlfocus.probe_dummy, sizeof (ttlfocus.probe_dummy));
+            try
+            {
+                injpkt = new Packet(ttlfocus.probe->probe_dummy, sizeof (ttlfocus.probe->probe_dummy));
+            }
+            catch (bad_alloc &e)
+            {
+                /* the pool is exhausted: the probe is retried in the next cycle */
+                ++pool_drops;
+                ttlfocus.probe->next_probe_time = sj_clock;
+                timer_wheel->add(ttlfocus.probe->probe_timer, sj_clock_msec);
+                break;
+            }
+
+            ++ttlfocus.probe->sent_probe;
             injpkt->source = TRACEROUTE;
             injpkt->wtf = INNOCENT;
-            injpkt->ip->id = htons((ttlfocus.rand_key % 64) + ttlfocus.sent_probe);
-            injpkt->ip->ttl = ttlfocus.sent_probe;
-            injpkt->tcp->seq = htonl(ttlfocus.rand_key + ttlfocus.sent_probe);
+            injpkt->ip->id = htons((ttlfocus.probe->rand_key % 64) + ttlfocus.probe->sent_probe);
+            injpkt->ip->ttl = ttlfocus.probe->sent_probe;
+            injpkt->tcp->seq = htonl(ttlfocus.probe->rand_key + ttlfocus.probe->sent_probe);
 
             injpkt->fixIPTCPSum();
             p_queue.insert(*injpkt, SEND);
 
             /* the next ttl probe schedule is forced in the next cycle */
-            ttlfocus.next_probe_time = sj_clock;
+            ttlfocus.probe->next_probe_time = sj_clock;
+            timer_wheel->add(ttlfocus.probe->probe_timer, sj_clock_msec);
 
             injpkt->SELFLOG("TTL_BRUTEFORCE #sent|%u ttl_estimate|%u",
-                            ttlfocus.sent_probe, ttlfocus.ttl_estimate);
+                            ttlfocus.probe->sent_probe, ttlfocus.ttl_estimate);
             break;
         }
     case TTL_KNOWN:
@@ -266,18 +294,36 @@ void TCPTrack::injectTTLProbe(TTLFocus &ttlfocus)
 }
 
 /*
- * verifies the need of ttl probes for active destinations
+ * handles the timers expired: the ttl probes of the destinations and
+ * the expiry of the sessions and of the destinations.
  */
-void TCPTrack::execTTLBruteforces(void)
+void TCPTrack::handleTimers(void)
 {
-    for (TTLFocusMap::iterator it = ttlfocus_map->begin(); it != ttlfocus_map->end(); ++it)
+    timer_wheel->advance(sj_clock_msec);
+
+    Timer *timer;
+    while ((timer = timer_wheel->getExpired()) != NULL)
     {
-        TTLFocus &ttlfocus = *((*it).second);
-        if ((ttlfocus.status != TTL_KNOWN) /* 1) the ttl is BRUTEFORCE or UNKNOWN */
-                && (ttlfocus.access_timestamp > (sj_clock - 30)) /* 2) the destination it's used in the last 30 seconds */
-                && (ttlfocus.next_probe_time <= sj_clock)) /* 3) the next probe time it's passed */
+        switch (timer->event)
+        {
+        case TIMER_TTLPROBE:
         {
-            injectTTLProbe(*(*it).second);
+            TTLFocus &ttlfocus = ttlfocus_map->getFromProbe(*((TTLFocusProbe *) timer->context));
+
+            /* the ttl is BRUTEFORCE or UNKNOWN, and the destination it's used in the last 30 seconds;
+             * on a destination unused the timer is armed again by TTLFocusMap::get() */
+            if (ttlfocus.status != TTL_KNOWN && ttlfocus.access_timestamp > (sj_clock - 30))
+                injectTTLProbe(ttlfocus);
+            break;
+        }
+        case TIMER_SESSIONTRACK_EXPIRY:
+            sessiontrack_map->manage();
+            break;
+        case TIMER_TTLFOCUS_EXPIRY:
+            ttlfocus_map->manage();
+            break;
+        default:
+            RUNTIME_EXCEPTION("FATAL CODE [T1CK T0CK]: please send a notification to the developers");
         }
     }
 }
@@ -289,7 +335,7 @@ void TCPTrack::execTTLBruteforces(void)
  * the function returns TRUE if the packet has been identified as an answer to
  * the ttlbruteforce session and has to be removed.
  *
- * in this function we call the find() method of std::map because
+ * in this function we call the find() method of TTLFocusMap because
  * we want to test the ttl existence and NEVER NEVER NEVER create a new one
  * to not permit an external packet to force us to activate a ttlbrouteforce session.
  *
@@ -297,7 +343,6 @@ void TCPTrack::execTTLBruteforces(void)
  */
 bool TCPTrack::extractTTLinfo(const Packet &incompkt)
 {
-    TTLFocusMap::iterator it;
     TTLFocus *ttlfocus;
 
     /* if the pkt is an ICMP TIME_EXCEEDED should contain informations useful for
@@ -312,30 +357,28 @@ bool TCPTrack::extractTTLinfo(const Packet &incompkt)
             return false;
 
         /* if is not tracked, the user is making a tcptraceroute */
-        if ((it = ttlfocus_map->find(badiph->daddr)) == ttlfocus_map->end())
+        if ((ttlfocus = ttlfocus_map->find(badiph->daddr)) == NULL)
             return false;
 
-        ttlfocus = it->second;
-
-        const uint8_t expired_ttl = ntohs(badiph->id) - (ttlfocus->rand_key % 64);
-        const uint8_t exp_double_check = ntohl(badtcph->seq) - ttlfocus->rand_key;
+        const uint8_t expired_ttl = ntohs(badiph->id) - (ttlfocus->probe->rand_key % 64);
+        const uint8_t exp_double_check = ntohl(badtcph->seq) - ttlfocus->probe->rand_key;
 
         if (expired_ttl == exp_double_check)
         {
             if (ttlfocus->status == TTL_BRUTEFORCE)
             {
                 incompkt.SELFLOG("incoming ICMP EXPIRED puppet|%d expired|%d",
-                                 ttlfocus->puppet_port, expired_ttl);
+                                 ttlfocus->probe->puppet_port, expired_ttl);
 
-                ttlfocus->received_probe++;
+                ttlfocus->probe->received_probe++;
 
                 /*
                  * every time a time exceded it's received. if the MAXTTLPROBE has
-                 * been reached (ttlfocus->probe_timeout != 0), the probe_timeout
+                 * been reached (ttlfocus->probe->probe_timeout != 0), the probe_timeout
                  * it's resetted.
                  */
-                if (ttlfocus->probe_timeout)
-                    ttlfocus->probe_timeout = sj_clock + 2;
+                if (ttlfocus->probe->probe_timeout)
+                    ttlfocus->probe->probe_timeout = sj_clock_msec + TTLPROBE_TIMEOUT;
 
                 if (expired_ttl >= ttlfocus->ttl_estimate)
                 {
@@ -346,6 +389,7 @@ bool TCPTrack::extractTTLinfo(const Packet &incompkt)
                      */
                     ttlfocus->status = TTL_UNKNOWN;
                     ttlfocus->ttl_estimate = expired_ttl + 1;
+                    releaseKeepPackets(*ttlfocus);
                 }
             }
 
@@ -356,13 +400,11 @@ bool TCPTrack::extractTTLinfo(const Packet &incompkt)
     }
 
     /* a tracked TCP packet contains important TTL informations */
-    if ((incompkt.proto != TCP || (it = ttlfocus_map->find(incompkt.ip->saddr)) == ttlfocus_map->end()))
+    if ((incompkt.proto != TCP || (ttlfocus = ttlfocus_map->find(incompkt.ip->saddr)) == NULL))
         return false;
 
-    ttlfocus = it->second;
-
     /* a SYN ACK will be the answer at our probe! */
-    if (incompkt.tcp->syn && incompkt.tcp->ack && (incompkt.tcp->dest == htons(ttlfocus->puppet_port)))
+    if (incompkt.tcp->syn && incompkt.tcp->ack && (incompkt.tcp->dest == htons(ttlfocus->probe->puppet_port)))
     {
         if (ttlfocus->status != TTL_BRUTEFORCE)
         {
@@ -375,14 +417,14 @@ bool TCPTrack::extractTTLinfo(const Packet &incompkt)
          * if the received packet matches the puppet port used for the current
          * ttlbruteforce session we can discern the ttl as:
          *
-         *     unsigned char discern_ttl =  ntohl(pkt.tcp->ack_seq) - ttlfocus->rand_key - 1;
+         *     unsigned char discern_ttl =  ntohl(pkt.tcp->ack_seq) - ttlfocus->probe->rand_key - 1;
          *
          * this because the sequence number used in the TTL bruteforce has hardcoded the
          * number of the TTL.
          */
-        uint8_t discern_ttl = ntohl(incompkt.tcp->ack_seq) - ttlfocus->rand_key - 1;
+        uint8_t discern_ttl = ntohl(incompkt.tcp->ack_seq) - ttlfocus->probe->rand_key - 1;
 
-        ++ttlfocus->received_probe;
+        ++ttlfocus->probe->received_probe;
 
         if (discern_ttl < ttlfocus->ttl_estimate)
         {
@@ -391,11 +433,12 @@ bool TCPTrack::extractTTLinfo(const Packet &incompkt)
         }
 
         ttlfocus->status = TTL_KNOWN;
+        releaseKeepPackets(*ttlfocus);
 
         incompkt.SELFLOG("incoming SYN/ACK puppet|%d ttl_estimate|%d ttl_synack|%d",
-                         ttlfocus->puppet_port, ttlfocus->ttl_estimate, ttlfocus->ttl_synack);
+                         ttlfocus->probe->puppet_port, ttlfocus->ttl_estimate, ttlfocus->ttl_synack);
         ttlfocus->SELFLOG("incoming SYN/ACK puppet|%d ttl_estimate|%d ttl_synack|%d",
-                          ttlfocus->puppet_port, ttlfocus->ttl_estimate, ttlfocus->ttl_synack);
+                          ttlfocus->probe->puppet_port, ttlfocus->ttl_estimate, ttlfocus->ttl_synack);
 
         return true;
     }
@@ -434,7 +477,15 @@ bool TCPTrack::notifyIncoming(Packet &origpkt)
     {
         PluginTrack *pt = *it;
 
-        pt->selfObj->mangleIncoming(origpkt);
+        try
+        {
+            pt->selfObj->mangleIncoming(origpkt);
+        }
+        catch (bad_alloc &e)
+        {
+            dropHacks(*pt->selfObj);
+            continue;
+        }
 
         /* it will be rare for a hack mangleIncoming to generate one or more packet, anyway we keep this possibility possible */
         for (vector<Packet*>::iterator hack_it = pt->selfObj->pktVector.begin(); hack_it < pt->selfObj->pktVector.end(); ++hack_it)
@@ -505,8 +556,10 @@ bool TCPTrack::injectHack(Packet &origpkt)
      */
     uint8_t availableScrambles = discernAvailScramble(origpkt);
 
-    char availableScramblesStr[LARGEBUF] = {0};
-    snprintfScramblesList(availableScramblesStr, sizeof (availableScramblesStr), availableScrambles);
+    /* the string is used only by the packet log */
+    char availableScramblesStr[LARGEBUF];
+    if (debug.enabled(PACKET_LEVEL))
+        snprintfScramblesList(availableScramblesStr, sizeof (availableScramblesStr), availableScrambles);
 
     /* SELECT APPLICABLE HACKS, the selection are base on:
      * 1) the plugin/hacks detect if the condition exists (eg: the hack wants a SYN and the packet is a RST+ACK)
@@ -521,7 +574,7 @@ bool TCPTrack::injectHack(Packet &origpkt)
          * more specific ones related to the origpkt will be checked in
          * the condition function implemented by a specific hack.
          */
-        if ((!(availableScrambles & pt->selfObj->supportedScrambles)) && (userconf->runcfg.debug_level == PACKET_LEVEL))
+        if ((!(availableScrambles & pt->selfObj->supportedScrambles)) && (debug.enabled(PACKET_LEVEL)))
         {
             char pluginavaileScrambStr[LARGEBUF] = {0};
 
@@ -541,11 +594,11 @@ bool TCPTrack::injectHack(Packet &origpkt)
             applicable_hacks.push_back(pt);
     }
 
-    if (!applicable_hacks.size() && (userconf->runcfg.debug_level == PACKET_LEVEL))
+    if (!applicable_hacks.size() && (debug.enabled(PACKET_LEVEL)))
         origpkt.SELFLOG("NONE hack plugin has been passed the selection!");
 
     /* -- RANDOMIZE HACKS APPLICATION */
-    random_shuffle(applicable_hacks.begin(), applicable_hacks.end());
+    random_shuffle(applicable_hacks.begin(), applicable_hacks.end(), sj_random_below);
 
     /* -- FINALLY, HACK THE CHOOSEN PACKET(S) */
     for (vector<PluginTrack *>::iterator it = applicable_hacks.begin(); it != applicable_hacks.end(); ++it)
@@ -556,7 +609,15 @@ bool TCPTrack::injectHack(Packet &origpkt)
         origpkt.SELFLOG("from %d avail plugins, %d has been selected: applying plugin [%s]", 
                         plugin_pool->pool.size(), applicable_hacks.size(), pt->selfObj->pluginName);
 
-        pt->selfObj->apply(origpkt, availableScrambles);
+        try
+        {
+            pt->selfObj->apply(origpkt, availableScrambles);
+        }
+        catch (bad_alloc &e)
+        {
+            dropHacks(*pt->selfObj);
+            continue;
+        }
 
         for (vector<Packet*>::iterator hack_it = pt->selfObj->pktVector.begin(); hack_it < pt->selfObj->pktVector.end(); ++hack_it)
         {
@@ -601,7 +662,7 @@ bool TCPTrack::injectHack(Packet &origpkt)
                 p_queue.insertAfter(injpkt, origpkt);
                 break;
             case ANY_POSITION:
-                if (random() % 2)
+                if (sj_random() % 2)
                     p_queue.insertBefore(injpkt, origpkt);
                 else
                     p_queue.insertAfter(injpkt, origpkt);
@@ -654,14 +715,14 @@ bool TCPTrack::lastPktFix(Packet &pkt)
         /* WHAT VALUE OF TTL GIVE TO THE PACKET ? */
         if (pkt.wtf == PRESCRIPTION)
         {
-            pkt.ip->ttl = ttlfocus.ttl_estimate - (1 + (random() % 2)); /* [-1, -2], 2 values */
+            pkt.ip->ttl = ttlfocus.ttl_estimate - (1 + (sj_random() % 2)); /* [-1, -2], 2 values */
         }
         else
         {
             /* MISTIFICATION FOR WTF != PRESCRIPTION */
             /* apply mystification if PRESCRIPTION is globally enabled */
             if (ISSET_TTL(plugin_pool->enabledScrambles()))
-                pkt.ip->ttl = ttlfocus.ttl_estimate + (random() % 4); /* [+0, +3], 4 values */
+                pkt.ip->ttl = ttlfocus.ttl_estimate + (sj_random() % 4); /* [+0, +3], 4 values */
         }
     }
     else
@@ -690,7 +751,7 @@ bool TCPTrack::lastPktFix(Packet &pkt)
             /* MISTIFICATION APPLY ON DOWNGRADE, RANDOMIZING A BIT THE ORIGINAL TTL VALUE */
             /* apply mystification if PRESCRIPTION is globally enabled */
             if (ISSET_TTL(plugin_pool->enabledScrambles()))
-                pkt.ip->ttl += (random() % 20) - 10; /* [-10, +10 ], 20 mystification values */
+                pkt.ip->ttl += (sj_random() % 20) - 10; /* [-10, +10 ], 20 mystification values */
         }
     }
 
@@ -835,6 +896,80 @@ drop_packet:
  *
  *   any other pkt->source does scatter a fatal exception.
  */
+/*
+ * with the tun in GSO mode the kernel hands us TCP super-packets up to 64KB,
+ * tracked as a single packet up to here. completeOffload cuts a super-packet
+ * in gso_size segments, placed in the queue where the super-packet was, and
+ * drops it. the segments have the checksum to be completed, done by
+ * lastPktFix for the hacked ones or by readpacket for the others.
+ * with the packet pool exhausted the super-packet is dropped, keeping the
+ * segments already cut. returns the number of packets replacing the one
+ * received.
+ */
+uint32_t TCPTrack::completeOffload(Packet &pkt)
+{
+    if (!pkt.gso_size || pkt.proto != TCP || pkt.tcppayloadlen <= pkt.gso_size)
+    {
+        pkt.gso_size = 0;
+        return 1;
+    }
+
+    const uint16_t hdrslen = pkt.iphdrlen + pkt.tcphdrlen;
+    const uint16_t mss = pkt.gso_size;
+    const uint32_t seq = ntohl(pkt.tcp->seq);
+    const uint16_t id = ntohs(pkt.ip->id);
+
+    /* every segment is written once in its pool buffer: the headers, then its slice of payload */
+    uint32_t segments = 0;
+    try
+    {
+        for (uint32_t offset = 0; offset < pkt.tcppayloadlen; offset += mss, ++segments)
+        {
+            const uint16_t seglen = (pkt.tcppayloadlen - offset > mss) ? mss : pkt.tcppayloadlen - offset;
+            const bool last = (offset + seglen == pkt.tcppayloadlen);
+
+            PacketBuffer segbuf;
+            segbuf.reserve(hdrslen + seglen);
+            memcpy(segbuf.begin(), &(pkt.pbuf[0]), hdrslen);
+            memcpy(segbuf.begin() + hdrslen, pkt.tcppayload + offset, seglen);
+
+            Packet * const seg = new Packet(segbuf, 0, hdrslen + seglen);
+            seg->source = pkt.source;
+            seg->wtf = pkt.wtf;
+            seg->choosableScramble = pkt.choosableScramble;
+            seg->needs_csum = true;
+
+            /* the same rules of the kernel TSO: CWR on the first, FIN and PSH on the last */
+            seg->ip->tot_len = htons(hdrslen + seglen);
+            seg->ip->id = htons(id + segments);
+            seg->tcp->seq = htonl(seq + offset);
+            if (offset)
+                seg->tcp->res2 &= 0x1; /* res2 keeps ECE and CWR: CWR is cleared */
+            if (!last)
+            {
+                seg->tcp->fin = 0;
+                seg->tcp->psh = 0;
+            }
+
+            p_queue.insertBefore(*seg, pkt);
+        }
+    }
+    catch (bad_alloc &e)
+    {
+        /* the segments cut are complete packets: only the rest of the payload is lost, TCP retransmits it */
+        pkt.SELFLOG("super-packet dropped after %u segments of %u bytes: packet pool exhausted", segments, mss);
+        ++pool_drops;
+        p_queue.drop(pkt);
+
+        return segments;
+    }
+
+    pkt.SELFLOG("super-packet cut in %u segments of %u bytes", segments, mss);
+    p_queue.drop(pkt);
+
+    return segments;
+}
+
 void TCPTrack::handleYoungPackets(void)
 {
     Packet *pkt = NULL;
@@ -887,9 +1022,12 @@ void TCPTrack::handleYoungPackets(void)
                  * due to the actual ttl bruteforce implementation a
                  * pure UDP flaw could go in starvation.
                  */
-                if (pkt->proto == TCP && ttlfocus_map->get(*pkt).status == TTL_BRUTEFORCE)
+                TTLFocus &ttlfocus = ttlfocus_map->get(*pkt);
+                if (pkt->proto == TCP && ttlfocus.status == TTL_BRUTEFORCE)
                 {
+                    pkt->keep_timestamp = sj_clock_msec;
                     p_queue.insert(*pkt, KEEP);
+                    ttlfocus.probe->keep_packets.push(*pkt);
                 }
                 else
                 {
@@ -899,6 +1037,7 @@ void TCPTrack::handleYoungPackets(void)
             else
             {
                 p_queue.insert(*pkt, SEND);
+                completeOffload(*pkt);
             }
             break;
 
@@ -909,25 +1048,92 @@ void TCPTrack::handleYoungPackets(void)
     }
 }
 
+/*
+ * here we release the KEEP packets of a destination
+ *
+ * the TUNNEL packets held in KEEP are waiting for the end of the ttl bruteforce
+ * of their destination; every ttlfocus chains its packets, so
+ * when its status leaves TTL_BRUTEFORCE they are moved in HACK in the order
+ * they have been received, without checking the packets of the other
+ * destinations.
+ */
+void TCPTrack::releaseKeepPackets(TTLFocus &ttlfocus)
+{
+    while (!ttlfocus.probe->keep_packets.empty())
+    {
+        Packet * const pkt = ttlfocus.probe->keep_packets.pop();
+
+        accountKeepWait(*pkt);
+        p_queue.insert(*pkt, HACK);
+    }
+}
+
 /*
  * here we analyze KEEP queue
  *
- * we handle only:
+ * a packet can't wait the end of the bruteforce more than max_keep_time:
+ * an expired packet is moved in HACK while its destination is still in
+ * TTL_BRUTEFORCE, so discernAvailScramble does not offer SCRAMBLE_TTL for it
+ * and lastPktFix downgrades to MALFORMED or GUILTY the PRESCRIPTION hacks.
  *
- *   TUNNEL packets:
- *     - we analyze tcp/udp packets to see if can marked sendable or if they
- *       need to be hold in status KEEP waiting for some conditions.
+ * KEEP is in insertion order, so the walk ends at the first packet not expired;
+ * for the same reason an expired packet is always the first of its ttlfocus list.
  *
- *   any other pkt->source does scatter a fatal exception.
+ * the packets of a destination evicted by a TTLFocusMap full of destinations
+ * with packets in KEEP are released in the same way, before the walk.
  */
 void TCPTrack::handleKeepPackets(void)
 {
     Packet *pkt = NULL;
-    for (p_queue.select(KEEP); ((pkt = p_queue.getSource(TUNNEL)) != NULL);)
+
+    while (!ttlfocus_map->evicted_keep.empty())
     {
-        if (ttlfocus_map->get(*pkt).status != TTL_BRUTEFORCE)
-            p_queue.insert(*pkt, HACK);
+        pkt = ttlfocus_map->evicted_keep.pop();
+
+        pkt->SELFLOG("KEEP destination evicted after %u ms: released without SCRAMBLE_TTL",
+                     (uint32_t) (sj_clock_msec - pkt->keep_timestamp));
+
+        ++keep_stats.expired;
+        accountKeepWait(*pkt);
+        p_queue.insert(*pkt, HACK);
     }
+
+    if (!userconf->runcfg.max_keep_time)
+        return;
+    for (p_queue.select(KEEP); ((pkt = p_queue.get()) != NULL);)
+    {
+        if (pkt->keep_timestamp + userconf->runcfg.max_keep_time > sj_clock_msec)
+            break;
+
+        TTLFocus *ttlfocus = ttlfocus_map->find(pkt->ip->daddr);
+        if (ttlfocus == NULL || ttlfocus->probe->keep_packets.front() != pkt)
+            RUNTIME_EXCEPTION("FATAL CODE [K33PW41T]: please send a notification to the developers");
+
+        ttlfocus->probe->keep_packets.pop();
+
+        pkt->SELFLOG("KEEP expired after %u ms: released without SCRAMBLE_TTL",
+                     (uint32_t) (sj_clock_msec - pkt->keep_timestamp));
+
+        ++keep_stats.expired;
+        accountKeepWait(*pkt);
+        p_queue.insert(*pkt, HACK);
+    }
+}
+
+void TCPTrack::accountKeepWait(const Packet &pkt)
+{
+    const uint64_t wait = sj_clock_msec - pkt.keep_timestamp;
+    uint8_t bucket = 0;
+
+    while (bucket < KEEPWAIT_BUCKETS - 1 && wait >= (1U << bucket))
+        ++bucket;
+
+    ++keep_stats.waits[bucket];
+}
+
+void TCPTrack::keepWaitStats(struct keep_wait_stats &stats) const
+{
+    stats = keep_stats;
 }
 
 /*
@@ -944,9 +1150,22 @@ void TCPTrack::handleKeepPackets(void)
  */
 void TCPTrack::handleHackPackets(void)
 {
-    /* for every packet in HACK queue we insert some random hacks */
-
     Packet *pkt = NULL;
+
+    /* the GSO super-packets are cut once, before the hacks are applied to the segments */
+    if (userconf->runcfg.tun_gso)
+    {
+        for (p_queue.select(HACK); ((pkt = p_queue.getSource(TUNNEL)) != NULL);)
+        {
+            if (pkt->gso_size)
+            {
+                SessionTrack &sessiontrack = sessiontrack_map->get(*pkt);
+                sessiontrack.packet_number += completeOffload(*pkt) - 1;
+            }
+        }
+    }
+
+    /* for every packet in HACK queue we insert some random hacks */
     for (p_queue.select(HACK); ((pkt = p_queue.getSource(TUNNEL)) != NULL);)
     {
         if (!lastPktFix(*pkt))
@@ -981,44 +1200,120 @@ void TCPTrack::handleHackPackets(void)
         p_queue.insert(*pkt, SEND);
 }
 
+/*
+ * the packets read are dropped when the pool has no more than
+ * PACKETPOOL_RESERVE free slots: the reserve is left to the hacks, the
+ * ttl probes and the GSO segments of the packets already in the queue.
+ */
+bool TCPTrack::poolAdmits(void)
+{
+    if (PacketPool::objects().available() > PACKETPOOL_RESERVE && PacketPool::buffers().available() > PACKETPOOL_RESERVE)
+        return true;
+
+    if (!pool_drops++)
+        LOG_ALL("packet pool under the reserve of %u slots: dropping the packets read", PACKETPOOL_RESERVE);
+
+    return false;
+}
+
+/* a plugin interrupted by an exhausted pool: its packets are dropped */
+void TCPTrack::dropHacks(Plugin &plugin)
+{
+    for (vector<Packet*>::iterator it = plugin.pktVector.begin(); it != plugin.pktVector.end(); ++it)
+        delete *it;
+
+    ++pool_drops;
+    plugin.reset();
+}
+
+uint32_t TCPTrack::poolDrops(void) const
+{
+    return pool_drops;
+}
+
+/* a reader of the packets unable to get a buffer from the pool */
+void TCPTrack::countPoolDrop(void)
+{
+    ++pool_drops;
+}
+
 /* the packet is added in the packet queue here to be analyzed in a second time */
-void TCPTrack::writepacket(source_t source, const unsigned char *buff, int nbyte)
+void TCPTrack::queueOrigPacket(Packet &pkt, source_t source, uint16_t gso_size, bool needs_csum)
 {
-    try
+    pkt.source = source;
+    pkt.wtf = INNOCENT;
+    pkt.choosableScramble = INNOCENT; /* on innocent pkts this variable is meaningless */
+    pkt.gso_size = gso_size;
+    pkt.needs_csum = needs_csum;
+    pkt.trustSum();
+
+    /* Sniffjoke does handle only TCP, UDP and ICMP */
+    if (userconf->runcfg.active && (pkt.proto & mangled_proto_mask))
     {
-        Packet * const pkt = new Packet(buff, nbyte);
-        pkt->source = source;
-        pkt->wtf = INNOCENT;
-        pkt->choosableScramble = INNOCENT; /* on innocent pkts this variable is meaningless */
-
-        /* Sniffjoke does handle only TCP, UDP and ICMP */
-        if (userconf->runcfg.active && (pkt->proto & mangled_proto_mask))
+        if (userconf->runcfg.use_blacklist)
         {
-            if (userconf->runcfg.use_blacklist)
+            if (userconf->runcfg.blacklist->isPresent(pkt.ip->daddr) ||
+                    userconf->runcfg.blacklist->isPresent(pkt.ip->saddr))
             {
-                if (userconf->runcfg.blacklist->isPresent(pkt->ip->daddr) ||
-                        userconf->runcfg.blacklist->isPresent(pkt->ip->saddr))
-                {
-                    p_queue.insert(*pkt, SEND);
-                    return;
-                }
+                p_queue.insert(pkt, SEND);
+                completeOffload(pkt);
+                return;
             }
-            else if (userconf->runcfg.use_whitelist)
+        }
+        else if (userconf->runcfg.use_whitelist)
+        {
+            if (!userconf->runcfg.whitelist->isPresent(pkt.ip->daddr) &&
+                    !userconf->runcfg.whitelist->isPresent(pkt.ip->saddr))
             {
-                if (!userconf->runcfg.whitelist->isPresent(pkt->ip->daddr) &&
-                        !userconf->runcfg.whitelist->isPresent(pkt->ip->saddr))
-                {
-                    p_queue.insert(*pkt, SEND);
-                    return;
-                }
+                p_queue.insert(pkt, SEND);
+                completeOffload(pkt);
+                return;
             }
-
-            p_queue.insert(*pkt, YOUNG);
-            return;
         }
 
-        p_queue.insert(*pkt, SEND);
+        p_queue.insert(pkt, YOUNG);
+        return;
+    }
+
+    p_queue.insert(pkt, SEND);
+    completeOffload(pkt);
+}
+
+void TCPTrack::writepacket(source_t source, const unsigned char *buff, int nbyte, uint16_t gso_size, bool needs_csum)
+{
+    if (!poolAdmits())
+        return;
+
+    try
+    {
+        queueOrigPacket(*new Packet(buff, nbyte), source, gso_size, needs_csum);
+    }
+    catch (bad_alloc &e)
+    {
+        /* bigger than a pool buffer, or the pool is exhausted */
+        ++pool_drops;
+    }
+    catch (exception &e)
+    {
+        /* anomalous/malformed packets are flushed bypassing the queue */
+        LOG_ALL("malformed orig pkt dropped: %s", e.what());
+    }
+}
+
+/* the packet takes the buffer of the reader: nbyte bytes at offset */
+void TCPTrack::writepacket(source_t source, PacketBuffer &readbuf, uint16_t offset, int nbyte, uint16_t gso_size, bool needs_csum)
+{
+    /* a packet dropped leaves its buffer to the reader */
+    if (!poolAdmits())
+        return;
 
+    try
+    {
+        queueOrigPacket(*new Packet(readbuf, offset, nbyte), source, gso_size, needs_csum);
+    }
+    catch (bad_alloc &e)
+    {
+        ++pool_drops;
     }
     catch (exception &e)
     {
@@ -1032,23 +1327,33 @@ void TCPTrack::writepacket(source_t source, const unsigned char *buff, int nbyte
  */
 Packet * TCPTrack::readpacket(source_t destsource)
 {
-    uint8_t mask;
-    if (destsource == NETWORK)
-        mask = NETWORK;
-    else
-        mask = TUNNEL | PLUGIN | TRACEROUTE;
+    Packet * const pkt = p_queue.popSend(destsource);
 
-    Packet *pkt = NULL;
-    for (p_queue.select(SEND); ((pkt = p_queue.get()) != NULL);)
+    if (pkt != NULL && pkt->needs_csum)
+        pkt->fixSum();
+
+    return pkt;
+}
+
+/*
+ * readpacketBurst works like readpacket but extracts up to maxpkts packets
+ * at once, keeping their relative order.
+ * it's used by NetIO in batch mode to fill a sendmmsg vector.
+ */
+uint32_t TCPTrack::readpacketBurst(source_t destsource, Packet **pkts, uint32_t maxpkts)
+{
+    uint32_t count = 0;
+    Packet *pkt;
+
+    while (count < maxpkts && (pkt = p_queue.popSend(destsource)) != NULL)
     {
-        if (pkt->source & mask)
-        {
-            p_queue.extract(*pkt);
-            return pkt;
-        }
+        if (pkt->needs_csum)
+            pkt->fixSum();
+
+        pkts[count++] = pkt;
     }
 
-    return NULL;
+    return count;
 }
 
 void TCPTrack::analyzePacketQueue(void)
@@ -1064,19 +1369,39 @@ void TCPTrack::analyzePacketQueue(void)
 bypass_queue_analysis:
 
     /*
-     * here we call sessiontrack_map and ttlfocus_map manage routines.
-     * it's fundamental to do this here after HACK last_packet_HACK()
-     * and before ttl probes injections.
-     * In fact the two routine, in case that their respective memory threshold
-     * limits are passed, will delete the oldest records.
-     * This is completely safe because send packets are just HACKed and there
-     * is no problem if we does not schedule a ttlprobe for a cycle;
-     * KEEP packets will scatter a new ttlfocus at the next.
+     * here we handle the timers: the sessiontrack_map and ttlfocus_map
+     * expiries and the ttl probes injections.
+     * it's fundamental to do this here after HACK last_packet_HACK():
+     * the expiries delete the oldest records. This is completely safe
+     * because send packets are just HACKed; the ttlfocus with packets
+     * in KEEP are never deleted.
      */
 
-    sessiontrack_map->manage();
-    ttlfocus_map->manage();
+    handleTimers();
+}
+
+/*
+ * the time (sj_clock_msec based) when analyzePacketQueue has some work to do
+ * also without traffic, 0 when there is none. NetIO arms its timer on it.
+ */
+uint64_t TCPTrack::nextDeadline(void)
+{
+    /* the KEEP packets of an evicted destination are released in the next cycle */
+    if (!ttlfocus_map->evicted_keep.empty())
+        return sj_clock_msec;
+
+    uint64_t deadline = timer_wheel->nextExpiry();
+
+    /* the first packet in KEEP is the first to expire */
+    if (userconf->runcfg.max_keep_time)
+    {
+        p_queue.select(KEEP);
+
+        const Packet * const pkt = p_queue.get();
+        if (pkt != NULL && (!deadline || pkt->keep_timestamp + userconf->runcfg.max_keep_time < deadline))
+            deadline = pkt->keep_timestamp + userconf->runcfg.max_keep_time;
+    }
 
-    execTTLBruteforces();
+    return deadline;
 }
 
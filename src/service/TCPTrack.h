@@ -34,6 +34,13 @@
 #include "HDRoptions.h"
 #include "PluginPool.h"
 
+/* the waits of the packets released from KEEP, shown by "sniffjokectl stat" */
+struct keep_wait_stats
+{
+    uint32_t waits[KEEPWAIT_BUCKETS]; /* bucket i counts the waits < 2^i ms, the last the longer */
+    uint32_t expired; /* packets released before the end of the bruteforce: by max_keep_time, or evicted */
+};
+
 class TCPTrack
 {
 private:
@@ -43,20 +50,32 @@ private:
     PacketFilter packet_filter;
     PacketQueue p_queue;
 
+    struct keep_wait_stats keep_stats;
+
+    /* packets and hacks dropped with the packet pool near to exhaustion */
+    uint32_t pool_drops;
+
     uint32_t derivePercentage(uint32_t, uint16_t);
     bool percentage(uint32_t, uint16_t, uint16_t);
     uint16_t getUserFrequency(const Packet &);
     uint8_t discernAvailScramble(const Packet &);
 
     void injectTTLProbe(TTLFocus &);
-    void execTTLBruteforces(void);
+    void handleTimers(void);
     bool extractTTLinfo(const Packet &);
 
     bool notifyIncoming(Packet &);
     bool injectHack(Packet &);
     bool lastPktFix(Packet &);
 
+    uint32_t completeOffload(Packet &);
+    bool poolAdmits(void);
+    void queueOrigPacket(Packet &, source_t, uint16_t, bool);
+    void dropHacks(Plugin &);
+
     void handleYoungPackets(void);
+    void accountKeepWait(const Packet &);
+    void releaseKeepPackets(TTLFocus &);
     void handleKeepPackets(void);
     void handleHackPackets(void);
 
@@ -65,9 +84,15 @@ public:
     TCPTrack(void);
     ~TCPTrack(void);
 
-    void writepacket(source_t, const unsigned char *, int);
+    void writepacket(source_t, const unsigned char *, int, uint16_t = 0, bool = false);
+    void writepacket(source_t, PacketBuffer &, uint16_t, int, uint16_t = 0, bool = false);
     Packet* readpacket(source_t);
+    uint32_t readpacketBurst(source_t, Packet **, uint32_t);
     void analyzePacketQueue(void);
+    uint64_t nextDeadline(void);
+    void keepWaitStats(struct keep_wait_stats &) const;
+    uint32_t poolDrops(void) const;
+    void countPoolDrop(void);
 };
 
 #endif /* SJ_TCPTRACK_H */
@@ -22,22 +22,21 @@
 
 #include "TTLFocus.h"
 
-TTLFocus::TTLFocus(const Packet &pkt) :
-access_timestamp(sj_clock),
-next_probe_time(sj_clock),
-probe_timeout(0),
-status(TTL_BRUTEFORCE),
-rand_key(random()),
-puppet_port(0),
-sent_probe(0),
-received_probe(0),
-daddr(pkt.ip->daddr),
-ttl_estimate(0xff),
-ttl_synack(0)
+extern auto_ptr<TimerWheel> timer_wheel;
+
+void TTLFocusProbe::setup(const Packet &pkt)
 {
     struct iphdr *newip = (struct iphdr *) probe_dummy;
     struct tcphdr *newtcp = (struct tcphdr *) (probe_dummy + sizeof (struct iphdr));
 
+    next_probe_time = sj_clock;
+    probe_timeout = 0;
+    rand_key = sj_random();
+    sent_probe = 0;
+    received_probe = 0;
+    memset(OptMap, 0, sizeof (OptMap));
+
+    memset(probe_dummy, 0, sizeof (probe_dummy));
     memcpy(newip, &pkt.pbuf[0], sizeof (struct iphdr) + 4); /* 4 byte for the two port TCP/UDP =) */
 
     newip->ihl = 5; /* 20 >> 4 */
@@ -56,40 +55,28 @@ ttl_synack(0)
 
     puppet_port = selectPuppetPort(ntohs(newtcp->source));
     newtcp->source = htons(puppet_port);
-
-    SELFLOG("Construct from Packet #%d", pkt.SjPacketId);
-    pkt.SELFLOG("This packet has made a new Session");
 }
 
-TTLFocus::TTLFocus(const struct ttlfocus_cache_record& cpy) :
-access_timestamp(cpy.access_timestamp),
-next_probe_time(sj_clock),
-status(TTL_KNOWN),
-rand_key(random()),
-puppet_port(0),
-sent_probe(0),
-received_probe(0),
-daddr(cpy.daddr),
-ttl_estimate(cpy.ttl_estimate),
-ttl_synack(cpy.ttl_synack)
+void TTLFocusProbe::setup(const struct ttlfocus_cache_record& cpy)
 {
-    memcpy(probe_dummy, cpy.probe_dummy, 40);
-
-    SELFLOG("Construct from cache record");
-}
+    next_probe_time = sj_clock;
+    probe_timeout = 0;
+    rand_key = sj_random();
+    puppet_port = 0;
+    sent_probe = 0;
+    received_probe = 0;
+    memset(OptMap, 0, sizeof (OptMap));
 
-TTLFocus::~TTLFocus(void)
-{
-    SELFLOG("");
+    memcpy(probe_dummy, cpy.probe_dummy, 40);
 }
 
-uint16_t TTLFocus::selectPuppetPort(uint16_t realport)
+uint16_t TTLFocusProbe::selectPuppetPort(uint16_t realport)
 {
     uint16_t puppet_port;
 
     do
     {
-        puppet_port = (random() % (32767 - 1024)) + 1024;
+        puppet_port = (sj_random() % (32767 - 1024)) + 1024;
     }
 
     while ((puppet_port >> 4) == (realport >> 4));
@@ -97,11 +84,31 @@ uint16_t TTLFocus::selectPuppetPort(uint16_t realport)
     return puppet_port;
 }
 
-void TTLFocus::selflog(const char *func, const char *format, ...) const
+TTLFocus::TTLFocus(void) :
+probe_distance(0),
+status(TTL_UNKNOWN),
+daddr(0),
+ttl_estimate(0),
+ttl_synack(0),
+access_timestamp(0),
+probe(NULL)
 {
-    if (debug.level() == SUPPRESS_LEVEL)
-        return;
+}
+
+/* a destination not yet in the TTLFocusMap: the map gives it a TTLFocusProbe when inserted */
+TTLFocus::TTLFocus(const Packet &pkt) :
+probe_distance(0),
+status(TTL_BRUTEFORCE),
+daddr(pkt.ip->daddr),
+ttl_estimate(0xff),
+ttl_synack(0),
+access_timestamp(sj_clock),
+probe(NULL)
+{
+}
 
+void TTLFocus::selflogFormat(const char *func, const char *format, ...) const
+{
     char loginfo[LARGEBUF];
     va_list arguments;
     va_start(arguments, format);
@@ -124,115 +131,285 @@ void TTLFocus::selflog(const char *func, const char *format, ...) const
     }
 
     LOG_SESSION("%s daddr(%s) %s sent(%d) recv(%d) ttl_estimate(%u) ttl_synack(%u) %s",
-                func, inet_ntoa(*((struct in_addr *) &(daddr))), status_name, sent_probe,
-                received_probe, ttl_estimate, ttl_synack, loginfo
+                func, inet_ntoa(*((struct in_addr *) &(daddr))), status_name,
+                probe != NULL ? probe->sent_probe : 0, probe != NULL ? probe->received_probe : 0,
+                ttl_estimate, ttl_synack, loginfo
                 );
 }
 
-TTLFocusMap::TTLFocusMap(void) :
-manage_timeout(sj_clock)
+/* the smallest power of two keeping capacity destinations at 7/8 of the slots */
+static uint32_t ttlFocusSlots(uint32_t capacity)
 {
-    LOG_DEBUG("with reference time (seconds) %u", uint32_t(sj_clock));
+    uint32_t slots = 16;
+
+    while (slots / 8 * 7 < capacity)
+        slots *= 2;
+
+    return slots;
+}
+
+TTLFocusMap::TTLFocusMap(uint32_t capacity) :
+table(new TTLFocus[ttlFocusSlots(capacity)]),
+table_mask(ttlFocusSlots(capacity) - 1),
+table_size(0),
+probes(new TTLFocusProbe[capacity]),
+lru(capacity),
+expiry_timer(TIMER_TTLFOCUS_EXPIRY, this)
+{
+    LOG_DEBUG("with reference time (seconds) %u, capacity of %u destinations in %u slots",
+              uint32_t(sj_clock), capacity, table_mask + 1);
+
+    for (uint32_t i = 0; i < capacity; ++i)
+    {
+        probes[i].probe_timer.event = TIMER_TTLPROBE;
+        probes[i].probe_timer.context = &probes[i];
+    }
 
     load();
 }
 
 TTLFocusMap::~TTLFocusMap(void)
 {
-    uint32_t counter = 0;
-
     dump();
 
-    for (TTLFocusMap::iterator it = begin(); it != end();)
+    LOG_DEBUG("dumped elements: %d", table_size);
+
+    for (uint32_t i = 0; i <= table_mask; ++i)
+    {
+        if (table[i].probe != NULL)
+            timer_wheel->remove(table[i].probe->probe_timer);
+    }
+
+    timer_wheel->remove(expiry_timer);
+
+    delete[] table;
+    delete[] probes;
+}
+
+/* the murmur3 finalizer */
+uint32_t TTLFocusMap::hash(uint32_t daddr)
+{
+    daddr ^= daddr >> 16;
+    daddr *= 0x85EBCA6B;
+    daddr ^= daddr >> 13;
+    daddr *= 0xC2B2AE35;
+    daddr ^= daddr >> 16;
+
+    return daddr;
+}
+
+/*
+ * robin hood insertion of a destination not present: on its way the record takes
+ * the slot of the first one nearer to its own slot, that continues in its place.
+ * every record moved updates the slot of its LRUList node.
+ * returns the slot of the record inserted.
+ */
+uint32_t TTLFocusMap::place(const TTLFocus &ttlfocus)
+{
+    TTLFocus moving = ttlfocus;
+    uint32_t index = hash(moving.daddr) & table_mask;
+    uint32_t placed = table_mask + 1;
+
+    moving.probe_distance = 0;
+
+    while (table[index].probe != NULL)
+    {
+        if (table[index].probe_distance < moving.probe_distance)
+        {
+            swap(moving, table[index]);
+            lru.setSlot(table[index].probe - probes, index);
+            if (placed > table_mask)
+                placed = index;
+        }
+
+        index = (index + 1) & table_mask;
+        ++moving.probe_distance;
+    }
+
+    table[index] = moving;
+    lru.setSlot(table[index].probe - probes, index);
+    if (placed > table_mask)
+        placed = index;
+
+    ++table_size;
+
+    return placed;
+}
+
+/* the records following the erased one are moved back of a slot, until one is in its own */
+void TTLFocusMap::erase(uint32_t index)
+{
+    uint32_t next = (index + 1) & table_mask;
+
+    table[index].SELFLOG("");
+
+    table[index].probe->keep_packets.clear();
+    timer_wheel->remove(table[index].probe->probe_timer);
+    lru.release(table[index].probe - probes);
+
+    while (table[next].probe != NULL && table[next].probe_distance)
     {
-        counter++;
+        table[index] = table[next];
+        --table[index].probe_distance;
+        lru.setSlot(table[index].probe - probes, index);
 
-        delete &(*it->second);
-        erase(it++);
+        index = next;
+        next = (next + 1) & table_mask;
     }
 
-    LOG_DEBUG("dumped elements: %d", counter);
+    table[index] = TTLFocus();
 
+    --table_size;
+}
+
+/*
+ * the least recently used destination without packets in KEEP is removed;
+ * when every destination has some, the least recently used is removed and
+ * its packets go in evicted_keep, to be released as the expired ones.
+ */
+void TTLFocusMap::evict(void)
+{
+    uint32_t node = lru.getOldest();
+
+    while (node != LRU_NONE && !probes[node].keep_packets.empty())
+        node = lru.getNewer(node);
+
+    if (node == LRU_NONE)
+    {
+        node = lru.getOldest();
+
+        uint32_t kept = 0;
+        for (const Packet *pkt = probes[node].keep_packets.front(); pkt != NULL; pkt = pkt->keep_next)
+            ++kept;
+
+        evicted_keep.splice(probes[node].keep_packets);
+
+        table[lru.getSlot(node)].SELFLOG("every destination has packets in KEEP: evicted with %u of them", kept);
+    }
+
+    erase(lru.getSlot(node));
+}
+
+/* a destination not present is inserted with a TTLFocusProbe, to be set up by the caller */
+TTLFocus& TTLFocusMap::insert(const TTLFocus &ttlfocus)
+{
+    if (lru.full())
+        evict();
+
+    TTLFocus newfocus = ttlfocus;
+    newfocus.probe = &probes[lru.acquire()];
+
+    const uint32_t placed = place(newfocus);
+
+    if (!expiry_timer.armed())
+        scheduleExpiry();
+
+    return table[placed];
 }
 
 /* return a ttlfocus given a packet; return a new ttlfocus if no one exists */
 TTLFocus& TTLFocusMap::get(const Packet &pkt)
 {
-    TTLFocus *ttlfocus;
-
     /* check if the key it's already present */
-    TTLFocusMap::iterator it = find(pkt.ip->daddr);
+    TTLFocus *ttlfocus = find(pkt.ip->daddr);
 
-    if (it != end()) /* on hit: return the ttlfocus object. */
-        ttlfocus = &(*it->second);
+    if (ttlfocus == NULL) /* on miss: create a new ttlfocus and insert it into the map */
+    {
+        ttlfocus = &insert(TTLFocus(pkt));
+        ttlfocus->probe->setup(pkt);
 
-    else /* on miss: create a new ttlfocus and insert it into the map */
-        ttlfocus = &(*insert(pair<uint32_t, TTLFocus*>(pkt.ip->daddr, new TTLFocus(pkt))).first->second);
+        /* the ttl bruteforce starts in this cycle */
+        timer_wheel->add(ttlfocus->probe->probe_timer, sj_clock_msec);
+
+        ttlfocus->SELFLOG("Construct from Packet #%d", pkt.SjPacketId);
+        pkt.SELFLOG("This packet has made a new Session");
+    }
+    else
+    {
+        lru.touch(ttlfocus->probe - probes);
+
+        /* a bruteforce paused on a destination unused resumes when it is used again */
+        if (ttlfocus->status != TTL_KNOWN && !ttlfocus->probe->probe_timer.armed())
+            timer_wheel->add(ttlfocus->probe->probe_timer, sj_clock_msec);
+    }
 
     /* update access timestamp using global clock */
     ttlfocus->access_timestamp = sj_clock;
     return *ttlfocus;
 }
 
-void TTLFocusMap::manage(void)
+/* return the ttlfocus of a destination, NULL if it is not tracked; never creates a new one */
+TTLFocus* TTLFocusMap::find(uint32_t daddr)
 {
-    /* timeout check */
-    if (manage_timeout < sj_clock - TTLFOCUSMAP_MANAGE_ROUTINE_TIMER)
+    uint32_t index = hash(daddr) & table_mask;
+    uint8_t distance = 0;
+
+    while (table[index].probe != NULL && table[index].probe_distance >= distance)
     {
-        manage_timeout = sj_clock; /* update the next manage timeout */
-        for (TTLFocusMap::iterator it = begin(); it != end();)
-        {
-            if ((*it).second->access_timestamp + TTLFOCUS_EXPIRYTIME < sj_clock)
-                erase(it++);
-            else
-                ++it;
-        }
+        if (table[index].daddr == daddr)
+            return &table[index];
+
+        index = (index + 1) & table_mask;
+        ++distance;
     }
 
-    /* size check */
-    uint32_t map_size = size();
-    uint32_t index;
-    if (map_size > TTLFOCUSMAP_MEMORY_THRESHOLD)
+    return NULL;
+}
+
+/* the ttlfocus of a TIMER_TTLPROBE expired */
+TTLFocus& TTLFocusMap::getFromProbe(const TTLFocusProbe &probe)
+{
+    return table[lru.getSlot(&probe - probes)];
+}
+
+TTLFocus* TTLFocusMap::getNext(uint32_t &index)
+{
+    for (; index <= table_mask; ++index)
     {
-        /*
-         * we are forced to make a map cleanup.
-         * to solve this critical condition we decide to reset half
-         * of the map, and to do the best selection we reorder
-         * the map by the access timestamp.
-         * the complexity cost of this operation is O(NLogN)
-         * due to the sort algorithm.
-         * this is the worst case; (others operations are linear
-         */
-        TTLFocus** tmp = new TTLFocus*[map_size];
+        if (table[index].probe != NULL)
+            return &table[index++];
+    }
 
-        index = 0;
-        for (TTLFocusMap::iterator it = begin(); it != end(); ++it)
-            tmp[index++] = it->second;
+    return NULL;
+}
 
-        clear();
+/* the expiry_timer is armed on the expiry of the least recently used destination */
+void TTLFocusMap::scheduleExpiry(void)
+{
+    const uint32_t node = lru.getOldest();
 
-        sort(tmp, tmp + map_size, ttlfocusTimestampComparison);
+    if (node == LRU_NONE)
+        return;
 
-        index = 0;
-        do
-        {
-            insert(pair<uint32_t, TTLFocus*>((tmp[index])->daddr, tmp[index]));
-        }
-        while (++index != TTLFOCUSMAP_MEMORY_THRESHOLD / 2);
+    /* manage() removes the ones with access_timestamp + TTLFOCUS_EXPIRYTIME < sj_clock */
+    const time_t expiry = table[lru.getSlot(node)].access_timestamp + TTLFOCUS_EXPIRYTIME + 1;
 
-        do
-            delete tmp[index];
+    timer_wheel->add(expiry_timer, sj_clock_msec + (expiry > sj_clock ? (uint64_t) (expiry - sj_clock) * 1000 : 0));
+}
 
-        while (++index != map_size);
+/* called by the conntrack when the expiry_timer expires */
+void TTLFocusMap::manage(void)
+{
+    /* the destinations are walked from the least recently used until the first not expired */
+    uint32_t node = lru.getOldest();
+    while (node != LRU_NONE && table[lru.getSlot(node)].access_timestamp + TTLFOCUS_EXPIRYTIME < sj_clock)
+    {
+        const uint32_t expired = node;
+        node = lru.getNewer(node);
 
-        delete[] tmp;
+        /* a destination with packets in KEEP is in use */
+        if (probes[expired].keep_packets.empty())
+            erase(lru.getSlot(expired));
     }
+
+    scheduleExpiry();
 }
 
 void TTLFocusMap::load(void)
 {
     uint32_t records_num = 0;
     struct ttlfocus_cache_record tmp;
+    vector<struct ttlfocus_cache_record> records;
 
     LOG_ALL("loading ttlfocusmap from %s", FILE_TTLFOCUSMAP);
 
@@ -244,13 +421,32 @@ void TTLFocusMap::load(void)
     }
 
     while (fread(&tmp, sizeof (struct ttlfocus_cache_record), 1, loadstream) == 1)
+        records.push_back(tmp);
+
+    fclose(loadstream);
+
+    /* inserted from the least recently used: over the capacity the oldest are evicted */
+    sort(records.begin(), records.end(), ttlfocusCacheComparison);
+
+    for (vector<struct ttlfocus_cache_record>::iterator it = records.begin(); it != records.end(); ++it)
     {
+        if (find(it->daddr) != NULL)
+            continue;
+
         ++records_num;
-        TTLFocus *ttlfocus = new TTLFocus(tmp);
-        insert(pair<uint32_t, TTLFocus*>(ttlfocus->daddr, ttlfocus));
-    }
 
-    fclose(loadstream);
+        TTLFocus ttlfocus;
+        ttlfocus.status = TTL_KNOWN;
+        ttlfocus.daddr = it->daddr;
+        ttlfocus.ttl_estimate = it->ttl_estimate;
+        ttlfocus.ttl_synack = it->ttl_synack;
+        ttlfocus.access_timestamp = it->access_timestamp;
+
+        TTLFocus &inserted = insert(ttlfocus);
+        inserted.probe->setup(*it);
+
+        inserted.SELFLOG("Construct from cache record");
+    }
 
     LOG_ALL("load completed: %u records loaded", records_num);
 }
@@ -269,9 +465,10 @@ void TTLFocusMap::dump(void)
         return;
     }
 
-    for (TTLFocusMap::iterator it = begin(); it != end(); ++it)
+    uint32_t index = 0;
+    TTLFocus *tmp;
+    while ((tmp = getNext(index)) != NULL)
     {
-        TTLFocus *tmp = &(*it->second);
 
         /* we saves only with TTL_KNOWN status */
         if (tmp->status != TTL_KNOWN)
@@ -292,7 +489,7 @@ void TTLFocusMap::dump(void)
          * a ttlprobe packet is always 40 bytes (min iphdr + min tcphdr),
          * ipopts, tcpopts, and payload are stripped of on creation
          */
-        memcpy(cache_record.probe_dummy, &(tmp->probe_dummy[0]), 40);
+        memcpy(cache_record.probe_dummy, &(tmp->probe->probe_dummy[0]), 40);
 
         if (fwrite(&cache_record, sizeof (struct ttlfocus_cache_record), 1, dumpstream) != 1)
         {
@@ -25,6 +25,8 @@
 
 #include "Utils.h"
 #include "Packet.h"
+#include "LRUList.h"
+#include "TimerWheel.h"
 
 /* IT'S FUNDAMENTAL TO HAVE ALL THIS ENUMS VALUES AS POWERS OF TWO TO PERMIT OR MASKS */
 
@@ -33,6 +35,21 @@ enum ttlsearch_t
     TTL_KNOWN = 1, TTL_BRUTEFORCE = 2, TTL_UNKNOWN = 4
 };
 
+struct ttlfocus_cache_record
+{
+    time_t access_timestamp; /* access timestamp used to decretee expiry */
+    uint32_t daddr; /* destination of the traceroute */
+    uint8_t ttl_estimate; /* hop count estimate found during ttlbruteforce;
+                             on status KNOWN   : represents the min working ttl found
+                             on status UNKNOWN : represents the max expired ttl found */
+    uint8_t ttl_synack; /* the value of the ttl read in the synack packet */
+
+    unsigned char probe_dummy[40]; /* dummy ttlprobe packet generated from the packet
+                                      that scattered the ttlfocus creation.
+                                      the packet size is always 40 bytes long,
+                                      (sizeof(struct iphdr) + sizeof(struct tcphdr)) */
+};
+
 struct option_discovery
 {
     bool underTesting;
@@ -40,28 +57,91 @@ struct option_discovery
     bool defaultWorking;
 };
 
-class TTLFocus
+/*
+ * the packets of a destination held in KEEP, in their arrival order:
+ * they are chained by Packet::keep_next, so a destination costs only two
+ * pointers whether or not it is in bruteforce.
+ */
+class KeepChain
+{
+private:
+    Packet *head;
+    Packet *tail;
+
+public:
+    KeepChain(void) : head(NULL), tail(NULL)
+    {
+    }
+
+    bool empty(void) const
+    {
+        return head == NULL;
+    }
+
+    Packet *front(void) const
+    {
+        return head;
+    }
+
+    void push(Packet &pkt)
+    {
+        pkt.keep_next = NULL;
+        if (tail != NULL)
+            tail->keep_next = &pkt;
+        else
+            head = &pkt;
+        tail = &pkt;
+    }
+
+    Packet *pop(void)
+    {
+        Packet * const pkt = head;
+        head = pkt->keep_next;
+        if (head == NULL)
+            tail = NULL;
+        pkt->keep_next = NULL;
+        return pkt;
+    }
+
+    /* the packets of other are moved at the end of the chain */
+    void splice(KeepChain &other)
+    {
+        if (other.head == NULL)
+            return;
+        if (tail != NULL)
+            tail->keep_next = other.head;
+        else
+            head = other.head;
+        tail = other.tail;
+        other.head = other.tail = NULL;
+    }
+
+    void clear(void)
+    {
+        head = tail = NULL;
+    }
+};
+
+/*
+ * the data of a destination used only by the ttl bruteforce and by the
+ * options discovery: kept apart from the TTLFocus records, so that the
+ * lookups of the destinations touch only the TTLFocusMap slots.
+ */
+class TTLFocusProbe
 {
 public:
     /* timing variables */
-    time_t access_timestamp; /* access timestamp used to decretee expiry */
     time_t next_probe_time; /* timeout value used for ttlprobe schedule */
-    time_t probe_timeout;
+    uint64_t probe_timeout; /* sj_clock_msec of the end of the bruteforce, after the last probe */
+    Timer probe_timer; /* the next probe or the probe_timeout, TIMER_TTLPROBE */
 
-    /* status variables */
-    ttlsearch_t status; /* status of the traceroute */
     uint8_t rand_key; /* random key used as try to discriminate traceroute packet */
     uint16_t puppet_port; /* random port used with the aim to not disturbe a session */
 
     uint8_t sent_probe; /* number of sent probes */
     uint8_t received_probe; /* number of received probes */
 
-    /* ttl informations, results of the analysis */
-    const uint32_t daddr; /* destination of the traceroute */
-    uint8_t ttl_estimate; /* hop count estimate found during ttlbruteforce;
-                             on status KNOWN   : represents the min working ttl found
-                             on status UNKNOWN : represents the max expired ttl found */
-    uint8_t ttl_synack; /* the value of the ttl read in the synack packet */
+    KeepChain keep_packets; /* packets held in KEEP until the end of the bruteforce */
 
     /* per-dest tracking of which IP|TCP options will be effective or became dropped */
     struct option_discovery OptMap[SUPPORTED_OPTIONS];
@@ -71,53 +151,110 @@ public:
                                       the packet size is always 40 bytes long,
                                       (sizeof(struct iphdr) + sizeof(struct tcphdr)) */
 
+    void setup(const Packet &);
+    void setup(const struct ttlfocus_cache_record &);
+    uint16_t selectPuppetPort(uint16_t);
+};
+
+class TTLFocus
+{
+    friend class TTLFocusMap;
+
+private:
+    uint8_t probe_distance; /* distance from the slot of its hash in the TTLFocusMap */
+
+public:
+    /* status variables */
+    ttlsearch_t status; /* status of the traceroute */
+
+    /* ttl informations, results of the analysis */
+    uint32_t daddr; /* destination of the traceroute */
+    uint8_t ttl_estimate; /* hop count estimate found during ttlbruteforce;
+                             on status KNOWN   : represents the min working ttl found
+                             on status UNKNOWN : represents the max expired ttl found */
+    uint8_t ttl_synack; /* the value of the ttl read in the synack packet */
+
+    time_t access_timestamp; /* access timestamp used to decretee expiry */
+
+    TTLFocusProbe *probe; /* NULL marks an empty slot of the TTLFocusMap */
+
     TTLFocus(void);
     TTLFocus(const Packet &pkt);
-    TTLFocus(const struct ttlfocus_cache_record &);
-    ~TTLFocus(void);
-    uint16_t selectPuppetPort(uint16_t);
 
     /* utilities */
-    void selflog(const char *func, const char *format, ...) const;
+    __attribute__((always_inline)) void selflog(const char *func, const char *format, ...) const
+    {
+        if (debug.enabled(SESSION_LEVEL))
+            selflogFormat(func, format, __builtin_va_arg_pack());
+    }
+    void selflogFormat(const char *, const char *, ...) const;
 };
 
-class TTLFocusMap : public map<const uint32_t, TTLFocus*>
+/*
+ * TTLFocusMap is an open addressing hash table with robin hood probing
+ * keyed by the destination address, like the SessionTrackMap: the slots
+ * keep the TTLFocus records, the TTLFocusProbe of every destination is
+ * taken from a pool allocated with the table. the memory used is fixed by
+ * the capacity given to the map: a new destination exceeding it evicts the
+ * least recently used one, the destinations with packets in KEEP excluded
+ * until they are all of this kind: then the oldest is evicted, and its
+ * packets are left in evicted_keep for the conntrack to release them.
+ * the index of a TTLFocusProbe in the pool is its node in the LRUList.
+ * the expiry_timer is armed on the expiry of the least recently used
+ * destination, the conntrack calls manage() when it expires.
+ *
+ * the insertion of a new destination can move the others, so a reference
+ * returned by get() is valid until the next get() or manage();
+ * the TTLFocusProbe never moves.
+ */
+class TTLFocusMap
 {
 private:
-    time_t manage_timeout;
+    TTLFocus *table;
+    uint32_t table_mask; /* slots - 1, the slots are a power of two */
+    uint32_t table_size;
+
+    TTLFocusProbe *probes;
+    LRUList lru;
 
-    struct ttlfocus_timestamp_comparison
+    Timer expiry_timer; /* the expiry of the least recently used destination */
+
+    static uint32_t hash(uint32_t);
+    uint32_t place(const TTLFocus &);
+    void erase(uint32_t);
+    void evict(void);
+    TTLFocus& insert(const TTLFocus &);
+    void scheduleExpiry(void);
+
+    struct ttlfocus_cache_comparison
     {
 
-        bool operator() (const TTLFocus *i, const TTLFocus * j)
+        bool operator() (const struct ttlfocus_cache_record &i, const struct ttlfocus_cache_record &j)
         {
-            return ( i->access_timestamp < j->access_timestamp);
+            return ( i.access_timestamp < j.access_timestamp);
         }
 
-    } ttlfocusTimestampComparison;
+    } ttlfocusCacheComparison;
 
 public:
-    TTLFocusMap(void);
+    KeepChain evicted_keep; /* packets in KEEP of the evicted destinations */
+
+    TTLFocusMap(uint32_t);
     ~TTLFocusMap(void);
     TTLFocus& get(const Packet &);
+    TTLFocus* find(uint32_t);
+    TTLFocus& getFromProbe(const TTLFocusProbe &);
     void manage(void);
     void load(void);
     void dump(void);
-};
 
-struct ttlfocus_cache_record
-{
-    time_t access_timestamp; /* access timestamp used to decretee expiry */
-    uint32_t daddr; /* destination of the traceroute */
-    uint8_t ttl_estimate; /* hop count estimate found during ttlbruteforce;
-                             on status KNOWN   : represents the min working ttl found
-                             on status UNKNOWN : represents the max expired ttl found */
-    uint8_t ttl_synack; /* the value of the ttl read in the synack packet */
+    uint32_t size(void) const
+    {
+        return table_size;
+    }
 
-    unsigned char probe_dummy[40]; /* dummy ttlprobe packet generated from the packet
-                                      that scattered the ttlfocus creation.
-                                      the packet size is always 40 bytes long,
-                                      (sizeof(struct iphdr) + sizeof(struct tcphdr)) */
+    /* the destinations are walked by slot: returns the first from *index on, NULL at the end */
+    TTLFocus* getNext(uint32_t &);
 };
 
 #endif /* SJ_TTLFOCUS_H */
@@ -0,0 +1,242 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#include "TimerWheel.h"
+
+#define DUE_LIST        (TIMERWHEEL_LEVELS * TIMERWHEEL_SLOTS)
+#define EXPIRED_LIST    (DUE_LIST + 1)
+
+Timer::Timer(void) :
+prev(NULL),
+next(NULL),
+list(0),
+event(TIMER_UNASSIGNED),
+context(NULL),
+expires(0)
+{
+}
+
+Timer::Timer(timerevent_t event, void *context) :
+prev(NULL),
+next(NULL),
+list(0),
+event(event),
+context(context),
+expires(0)
+{
+}
+
+TimerWheel::TimerWheel(uint64_t start) :
+now(start),
+pending(0)
+{
+    LOG_DEBUG("");
+
+    memset(occupied, 0, sizeof (occupied));
+
+    for (uint16_t i = 0; i <= EXPIRED_LIST; ++i)
+        lists[i].prev = lists[i].next = &lists[i];
+}
+
+void TimerWheel::append(Timer &timer, uint16_t list)
+{
+    Timer &head = lists[list];
+
+    timer.prev = head.prev;
+    timer.next = &head;
+    head.prev->next = &timer;
+    head.prev = &timer;
+    timer.list = list;
+
+    if (list < DUE_LIST)
+    {
+        occupied[list / TIMERWHEEL_SLOTS] |= (uint64_t) 1 << (list % TIMERWHEEL_SLOTS);
+        ++pending;
+    }
+}
+
+/* all the timers of a list are moved at the end of another */
+void TimerWheel::splice(uint16_t from, uint16_t to)
+{
+    Timer &head = lists[from];
+
+    while (head.next != &head)
+    {
+        Timer &timer = *head.next;
+
+        remove(timer);
+        append(timer, to);
+    }
+}
+
+void TimerWheel::remove(Timer &timer)
+{
+    if (!timer.armed())
+        return;
+
+    timer.prev->next = timer.next;
+    timer.next->prev = timer.prev;
+    timer.prev = timer.next = NULL;
+
+    if (timer.list < DUE_LIST)
+    {
+        const Timer &head = lists[timer.list];
+
+        if (head.next == &head)
+            occupied[timer.list / TIMERWHEEL_SLOTS] &= ~((uint64_t) 1 << (timer.list % TIMERWHEEL_SLOTS));
+
+        --pending;
+    }
+}
+
+/* the timer is put in the slot of the lowest level where its expiry differs from now */
+void TimerWheel::place(Timer &timer)
+{
+    const uint64_t diff = timer.expires ^ now;
+    uint16_t level = 0;
+
+    while (level < TIMERWHEEL_LEVELS - 1 && (diff >> (TIMERWHEEL_BITS * (level + 1))))
+        ++level;
+
+    const uint16_t slot = (timer.expires >> (TIMERWHEEL_BITS * level)) & (TIMERWHEEL_SLOTS - 1);
+
+    append(timer, level * TIMERWHEEL_SLOTS + slot);
+}
+
+/*
+ * the slots of the time now: the higher levels are cascaded first, so a
+ * timer can go down more levels at once, then the level 0 slot expires.
+ */
+void TimerWheel::process(void)
+{
+    for (uint16_t level = TIMERWHEEL_LEVELS - 1; level > 0; --level)
+    {
+        if (now & (((uint64_t) 1 << (TIMERWHEEL_BITS * level)) - 1))
+            continue;
+
+        const uint16_t list = level * TIMERWHEEL_SLOTS + ((now >> (TIMERWHEEL_BITS * level)) & (TIMERWHEEL_SLOTS - 1));
+        Timer &head = lists[list];
+
+        if (head.next == &head)
+            continue;
+
+        /* a timer of a next round comes back in this slot, after the last one */
+        const Timer * const last = head.prev;
+        Timer *timer;
+
+        do
+        {
+            timer = head.next;
+            remove(*timer);
+            place(*timer);
+        }
+        while (timer != last);
+    }
+
+    splice(now & (TIMERWHEEL_SLOTS - 1), EXPIRED_LIST);
+}
+
+/*
+ * the time of the next slot with timers: the lowest level with timers has
+ * the first, in the round of now; only the last level can have a timer of
+ * a next round.
+ */
+uint64_t TimerWheel::nextSlotTime(void) const
+{
+    if (!pending)
+        return 0;
+
+    for (uint16_t level = 0; level < TIMERWHEEL_LEVELS; ++level)
+    {
+        if (!occupied[level])
+            continue;
+
+        const uint16_t shift = TIMERWHEEL_BITS * level;
+        const uint16_t current = (now >> shift) & (TIMERWHEEL_SLOTS - 1);
+        const uint64_t round = ((uint64_t) 1 << (shift + TIMERWHEEL_BITS));
+        const uint64_t round_start = now & ~(round - 1);
+        const uint64_t following = (current == TIMERWHEEL_SLOTS - 1) ? 0 : occupied[level] & (~(uint64_t) 0 << (current + 1));
+
+        if (following)
+            return round_start + ((uint64_t) __builtin_ctzll(following) << shift);
+
+        return round_start + round + ((uint64_t) __builtin_ctzll(occupied[level]) << shift);
+    }
+
+    return 0;
+}
+
+/* a timer already armed is moved to the new expiry */
+void TimerWheel::add(Timer &timer, uint64_t expires)
+{
+    remove(timer);
+
+    timer.expires = expires;
+
+    if (expires <= now)
+        append(timer, DUE_LIST);
+    else
+        place(timer);
+}
+
+/* the timers due and the ones expiring until the time passed are moved in the expired list */
+void TimerWheel::advance(uint64_t time)
+{
+    splice(DUE_LIST, EXPIRED_LIST);
+
+    while (now < time)
+    {
+        const uint64_t next = nextSlotTime();
+
+        if (!next || next > time)
+        {
+            now = time;
+            break;
+        }
+
+        now = next;
+        process();
+    }
+}
+
+/* the timers expired by advance(), one at a time: NULL when they are over */
+Timer* TimerWheel::getExpired(void)
+{
+    Timer &head = lists[EXPIRED_LIST];
+
+    if (head.next == &head)
+        return NULL;
+
+    Timer * const timer = head.next;
+    remove(*timer);
+
+    return timer;
+}
+
+/* the time when advance() has some timer to expire or to cascade, 0 when there is none */
+uint64_t TimerWheel::nextExpiry(void) const
+{
+    if (lists[DUE_LIST].next != &lists[DUE_LIST] || lists[EXPIRED_LIST].next != &lists[EXPIRED_LIST])
+        return now;
+
+    return nextSlotTime();
+}
@@ -0,0 +1,104 @@
+/*
+ *   SniffJoke is a software able to confuse the Internet traffic analysis,
+ *   developed with the aim to improve digital privacy in communications and
+ *   to show and test some securiy weakness in traffic analysis software.
+ *
+ *   Copyright (C) 2010 vecna <vecna@delirandom.net>
+ *                      evilaliv3 <giovanni.pellerano@evilaliv3.org>
+ *
+ *   This program is free software: you can redistribute it and/or modify
+ *   it under the terms of the GNU General Public License as published by
+ *   the Free Software Foundation, either version 3 of the License, or
+ *   (at your option) any later version.
+ *
+ *   This program is distributed in the hope that it will be useful,
+ *   but WITHOUT ANY WARRANTY; without even the implied warranty of
+ *   MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the
+ *   GNU General Public License for more details.
+ *
+ *   You should have received a copy of the GNU General Public License
+ *   along with this program.  If not, see <http://www.gnu.org/licenses/>.
+ */
+
+#ifndef SJ_TIMERWHEEL_H
+#define SJ_TIMERWHEEL_H
+
+#include "Utils.h"
+
+/* IT'S FUNDAMENTAL TO HAVE ALL THIS ENUMS VALUES AS POWERS OF TWO TO PERMIT OR MASKS */
+enum timerevent_t
+{
+    TIMER_UNASSIGNED = 0, TIMER_TTLPROBE = 1, TIMER_SESSIONTRACK_EXPIRY = 2, TIMER_TTLFOCUS_EXPIRY = 4
+};
+
+#define TIMERWHEEL_BITS     6
+#define TIMERWHEEL_SLOTS    (1 << TIMERWHEEL_BITS)
+#define TIMERWHEEL_LEVELS   5   /* 2^30 ms, about 12 days, in the slots of the last level */
+
+/*
+ * a Timer is kept inside the object that schedules it: the TimerWheel only
+ * links it in its lists, and the owner finds it back by event and context
+ * when it expires. a Timer armed is in one list, the due, the expired, or a
+ * slot of the wheel.
+ */
+class Timer
+{
+    friend class TimerWheel;
+
+private:
+    Timer *prev;
+    Timer *next;
+    uint16_t list;
+
+public:
+    timerevent_t event;
+    void *context;
+    uint64_t expires; /* sj_clock_msec of the expiry */
+
+    Timer(void);
+    Timer(timerevent_t, void *);
+
+    bool armed(void) const
+    {
+        return next != NULL;
+    }
+};
+
+/*
+ * TimerWheel is a hierarchical timing wheel in milliseconds of sj_clock_msec:
+ * the level 0 has a slot for every ms of the next 64, a slot of the level n
+ * keeps the timers of 64^n ms and is cascaded in the lower levels when its
+ * time comes. a timer is in the lowest level where its expiry and the time
+ * of the wheel differ only in the bits of the level; the ones further than
+ * the last level are met again every round of it, and then cascaded.
+ *
+ * advance() runs only on the slots that have timers: its cost depends on the
+ * timers expired and cascaded, not on the timers armed. a timer armed with
+ * an expiry already passed is due: it expires with the next advance(), so
+ * the owner handling an expired timer can arm it again for the next cycle.
+ */
+class TimerWheel
+{
+private:
+    uint64_t now;
+    uint32_t pending; /* timers in the slots of the levels */
+    uint64_t occupied[TIMERWHEEL_LEVELS]; /* bitmaps of the slots with timers */
+    Timer lists[TIMERWHEEL_LEVELS * TIMERWHEEL_SLOTS + 2]; /* the slots, due and expired: list heads */
+
+    void append(Timer &, uint16_t);
+    void splice(uint16_t, uint16_t);
+    void place(Timer &);
+    void process(void);
+    uint64_t nextSlotTime(void) const;
+
+public:
+    TimerWheel(uint64_t);
+
+    void add(Timer &, uint64_t);
+    void remove(Timer &);
+    void advance(uint64_t);
+    Timer* getExpired(void);
+    uint64_t nextExpiry(void) const;
+};
+
+#endif /* SJ_TIMERWHEEL_H */
@@ -130,6 +130,15 @@ cmdline_opts(cmdline_opts)
     if (runcfg.use_blacklist && runcfg.use_whitelist)
         RUNTIME_EXCEPTION("configuration conflict: both blacklist and whitelist seem to be enabled");
 
+    if (runcfg.tun_read_queues < 1 || runcfg.tun_read_queues > TUNQUEUE_MAX)
+        RUNTIME_EXCEPTION("invalid tun-read-queues value %u: accepted from 1 to %u", runcfg.tun_read_queues, TUNQUEUE_MAX);
+
+    if (runcfg.xdp && runcfg.tx_ring)
+        RUNTIME_EXCEPTION("configuration conflict: xdp and tx-ring are both transmit paths for the network");
+
+    if (runcfg.io_uring && (runcfg.batch_io || runcfg.rx_ring || runcfg.tx_ring || runcfg.xdp))
+        RUNTIME_EXCEPTION("configuration conflict: io-uring replaces the batch-io, rx-ring, tx-ring and xdp paths");
+
     if (runcfg.onlyplugin[0])
     {
         LOG_VERBOSE("plugin %s override the plugins settings in %s", runcfg.onlyplugin,
@@ -363,6 +372,31 @@ void UserConf::parseMatch(uint16_t &dst, const char *name, FILE *cf, uint16_t cm
     LOG_DEBUG(debugfmt, name, dst);
 }
 
+void UserConf::parseMatch(uint32_t &dst, const char *name, FILE *cf, uint32_t cmdopt, uint32_t difolt)
+{
+    char useropt[MEDIUMBUF] = {0};
+    const char *debugfmt = NULL;
+
+    /* command line priority always */
+    if (cmdopt != difolt)
+    {
+        debugfmt = "uint32: option %s read from command line: [%u]";
+        dst = cmdopt;
+    }
+    else if (cf != NULL && parseKeyword(cf, useropt, name))
+    {
+        debugfmt = "uint32: option %s read from config file: [%u]";
+        dst = strtoul(useropt, NULL, 10);
+    }
+    else
+    {
+        debugfmt = "uint32: not found %s option in conf file, using default: [%u]";
+        dst = difolt;
+    }
+
+    LOG_DEBUG(debugfmt, name, dst);
+}
+
 void UserConf::parseMatch(bool &dst, const char *name, FILE *cf, bool cmdopt, bool difolt)
 {
     char useropt[MEDIUMBUF] = {0};
@@ -416,7 +450,21 @@ bool UserConf::loadDiskConfiguration(void)
     parseMatch(runcfg.debug_level, "debug", loadstream, cmdline_opts.debug_level, DEFAULT_DEBUG_LEVEL);
     parseMatch(runcfg.onlyplugin, "only-plugin", loadstream, cmdline_opts.onlyplugin, DEFAULT_ONLYPLUGIN);
     parseMatch(runcfg.max_ttl_probe, "max-ttl-probe", loadstream, cmdline_opts.max_ttl_probe, DEFAULT_MAX_TTLPROBE);
+    parseMatch(runcfg.max_keep_time, "max-keep-time", loadstream, cmdline_opts.max_keep_time, DEFAULT_MAX_KEEPTIME);
+    parseMatch(runcfg.max_sessions, "max-sessions", loadstream, cmdline_opts.max_sessions, DEFAULT_MAX_SESSIONS);
+    parseMatch(runcfg.max_destinations, "max-destinations", loadstream, cmdline_opts.max_destinations, DEFAULT_MAX_DESTINATIONS);
     parseMatch(runcfg.gw_mac_str, "gw-mac-addr", loadstream, cmdline_opts.gw_mac_str, DEFAULT_GW_MAC_ADDR);
+    parseMatch(runcfg.batch_io, "batch-io", loadstream, cmdline_opts.batch_io, DEFAULT_BATCH_IO);
+    parseMatch(runcfg.rx_ring, "rx-ring", loadstream, cmdline_opts.rx_ring, DEFAULT_RX_RING);
+    parseMatch(runcfg.tx_ring, "tx-ring", loadstream, cmdline_opts.tx_ring, DEFAULT_TX_RING);
+    parseMatch(runcfg.tun_read_queues, "tun-read-queues", loadstream, cmdline_opts.tun_read_queues, DEFAULT_TUN_READ_QUEUES);
+    parseMatch(runcfg.tun_gso, "tun-gso", loadstream, cmdline_opts.tun_gso, DEFAULT_TUN_GSO);
+    parseMatch(runcfg.xdp, "xdp", loadstream, cmdline_opts.xdp, DEFAULT_XDP);
+    parseMatch(runcfg.io_uring, "io-uring", loadstream, cmdline_opts.io_uring, DEFAULT_IO_URING);
+
+    /* the maps evict a record to insert a new one: they hold one at least */
+    if (!runcfg.max_sessions || !runcfg.max_destinations)
+        RUNTIME_EXCEPTION("invalid parm: max-sessions and max-destinations must be at least 1");
 
     /* loading of IP lists, in future also the source IP address should be useful */
     if (runcfg.use_blacklist)
@@ -525,6 +573,16 @@ uint32_t UserConf::dumpIfPresent(FILE *out, const char *name, uint16_t data, uin
     return written;
 }
 
+uint32_t UserConf::dumpIfPresent(FILE *out, const char *name, uint32_t data, uint32_t difolt)
+{
+    uint32_t written = 0;
+
+    if (data != difolt)
+        written = fprintf(out, "%s:%u\n", name, data);
+
+    return written;
+}
+
 uint32_t UserConf::dumpIfPresent(FILE *out, const char *name, bool data, bool difolt)
 {
     uint32_t written = 0;
@@ -564,6 +622,16 @@ bool UserConf::syncDiskConfiguration(void)
     written += dumpIfPresent(out, "foreground", runcfg.go_foreground, DEFAULT_GO_FOREGROUND);
     written += dumpIfPresent(out, "debug", runcfg.debug_level, DEFAULT_DEBUG_LEVEL);
     written += dumpIfPresent(out, "max-ttl-probe", runcfg.max_ttl_probe, DEFAULT_MAX_TTLPROBE);
+    written += dumpIfPresent(out, "max-keep-time", runcfg.max_keep_time, DEFAULT_MAX_KEEPTIME);
+    written += dumpIfPresent(out, "max-sessions", runcfg.max_sessions, DEFAULT_MAX_SESSIONS);
+    written += dumpIfPresent(out, "max-destinations", runcfg.max_destinations, DEFAULT_MAX_DESTINATIONS);
+    written += dumpIfPresent(out, "batch-io", runcfg.batch_io, DEFAULT_BATCH_IO);
+    written += dumpIfPresent(out, "rx-ring", runcfg.rx_ring, DEFAULT_RX_RING);
+    written += dumpIfPresent(out, "tx-ring", runcfg.tx_ring, DEFAULT_TX_RING);
+    written += dumpIfPresent(out, "tun-read-queues", runcfg.tun_read_queues, DEFAULT_TUN_READ_QUEUES);
+    written += dumpIfPresent(out, "tun-gso", runcfg.tun_gso, DEFAULT_TUN_GSO);
+    written += dumpIfPresent(out, "xdp", runcfg.xdp, DEFAULT_XDP);
+    written += dumpIfPresent(out, "io-uring", runcfg.io_uring, DEFAULT_IO_URING);
 
     if (!syncPortsFiles() || !syncIPListsFiles())
     {
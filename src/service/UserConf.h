@@ -56,10 +56,29 @@ struct sj_cmdline_opts
     uint16_t debug_level;
     char onlyplugin[MEDIUMBUF];
     uint16_t max_ttl_probe;
+    uint16_t max_keep_time;
+    uint32_t max_sessions;
+    uint32_t max_destinations;
     char gw_mac_str[SMALLBUF];
+    bool batch_io;
+    bool rx_ring;
+    bool tx_ring;
+    uint16_t tun_read_queues;
+    bool tun_gso;
+    bool xdp;
+    bool io_uring;
     /* END OF COMMON PART WITH sj_config THAT WILL BE SAVED IN CONF FILE */
 
     bool force_restart;
+
+    /* replay mode: the captures used in place of the tun and of the network */
+    bool replay;
+    char replay_tunnel[MEDIUMBUF];
+    char replay_network[MEDIUMBUF];
+    char replay_output[MEDIUMBUF];
+
+    /* the seed of the random engine, 0 when it's random */
+    uint64_t seed;
 };
 
 /* this is the struct keeping the sniffjoke variables, is loaded
@@ -90,7 +109,17 @@ struct sj_config
     uint16_t debug_level;
     char onlyplugin[MEDIUMBUF];
     uint16_t max_ttl_probe;
+    uint16_t max_keep_time;
+    uint32_t max_sessions;
+    uint32_t max_destinations;
     char gw_mac_str[SMALLBUF];
+    bool batch_io;
+    bool rx_ring;
+    bool tx_ring;
+    uint16_t tun_read_queues;
+    bool tun_gso;
+    bool xdp;
+    bool io_uring;
     /* END OF COMMON PART WITH sj_cmdline_opts THAT WILL BE SAVED IN CONF FILE */
 
     /* mangling policies */
@@ -130,9 +159,11 @@ private:
     bool parseKeyword(FILE *, char *, const char *);
     void parseMatch(char *, const char *, FILE *, const char *, const char *);
     void parseMatch(uint16_t &, const char *, FILE *, uint16_t, uint16_t);
+    void parseMatch(uint32_t &, const char *, FILE *, uint32_t, uint32_t);
     void parseMatch(bool &, const char *, FILE *, bool, bool);
     uint32_t dumpIfPresent(FILE *, const char *, char *, const char *);
     uint32_t dumpIfPresent(FILE *, const char *, uint16_t, uint16_t);
+    uint32_t dumpIfPresent(FILE *, const char *, uint32_t, uint32_t);
     uint32_t dumpIfPresent(FILE *, const char *, bool, bool);
 
     /* import of the file containing the port range settings, and load the
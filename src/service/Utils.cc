@@ -67,50 +67,43 @@ string execOSCmd(string cmd)
     return data;
 }
 
-void init_random()
+/*
+ * the seed is the one of the command line (--seed), for a reproducible
+ * run, or 0: in this case it is read from /dev/urandom.
+ */
+void init_random(uint64_t seed)
 {
-    /* random pool initialization */
-    srandom(time(NULL));
-    for (uint8_t i = 0; i < ((uint8_t) random() % 10); ++i)
-        srandom(random());
+    if (!seed)
+    {
+        FILE *urandom = fopen("/dev/urandom", "r");
+
+        if (urandom == NULL || fread(&seed, sizeof (seed), 1, urandom) != 1)
+            seed = ((uint64_t) time(NULL) << 32) ^ getpid();
+
+        if (urandom != NULL)
+            fclose(urandom);
+    }
+
+    Random::seed(seed);
 }
 
-void* memset_random(void *s, size_t n)
+uint32_t sj_random(void)
 {
-    /*
-     * highly optimized memset_random
-     *
-     * long int random(void).
-     *
-     * long int is variable on different architectures;
-     * for example on linux 64 bit is 8 chars long,
-     * so do a while using single chars its an inefficient choice.
-     *
-     */
+    return Random::engine().get();
+}
 
+uint32_t sj_random_below(uint32_t n)
+{
+    return Random::engine().below(n);
+}
+
+/* the keystream of the engine is generated straight in s */
+void* memset_random(void *s, size_t n)
+{
     if (debug.level() == TESTING_LEVEL)
-    {
         memset(s, '6', n);
-    }
     else
-    {
-        size_t longint = n / sizeof (long int);
-        size_t finalbytes = n % sizeof (long int);
-        unsigned char *cp = (unsigned char*) s;
-
-        while (longint-- > 0)
-        {
-            *((long int*) cp) = random();
-            cp += sizeof (long int);
-        }
-
-        while (finalbytes-- > 0)
-        {
-            *cp = (unsigned char) random();
-            ++cp;
-        }
-
-    }
+        Random::engine().fill(s, n);
 
     return s;
 }
@@ -120,7 +113,7 @@ bool random_percent(int32_t percent)
     if(debug.level() == TESTING_LEVEL)
         return true;
 
-    return ( (random() % 100) + 1 <= percent );
+    return ( (int32_t) sj_random_below(100) + 1 <= percent );
 }
 
 int snprintfScramblesList(char *str, size_t size, uint8_t scramblesList)
@@ -40,6 +40,7 @@
 #include <sstream>
 
 #include <algorithm>
+#include <deque>
 #include <map>
 #include <memory>
 #include <set>
@@ -54,30 +55,40 @@ using namespace std;
 #include <sys/stat.h>
 
 #include "Debug.h"
+#include "Random.h"
 
 /*
  * there is a single clock in sniffjoke;
  * it global and defined/initialized/updated by Sniffjoke.cc
+ * sj_clock_msec is a monotonic clock in milliseconds, the time of the
+ * timers; in replay mode both follow the captures.
  */
 extern time_t sj_clock;
+extern uint64_t sj_clock_msec;
 extern char sj_clock_str[MEDIUMBUF];
 
 #define ISSET_TTL(byte)         (byte & SCRAMBLE_TTL)
 #define ISSET_CHECKSUM(byte)    (byte & SCRAMBLE_CHECKSUM)
 #define ISSET_MALFORMED(byte)   (byte & SCRAMBLE_MALFORMED)
 #define ISSET_INNOCENT(byte)    (byte & SCRAMBLE_INNOCENT)
-#define RANDOM_IPOPT            ((random() % (LAST_IPOPT - FIRST_IPOPT )) + FIRST_IPOPT + 1)
-#define RANDOM_TCPOPT           ((random() % (LAST_TCPOPT - FIRST_TCPOPT )) + FIRST_TCPOPT + 1)
+#define RANDOM_IPOPT            ((sj_random() % (LAST_IPOPT - FIRST_IPOPT )) + FIRST_IPOPT + 1)
+#define RANDOM_TCPOPT           ((sj_random() % (LAST_TCPOPT - FIRST_TCPOPT )) + FIRST_TCPOPT + 1)
 
 /* std::runtime_error runtime_exception(const char *, const char *, uint32_t, const char *, ...); */
 std::runtime_error runtime_exception(const char *, const char *, ...);
 
 string execOSCmd(string cmd);
-void init_random(void);
+void init_random(uint64_t);
+uint32_t sj_random(void);
+uint32_t sj_random_below(uint32_t);
 void* memset_random(void *, size_t);
 int snprintfScramblesList(char *str, size_t size, uint8_t scramblesList);
 bool random_percent(int32_t percent);
 
+/*
+ * selflog() is an inline check of the level of the class, forwarding the
+ * arguments to selflogFormat() only when that level is enabled.
+ */
 #define SELFLOG(...) selflog(__func__, __VA_ARGS__)
 
 /* #define RUNTIME_EXCEPTION(...) throw runtime_exception(__func__, __FILE__, __LINE__, __VA_ARGS__) */
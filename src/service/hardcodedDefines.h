@@ -52,7 +52,17 @@
 #define DEFAULT_ONLYPLUGIN      ""
 #define DEFAULT_DEBUG_LEVEL     2
 #define DEFAULT_MAX_TTLPROBE    35
+#define DEFAULT_MAX_KEEPTIME    50 /* milliseconds, 0 is no limit */
+#define DEFAULT_MAX_SESSIONS    1024 /* the least recently used is evicted by a new one */
+#define DEFAULT_MAX_DESTINATIONS 1024 /* the same for the destinations */
 #define DEFAULT_GW_MAC_ADDR     ""
+#define DEFAULT_BATCH_IO        false
+#define DEFAULT_RX_RING         false
+#define DEFAULT_TX_RING         false
+#define DEFAULT_TUN_READ_QUEUES 1
+#define DEFAULT_TUN_GSO         false
+#define DEFAULT_XDP             false
+#define DEFAULT_IO_URING        false
 
 /* this is not configurabile anyway in some (wrong) local network the
  * class 1.0.0.0/8 is used and should be require change this puppet-IP */
@@ -113,6 +123,12 @@
 #define NET_IF_MTU              1492
 #define TUN_IF_MTU_DIFF         80
 
+/*
+  in GSO mode (IFF_VNET_HDR) every tun read begins with a virtio_net_hdr
+  and could be a TCP super-packet up to the max IP length.
+ */
+#define TUN_GSO_READSIZE        (65535 + 10)
+
 #define PORTSNUMBER             65536
 
 #define SCRAMBLE_TTL            1
@@ -186,15 +202,45 @@
 #define SUPPORTED_OPTIONS           (LAST_TCPOPT + 1)
 
 #define NETIOBURSTSIZE                          10      /* 10 CYCLES OF I/O (10 in + 10 out pkts max) */
-#define SESSIONTRACKMAP_MANAGE_ROUTINE_TIMER    300     /* (5 MINUTES */
-#define TTLFOCUSMAP_MANAGE_ROUTINE_TIMER        3600    /* (1 HOUR) */
+#define NETIO_FDS                               6       /* tunfd, netfd, txfd, tun_eventfd, xskfd AND uring_fd */
+#define NETIO_TIMER_PACE                        1000000 /* A DEADLINE ALREADY REACHED FIRES AFTER 1ms */
+#define NETIOBATCHSIZE                          64      /* PKTS MOVED BY A SINGLE recvmmsg/sendmmsg IN BATCH MODE */
+#define RXRING_BLOCK_SIZE                       131072  /* 128KB FOR EVERY TPACKET_V3 RX RING BLOCK */
+#define RXRING_BLOCK_NUM                        32      /* 4MB OF RX RING */
+#define RXRING_FRAME_SIZE                       2048    /* ONLY USED TO COMPUTE THE FRAME NUMBER, V3 FRAMES ARE VARIABLE */
+#define RXRING_RETIRE_TIMEOUT                   1       /* A PARTIALLY FILLED BLOCK IS RETIRED AFTER 1ms */
+#define TXRING_BLOCK_SIZE                       65536   /* 64KB FOR EVERY TPACKET_V2 TX RING BLOCK */
+#define TXRING_FRAME_SIZE                       2048    /* A FRAME KEEPS THE tpacket2_hdr AND A WHOLE MTU */
+#define TXRING_FRAME_NUM                        512     /* 1MB OF TX RING */
+#define TUNQUEUE_MAX                            16      /* MAX TUN QUEUES IN IFF_MULTI_QUEUE MODE */
+#define TUNQUEUE_RING_SLOTS                     256     /* POOL BUFFERS BETWEEN A TUN QUEUE WORKER AND THE CORE */
+#define TUNQUEUE_GSO_RING_SLOTS                 64      /* THE SAME IN GSO MODE, WHERE A SLOT KEEPS A 64KB SUPER-PACKET */
+#define XSK_FRAME_SIZE                          2048    /* A UMEM FRAME KEEPS THE XDP HEADROOM AND A WHOLE ETHERNET FRAME */
+#define XSK_FRAME_NUM                           4096    /* 8MB OF UMEM, HALF FOR RX AND HALF FOR TX */
+#define XSK_RING_SIZE                           2048    /* DESCRIPTORS OF THE FILL, COMPLETION, RX AND TX RINGS */
+#define XSK_QUEUE_ID                            0       /* THE INTERFACE QUEUE BOUND TO THE AF_XDP SOCKET */
+#define URING_ENTRIES                           512     /* SUBMISSION QUEUE ENTRIES OF THE io_uring */
+#define URING_WRITE_SLOTS                       256     /* PKTS WRITTEN BY io_uring AND WAITING THEIR COMPLETION */
+#define URING_BUFS                              256     /* PROVIDED BUFFERS FOR THE READS OF tunfd AND OF netfd (POWER OF 2) */
+#define URING_GSO_BUFS                          64      /* THE SAME FOR tunfd IN GSO MODE, WHERE A BUFFER KEEPS A 64KB SUPER-PACKET */
+#define LOGRING_SLOTS                           2048    /* LOG RECORDS BUFFERED BETWEEN THE LOGGING THREADS AND THE WRITER */
+#define LOGRING_RECORD_SIZE                     1024    /* FORMAT AND CAPTURED ARGUMENTS OF A RECORD, THE LONGER ARE TRUNCATED */
+#define LOGRING_WRITER_WAIT                     10      /* THE WRITER POLLS THE RING EVERY 10ms, OR WHEN HALF FULL */
+#define LOGRING_FLUSH_WAIT                      100     /* A FLUSH CHECKS THE WRITER EVERY 100us */
+#define PACKETPOOL_SLOTS                        16384   /* PACKETS (AND BUFFERS) KEPT BY THE POOLS OF A THREAD */
+#define PACKETPOOL_RESERVE                      1024    /* SLOTS KEPT FOR THE HACKS: UNDER IT THE PACKETS READ ARE DROPPED */
+#define PACKETPOOL_ALIGN                        64      /* THE POOL SLOTS ARE ALIGNED TO THE CACHE LINE */
+#define PACKETBUF_HEADROOM                      80      /* FREE BYTES IN FRONT OF A PACKET: 40 OF IP AND 40 OF TCP OPTIONS */
+#define REPLAY_MTU                              1500    /* THE NETWORK MTU SEEN BY THE CONNTRACK IN REPLAY MODE */
+#define REPLAY_SNAPLEN                          65535   /* BIGGEST RECORD ACCEPTED FROM A CAPTURE FILE */
 #define SESSIONTRACK_EXPIRYTIME                 200     /* access expire time in seconds (5 MINUTES) */
 #define TTLFOCUS_EXPIRYTIME                     604800  /* access expire time in seconds (1 WEEK) */
 #define PLUGINHASH_EXPIRYTIME                   10      /* hash expire time in seconds since creation (10 SECONDS)*/
+#define FILTERHASH_SLOTS                        16384   /* SLOTS OF A GENERATION OF THE INJECTED PACKETS FILTER (POWER OF 2) */
 #define PLUGINCACHE_EXPIRYTIME                  200     /* access expire time in seconds (5 MINUTES) */
-#define TTLFOCUSMAP_MEMORY_THRESHOLD            1024    /* 1024 DESTINATIONS */
-#define SESSIONTRACKMAP_MEMORY_THRESHOLD        1024    /* 1024 TCP SESSIONS */
 #define TTLPROBE_RETRY_ON_UNKNOWN               600     /* schedule time on UNKNOWN TTL status (10 MINUTES) */
+#define TTLPROBE_TIMEOUT                        2000    /* wait for the answers after the last ttl probe in ms (2 SECONDS) */
+#define KEEPWAIT_BUCKETS                        10      /* KEEP WAITS HISTOGRAM: <1ms, <2ms, <4ms ... <256ms AND MORE */
 
 /* enable the intensive debug: DEVELOPERS AND TESTER ONLY! */
 #if 0
@@ -68,6 +68,17 @@ struct command_ret
 #define STAT_WHITELIST      19
 #define STAT_BLACKLIST      20
 #define STAT_ONLYP          21
+#define STAT_RXRING_USED    22
+#define STAT_RXRING_SIZE    23
+#define STAT_RXRING_DROPS   24
+#define STAT_TXRING_USED    25
+#define STAT_TXRING_SIZE    26
+#define STAT_TXRING_DROPS   27
+#define STAT_KEEPWAIT       28
+#define STAT_KEEPEXPIRED    29
+#define STAT_POOL_USED      30
+#define STAT_POOL_SIZE      31
+#define STAT_POOL_DROPS     32
 
 /* and in SJStatus are used this struct for describe the single block */
 struct single_block
@@ -35,6 +35,17 @@ void sigtrap(int signal)
     sniffjoke->alive = false;
 }
 
+/* UserConf does chdir in the location: the captures need an absolute path */
+static void sj_replay_path(char *dst, size_t len, const char *path)
+{
+    char cwd[MEDIUMBUF];
+
+    if (path[0] == '/' || getcwd(cwd, sizeof (cwd)) == NULL)
+        snprintf(dst, len, "%s", path);
+    else
+        snprintf(dst, len, "%s/%s", cwd, path);
+}
+
 static void sj_version(const char *pname)
 {
     printf("%s %s\n", SW_NAME, SW_VERSION);
@@ -59,6 +70,21 @@ static void sj_version(const char *pname)
     " --admin <ip>[:port]\tspecify administration IP address [default: %s:%d]\n"\
     " --force\t\tforce restart (usable when another sniffjoke service is running)\n"\
     " --gw-mac-addr\t\tspecify default gateway mac address [default: is autodetected]\n"\
+    " --max-keep-time <ms>\tmax wait of a packet for the ttl bruteforce, 0 is no limit [default: %d]\n"\
+    " --max-sessions <n>\tsessions tracked, over it the least recently used is evicted [default: %d]\n"\
+    " --max-destinations <n> destinations tracked for the ttl, the same [default: %d]\n"\
+    " --batch-io\t\tuse recvmmsg/sendmmsg bursts on the network side [default: %s]\n"\
+    " --rx-ring\t\tread the network side from a TPACKET_V3 mmap ring [default: %s]\n"\
+    " --tx-ring\t\twrite the network side through a PACKET_TX_RING [default: %s]\n"\
+    " --tun-read-queues <n> IFF_MULTI_QUEUE tun queues read by their own threads,\n"\
+    "\t\t\tthe conntrack stays on a single core [default: %d]\n"\
+    " --tun-gso\t\taccept TSO/GSO super-packets from the tun (IFF_VNET_HDR) [default: %s]\n"\
+    " --xdp\t\t\tuse an AF_XDP socket for the traffic with the gateway [default: %s]\n"\
+    " --io-uring\t\tread and write tun and network through io_uring [default: %s]\n"\
+    " --replay-tunnel <file>\treplay a pcap capture as the traffic of the tun (no root required)\n"\
+    " --replay-network <file> replay a pcap capture as the traffic of the network\n"\
+    " --replay-output <file>\twrite the packets sent by sniffjoke in a pcap capture\n"\
+    " --seed <n>\t\tseed of the random engine, for reproducible runs [default: random]\n"\
     " --version\t\tshow sniffjoke version\n"\
     " --help\t\t\tshow this help\n\n"\
     "\t\t\thttp://www.delirandom.net/sniffjoke\n"
@@ -76,19 +102,23 @@ static void sj_help(const char *pname)
            DEFAULT_CHAINING ? "enabled" : "disabled",
            SUPPRESS_LEVEL, PACKET_LEVEL, DEFAULT_DEBUG_LEVEL,
            SUPPRESS_LEVEL, ALL_LEVEL, VERBOSE_LEVEL, DEBUG_LEVEL, SESSION_LEVEL, PACKET_LEVEL,
-           DEFAULT_ADMIN_ADDRESS, DEFAULT_ADMIN_PORT
+           DEFAULT_ADMIN_ADDRESS, DEFAULT_ADMIN_PORT,
+           DEFAULT_MAX_KEEPTIME,
+           DEFAULT_MAX_SESSIONS,
+           DEFAULT_MAX_DESTINATIONS,
+           DEFAULT_BATCH_IO ? "enabled" : "disabled",
+           DEFAULT_RX_RING ? "enabled" : "disabled",
+           DEFAULT_TX_RING ? "enabled" : "disabled",
+           DEFAULT_TUN_READ_QUEUES,
+           DEFAULT_TUN_GSO ? "enabled" : "disabled",
+           DEFAULT_XDP ? "enabled" : "disabled",
+           DEFAULT_IO_URING ? "enabled" : "disabled"
            );
 }
 
 int main(int argc, char **argv)
 {
 
-    if (getuid() || geteuid())
-    {
-        printf("SniffJoke is too dangerous to be run by an humble user; go to fetch daddy root, now!\n");
-        exit(1);
-    }
-
     /*
      * set the default values in the configuration struct
      */
@@ -106,7 +136,18 @@ int main(int argc, char **argv)
     useropt.go_foreground = DEFAULT_GO_FOREGROUND;
     useropt.debug_level = DEFAULT_DEBUG_LEVEL;
     useropt.max_ttl_probe = DEFAULT_MAX_TTLPROBE;
+    useropt.max_keep_time = DEFAULT_MAX_KEEPTIME;
+    useropt.max_sessions = DEFAULT_MAX_SESSIONS;
+    useropt.max_destinations = DEFAULT_MAX_DESTINATIONS;
+    useropt.batch_io = DEFAULT_BATCH_IO;
+    useropt.rx_ring = DEFAULT_RX_RING;
+    useropt.tx_ring = DEFAULT_TX_RING;
+    useropt.tun_read_queues = DEFAULT_TUN_READ_QUEUES;
+    useropt.tun_gso = DEFAULT_TUN_GSO;
+    useropt.xdp = DEFAULT_XDP;
+    useropt.io_uring = DEFAULT_IO_URING;
     useropt.force_restart = false;
+    useropt.replay = false;
 
     /*
      * no explicit inizialization needed for string values;
@@ -131,13 +172,27 @@ int main(int argc, char **argv)
         { "only-plugin", required_argument, NULL, 'p'}, /* not documented in --help */
         { "max-ttl-probe", required_argument, NULL, 'm'}, /* not documented too */
         { "gw-mac-addr", required_argument, NULL, 'e'},
+        { "max-keep-time", required_argument, NULL, 'k'},
+        { "max-sessions", required_argument, NULL, 'M'},
+        { "max-destinations", required_argument, NULL, 'D'},
+        { "batch-io", no_argument, NULL, 'B'},
+        { "rx-ring", no_argument, NULL, 'R'},
+        { "tx-ring", no_argument, NULL, 'T'},
+        { "tun-read-queues", required_argument, NULL, 'q'},
+        { "tun-gso", no_argument, NULL, 'G'},
+        { "xdp", no_argument, NULL, 'X'},
+        { "io-uring", no_argument, NULL, 'U'},
+        { "replay-tunnel", required_argument, NULL, 'I'},
+        { "replay-network", required_argument, NULL, 'N'},
+        { "replay-output", required_argument, NULL, 'O'},
+        { "seed", required_argument, NULL, 'S'},
         { "version", no_argument, NULL, 'v'},
         { "help", no_argument, NULL, 'h'},
         { NULL, 0, NULL, 0}
     };
 
     int charopt;
-    while ((charopt = getopt_long(argc, argv, "i:o:u:g:a:ctlwbsxrd:p:m:vh", sj_option, NULL)) != -1)
+    while ((charopt = getopt_long(argc, argv, "i:o:u:g:a:ctlwbsxrd:p:m:k:M:D:BRTq:GXUI:N:O:S:vh", sj_option, NULL)) != -1)
     {
         switch (charopt)
         {
@@ -207,6 +262,52 @@ int main(int argc, char **argv)
         case 'm':
             useropt.max_ttl_probe = atoi(optarg);
             break;
+        case 'k':
+            useropt.max_keep_time = atoi(optarg);
+            break;
+        case 'M':
+            useropt.max_sessions = strtoul(optarg, NULL, 10);
+            break;
+        case 'D':
+            useropt.max_destinations = strtoul(optarg, NULL, 10);
+            break;
+        case 'B':
+            useropt.batch_io = true;
+            break;
+        case 'R':
+            useropt.rx_ring = true;
+            break;
+        case 'T':
+            useropt.tx_ring = true;
+            break;
+        case 'G':
+            useropt.tun_gso = true;
+            break;
+        case 'X':
+            useropt.xdp = true;
+            break;
+        case 'U':
+            useropt.io_uring = true;
+            break;
+        case 'I':
+            sj_replay_path(useropt.replay_tunnel, sizeof (useropt.replay_tunnel), optarg);
+            useropt.replay = true;
+            break;
+        case 'N':
+            sj_replay_path(useropt.replay_network, sizeof (useropt.replay_network), optarg);
+            useropt.replay = true;
+            break;
+        case 'O':
+            sj_replay_path(useropt.replay_output, sizeof (useropt.replay_output), optarg);
+            break;
+        case 'S':
+            useropt.seed = strtoull(optarg, NULL, 10);
+            break;
+        case 'q':
+            useropt.tun_read_queues = atoi(optarg);
+            if (useropt.tun_read_queues < 1 || useropt.tun_read_queues > TUNQUEUE_MAX)
+                goto sniffjoke_help;
+            break;
         case 'v':
             sj_version(argv[0]);
             return 0;
@@ -221,7 +322,16 @@ sniffjoke_help:
         }
     }
 
-    init_random();
+    /* the replay mode does not touch the system: it's the only one allowed to an user */
+    if (useropt.replay)
+        useropt.go_foreground = true;
+    else if (getuid() || geteuid())
+    {
+        printf("SniffJoke is too dangerous to be run by an humble user; go to fetch daddy root, now!\n");
+        exit(1);
+    }
+
+    init_random(useropt.seed);
 
     try
     {